@@ -0,0 +1,47 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+/*
+ * Counts heap allocations made by the current thread while a guard is alive.
+ * Counting is compiled in only with ROAR_ALLOCATION_GUARD defined,
+ * otherwise the guard does nothing.
+ */
+class AllocationGuard {
+public:
+
+#ifdef ROAR_ALLOCATION_GUARD
+    AllocationGuard();
+    ~AllocationGuard();
+
+    static bool isEnabled() {
+        return true;
+    }
+
+    // Allocations made inside guards so far.
+    static std::uint64_t getCount();
+#else
+    AllocationGuard() {}
+
+    static bool isEnabled() {
+        return false;
+    }
+
+    static std::uint64_t getCount() {
+        return 0;
+    }
+#endif
+};
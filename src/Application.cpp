@@ -16,20 +16,75 @@
 #include "Application.h"
 #include "Window.h"
 #include "SoundPlayer.h"
+#include "XAudio2Backend.h"
+#include "Calibration.h"
+#include "KeyTrace.h"
+#include "FlightRecorder.h"
+#include "MetricsPublisher.h"
+#include "Trace.h"
+
+// Seconds of silence before the audio output is suspended.
+static const int DEFAULT_IDLE_SECONDS = 30;
+
+static const int DEFAULT_TRIM_SECONDS = 600;
+
+static const wchar_t DEFAULT_FLIGHT_FILE[] = L"roar-flight.bin";
+
+static const wchar_t KEY_USAGE_FILE[] = L"key-usage.json";
+
+static const wchar_t DEFAULT_CALIBRATION_FILE[] = L"roar-calibration.txt";
+
+static AudioBackend* createCalibrationBackend(const Calibration::Setting& setting)
+{
+    return XAudio2Backend::create(setting.blockFrames, setting.bufferCount);
+}
+
+static void usage()
+{
+    std::cerr << "usage: roar [--block-frames <frames>] [--buffers <count>] [--volume <percent>]"
+        " [--voices <count>] [--idle-timeout <s>] [--trim-timeout <s>]"
+        " [--max-rate <starts per second>] [--collapse-floods] [--no-reverb]"
+        " [--record-trace <file>] [--trace-file <file>] [--flight-file <file>]"
+        " [--metrics-file <file>] [--metrics-pipe <name>]"
+        " [--calibrate] [--calibration-file <file>]" << std::endl;
+}
+
+// Leaves the last moments before a crash behind for roar-flight.
+static LONG WINAPI dumpFlightRecording(EXCEPTION_POINTERS* /*exception*/)
+{
+    FlightRecorder::get().dump();
+    return EXCEPTION_CONTINUE_SEARCH;
+}
 
 Application::Application(HINSTANCE module)
 :   module(module),
-    repository(getDirectories(module))
+    repository(getDirectories(module)),
+    keyUsage(getHomeDirectory(module) / KEY_USAGE_FILE)
 {
     Window::registerClass(module);
 }
 
 int Application::run(const wchar_t* commandLine, int show)
 {
+    TRACE_OUTPUT(Path(getOption(L"--trace-file")));
+    TRACE_ZONE("Application::run");
+
+    setUpFlightRecorder();
+
     HRESULT hr = ::CoInitializeEx( nullptr, COINIT_MULTITHREADED );
     if (FAILED(hr))
         return 1;
 
+    // The clips of the keys pressed most are ready first.
+    keyUsage.load();
+    repository.setKeyUsage(&keyUsage);
+
+    if (hasOption(L"--calibrate")) {
+        int result = calibrate();
+        ::CoUninitialize();
+        return result;
+    }
+
     SoundPack* soundPack = repository.loadDefault();
 
     SoundPlayer* soundPlayer = createSoundPlayer(soundPack);
@@ -38,10 +93,21 @@ int Application::run(const wchar_t* commandLine, int show)
     }
 
     Window* window = Window::create(L"Hello Window", soundPlayer, module);
+    window->setTraceWriter(createTraceWriter());
+    window->setKeyUsage(&keyUsage);
     window->show(SW_HIDE);
 
+    MetricsPublisher* metricsPublisher = MetricsPublisher::create(
+        soundPlayer,
+        Path(getOption(L"--metrics-file")),
+        getOption(L"--metrics-pipe"));
+
+    // Startup is complete, the trace is written again on exit.
+    TRACE_FLUSH();
+
     loop();
 
+    delete metricsPublisher;
     delete window;
     delete soundPlayer;
 
@@ -52,14 +118,82 @@ int Application::run(const wchar_t* commandLine, int show)
 
 SoundPlayer* Application::createSoundPlayer(SoundPack* soundPack)
 {
-    SoundPlayer* soundPlayer = SoundPlayer::create();
+    TRACE_ZONE("Application::createSoundPlayer");
+
+    // Numbers are parsed before anything is created, so nothing leaks if one is malformed.
+    int blockFrames = 0;
+    int buffers = XAudio2Backend::DEFAULT_BUFFER_COUNT;
+    int volume = 100;
+    int voices = SoundPlayer::DEFAULT_VOICES;
+    int idleSeconds = DEFAULT_IDLE_SECONDS;
+    int trimSeconds = DEFAULT_TRIM_SECONDS;
+    InputThrottle::Limits limits;
+    try {
+        blockFrames = getIntOption(L"--block-frames", blockFrames);
+        buffers = getIntOption(L"--buffers", buffers);
+        volume = getIntOption(L"--volume", volume);
+        voices = getIntOption(L"--voices", voices);
+        idleSeconds = getIntOption(L"--idle-timeout", idleSeconds);
+        trimSeconds = getIntOption(L"--trim-timeout", trimSeconds);
+        limits.startsPerSecond = getIntOption(L"--max-rate", limits.startsPerSecond);
+    } catch (const std::logic_error&) {
+        usage();
+        return nullptr;
+    }
+    limits.collapseFloods = hasOption(L"--collapse-floods");
+
+    XAudio2Backend* backend = XAudio2Backend::create(blockFrames, buffers);
+
+    SoundPlayer* soundPlayer = SoundPlayer::create(backend);
     if (soundPlayer != nullptr) {
+        soundPlayer->setVolume(volume / 100.0f);
+        soundPlayer->setVoiceCount(voices);
+        soundPlayer->setIdleTimeout(idleSeconds * 1000);
+        soundPlayer->setTrimTimeout(trimSeconds * 1000);
+        soundPlayer->setInputLimits(limits);
+        soundPlayer->setReverb(!hasOption(L"--no-reverb"));
         soundPlayer->setSoundPack(soundPack);
     }
 
     return soundPlayer;
 }
 
+/*
+ * Measures every block setting on the default device and writes the results,
+ * to choose --block-frames and --buffers.
+ */
+int Application::calibrate()
+{
+    TRACE_ZONE("Application::calibrate");
+
+    Calibration calibration(createCalibrationBackend);
+    auto results = calibration.run(repository, Calibration::getDefaultSettings());
+    if (results.empty()) {
+        return 1;
+    }
+
+    std::wstring path = getOption(L"--calibration-file");
+    std::ofstream out(path.empty() ? getHomeDirectory(module) / DEFAULT_CALIBRATION_FILE : Path(path));
+    Calibration::report(results, out);
+    return out ? 0 : 1;
+}
+
+void Application::setUpFlightRecorder()
+{
+    std::wstring path = getOption(L"--flight-file");
+    FlightRecorder::get().setPath(path.empty() ? getHomeDirectory(module) / DEFAULT_FLIGHT_FILE : Path(path));
+    ::SetUnhandledExceptionFilter(dumpFlightRecording);
+}
+
+KeyTraceWriter* Application::createTraceWriter()
+{
+    std::wstring path = getOption(L"--record-trace");
+    if (path.empty()) {
+        return nullptr;
+    }
+    return KeyTraceWriter::create(Path(path));
+}
+
 void Application::loop()
 {
     MSG msg{};
@@ -69,6 +203,62 @@ void Application::loop()
     }
 }
 
+/*
+ * Returns the value following the given option on the command line,
+ * or an empty string if the option is not specified.
+ */
+std::wstring Application::getOption(const wchar_t* name)
+{
+    std::wstring value;
+
+    int argc = 0;
+    wchar_t** argv = ::CommandLineToArgvW(::GetCommandLineW(), &argc);
+    if (argv == nullptr) {
+        return value;
+    }
+
+    for (int i = 1; i + 1 < argc; i++) {
+        if (::wcscmp(argv[i], name) == 0) {
+            value = argv[i + 1];
+            break;
+        }
+    }
+
+    ::LocalFree(argv);
+    return value;
+}
+
+/*
+ * Returns the number following the given option, or the default value
+ * if the option is not specified. Throws std::invalid_argument or
+ * std::out_of_range if the value is not a number.
+ */
+int Application::getIntOption(const wchar_t* name, int defaultValue)
+{
+    std::wstring value = getOption(name);
+    return value.empty() ? defaultValue : std::stoi(value);
+}
+
+bool Application::hasOption(const wchar_t* name)
+{
+    int argc = 0;
+    wchar_t** argv = ::CommandLineToArgvW(::GetCommandLineW(), &argc);
+    if (argv == nullptr) {
+        return false;
+    }
+
+    bool found = false;
+    for (int i = 1; i < argc; i++) {
+        if (::wcscmp(argv[i], name) == 0) {
+            found = true;
+            break;
+        }
+    }
+
+    ::LocalFree(argv);
+    return found;
+}
+
 Application::PathSet Application::getDirectories(HINSTANCE module)
 {
     PathSet dirs;
@@ -90,5 +280,7 @@ Application::Path Application::getHomeDirectory(HINSTANCE module)
 int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE /*hPrevInstance*/, wchar_t* commandLine, int show)
 {
     Application app(hInstance);
-    return app.run(commandLine, show);
+    int result = app.run(commandLine, show);
+    TRACE_FLUSH();
+    return result;
 }
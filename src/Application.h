@@ -16,9 +16,11 @@
 #pragma once
 
 #include "SoundPackRepository.h"
+#include "KeyUsage.h"
 
 class SoundPlayer;
 class SoundPack;
+class KeyTraceWriter;
 
 class Application {
 private:
@@ -30,6 +32,8 @@ private:
 
     SoundPackRepository repository;
 
+    KeyUsage keyUsage;
+
 public:
 
     Application(HINSTANCE module);
@@ -40,8 +44,20 @@ private:
 
     SoundPlayer* createSoundPlayer(SoundPack* soundPack);
 
+    int calibrate();
+
+    void setUpFlightRecorder();
+
+    KeyTraceWriter* createTraceWriter();
+
     void loop();
 
+    std::wstring getOption(const wchar_t* name);
+
+    int getIntOption(const wchar_t* name, int defaultValue);
+
+    bool hasOption(const wchar_t* name);
+
     PathSet getDirectories(HINSTANCE module);
 
     Path getHomeDirectory(HINSTANCE module);
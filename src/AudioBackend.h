@@ -0,0 +1,77 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+struct AudioFormat {
+    int numberOfChannels;
+    int samplingRate;
+
+    bool operator==(const AudioFormat& other) const {
+        return numberOfChannels == other.numberOfChannels
+            && samplingRate == other.samplingRate;
+    }
+
+    bool operator!=(const AudioFormat& other) const {
+        return !(*this == other);
+    }
+};
+
+/*
+ * Produces the interleaved 32-bit float samples pulled by a backend.
+ */
+class AudioRenderer {
+public:
+
+    virtual ~AudioRenderer() {};
+
+    // Called on the thread of the backend.
+    virtual void render(float* buffer, int frames) = 0;
+};
+
+/*
+ * Output device which pulls blocks of samples from a renderer.
+ */
+class AudioBackend {
+public:
+
+    virtual ~AudioBackend() {};
+
+    virtual bool open(const AudioFormat& format, AudioRenderer* renderer) = 0;
+
+    virtual void close() = 0;
+
+    // Number of frames rendered since the backend was opened.
+    virtual std::uint64_t getFramePosition() = 0;
+
+    // Current time of the clock driving the backend, in microseconds.
+    virtual std::uint64_t getTime() = 0;
+
+    // Number of times the output ran out of rendered blocks.
+    virtual std::uint64_t getUnderruns() = 0;
+
+    // Frames still to be played when the last block was rendered,
+    // which are heard before that block.
+    virtual std::uint64_t getOutputDelay() = 0;
+
+    // Stops pulling blocks and lets the device go idle, keeping the clock running.
+    virtual void suspend() = 0;
+
+    // Pulls blocks again after suspend(), starting with the next frame.
+    // Stays suspended if the device cannot be restarted.
+    virtual bool resume() = 0;
+
+    virtual bool isSuspended() = 0;
+};
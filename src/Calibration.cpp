@@ -0,0 +1,179 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "Calibration.h"
+#include "SoundPackRepository.h"
+#include "SoundPlayer.h"
+#include "SoundPack.h"
+#include "Trace.h"
+
+using Clock = std::chrono::steady_clock;
+
+// Letters, space and enter, which make up most of typing.
+static const std::uint16_t TYPING_KEYS[] = {
+    0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19,
+    0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26,
+    0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32,
+    0x39, 0x39, 0x39, 0x1c
+};
+
+Calibration::Calibration(BackendFactory createBackend)
+:   createBackend(createBackend),
+    trace(synthesizeTrace(SECONDS_PER_SETTING))
+{
+}
+
+std::vector<Calibration::Setting> Calibration::getDefaultSettings()
+{
+    std::vector<Setting> settings;
+    for (int blockFrames : {64, 128, 256, 480, 960}) {
+        for (int bufferCount : {2, 3, 4}) {
+            settings.push_back(Setting{blockFrames, bufferCount});
+        }
+    }
+    return settings;
+}
+
+/*
+ * Typing at about 8 keys per second, with now and then a burst of keys
+ * pressed nearly at once. The generator is seeded so every setting and
+ * every run plays the same trace.
+ */
+std::vector<KeyEvent> Calibration::synthesizeTrace(int seconds)
+{
+    std::vector<KeyEvent> events;
+    std::uint32_t state = 0x2545f491;
+    auto next = [&state](std::uint32_t range) {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) % range;
+    };
+
+    const std::uint64_t end = (std::uint64_t) seconds * 1000000;
+    std::uint64_t timestamp = 200000;
+    while (timestamp < end) {
+        const int keys = (next(10) == 0) ? 3 : 1;
+        for (int i = 0; i < keys && timestamp < end; i++) {
+            std::uint16_t scanCode = TYPING_KEYS[next(std::size(TYPING_KEYS))];
+            events.push_back(KeyEvent{timestamp, scanCode, true});
+            timestamp += 8000 + next(12000);
+        }
+        timestamp += 40000 + next(180000);
+    }
+    return events;
+}
+
+std::vector<Calibration::Result> Calibration::run(SoundPackRepository& repository, const std::vector<Setting>& settings)
+{
+    TRACE_ZONE("Calibration::run");
+
+    std::vector<Result> results;
+    for (const auto& setting : settings) {
+        SoundPack* soundPack = repository.loadDefault();
+        if (soundPack == nullptr) {
+            break;
+        }
+        soundPack->waitForClips();
+        results.push_back(measure(soundPack, setting));
+    }
+    return results;
+}
+
+/*
+ * Plays the trace in real time. The latency of a sound is its onset
+ * in the rendered stream, relative to the frame being rendered when the
+ * key was pressed, plus the frames queued ahead of the block it starts in.
+ */
+Calibration::Result Calibration::measure(SoundPack* soundPack, const Setting& setting)
+{
+    Result result{setting, false, 0, 0.0, 0.0, 0, 0.0};
+
+    AudioBackend* backend = createBackend(setting);
+    SoundPlayer* player = SoundPlayer::create(backend);
+    if (player == nullptr) {
+        delete soundPack;
+        return result;
+    }
+
+    const int samplingRate = soundPack->getSamplingRate();
+    player->setVolume(0.0f);
+    player->setIdleTimeout(0);
+    if (!player->setSoundPack(soundPack)) {
+        delete player;
+        return result;
+    }
+
+    std::uint64_t delaySum = 0;
+    std::uint64_t delayMax = 0;
+    std::uint64_t delayCount = 0;
+
+    const Clock::time_point start = Clock::now();
+    for (const auto& event : trace) {
+        std::this_thread::sleep_until(start + std::chrono::microseconds(event.timestamp));
+        player->playSound(event.scanCode);
+
+        std::uint64_t delay = backend->getOutputDelay();
+        delaySum += delay;
+        delayMax = std::max(delayMax, delay);
+        delayCount++;
+    }
+    // Lets the last sounds start.
+    std::this_thread::sleep_until(start + std::chrono::seconds(SECONDS_PER_SETTING));
+    const double elapsedMicros = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+    SoundPlayer::Statistics statistics = player->getStatistics();
+    Metrics& metrics = player->getMetrics();
+
+    const double millisPerFrame = 1000.0 / samplingRate;
+    const double meanDelay = (delayCount > 0) ? (double) delaySum / delayCount : 0.0;
+    result.opened = statistics.onset.count > 0;
+    result.plays = statistics.plays;
+    result.meanLatencyMillis = (statistics.onset.getMean() + meanDelay) * millisPerFrame;
+    result.maxLatencyMillis = (statistics.onset.maximum + delayMax) * millisPerFrame;
+    result.underruns = metrics.underruns;
+    result.cpuPercent = 100.0 * metrics.renderMicros / elapsedMicros;
+
+    delete player;
+    return result;
+}
+
+void Calibration::report(const std::vector<Result>& results, std::ostream& out)
+{
+    out << "block frames  buffers  latency mean  latency max  underruns  cpu" << std::endl;
+
+    const Result* best = nullptr;
+    for (const auto& result : results) {
+        out << std::setw(12) << result.setting.blockFrames
+            << std::setw(9) << result.setting.bufferCount;
+        if (!result.opened) {
+            out << "  no output" << std::endl;
+            continue;
+        }
+        out << std::fixed << std::setprecision(1)
+            << std::setw(11) << result.meanLatencyMillis << " ms"
+            << std::setw(10) << result.maxLatencyMillis << " ms"
+            << std::setw(11) << result.underruns
+            << std::setw(6) << std::setprecision(2) << result.cpuPercent << " %" << std::endl;
+        if (result.underruns == 0 && (best == nullptr || result.meanLatencyMillis < best->meanLatencyMillis)) {
+            best = &result;
+        }
+    }
+
+    if (best != nullptr) {
+        out << "lowest latency without underruns: --block-frames " << best->setting.blockFrames
+            << " --buffers " << best->setting.bufferCount << std::endl;
+    } else {
+        out << "every setting underran" << std::endl;
+    }
+}
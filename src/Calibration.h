@@ -0,0 +1,80 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "KeyTrace.h"
+
+class AudioBackend;
+class SoundPackRepository;
+class SoundPack;
+
+/*
+ * Sweeps the length of the blocks of the audio output and the number of
+ * blocks in flight, playing the same synthetic typing with each, and
+ * measures the latency from key events to the output, the underruns and
+ * the time spent rendering.
+ */
+class Calibration {
+public:
+
+    struct Setting {
+        int blockFrames;
+        int bufferCount;
+    };
+
+    struct Result {
+        Setting setting;
+        bool opened;
+        std::uint64_t plays;
+        // From key events until their sounds are handed to the device,
+        // which adds a latency of its own.
+        double meanLatencyMillis;
+        double maxLatencyMillis;
+        std::uint64_t underruns;
+        // Share of the real time spent rendering.
+        double cpuPercent;
+    };
+
+    using BackendFactory = AudioBackend* (*)(const Setting& setting);
+
+private:
+
+    static constexpr int SECONDS_PER_SETTING = 4;
+
+    BackendFactory createBackend;
+
+    // Key downs only.
+    std::vector<KeyEvent> trace;
+
+public:
+
+    Calibration(BackendFactory createBackend);
+
+    static std::vector<Setting> getDefaultSettings();
+
+    // Loads the default pack of the repository afresh for each setting,
+    // since the player owns it.
+    std::vector<Result> run(SoundPackRepository& repository, const std::vector<Setting>& settings);
+
+    // One line per setting, followed by the lowest latency without underruns.
+    static void report(const std::vector<Result>& results, std::ostream& out);
+
+private:
+
+    static std::vector<KeyEvent> synthesizeTrace(int seconds);
+
+    Result measure(SoundPack* soundPack, const Setting& setting);
+};
@@ -0,0 +1,60 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "ClipLoudness.h"
+#include "Simd.h"
+
+static const double FULL_SCALE = 32768.0;
+static const double DECAY_FRACTION = 0.9;
+
+ClipLoudness ClipLoudness::analyze(const std::int16_t* samples, std::uint64_t length, int channels, int samplingRate)
+{
+    ClipLoudness loudness;
+    const std::uint64_t frames = (channels > 0) ? length / channels : 0;
+    if (frames == 0) {
+        return loudness;
+    }
+
+    double segmentEnergy[SEGMENTS]{};
+    double total = 0.0;
+    for (int s = 0; s < SEGMENTS; s++) {
+        std::uint64_t start = frames * s / SEGMENTS * channels;
+        std::uint64_t end = frames * (s + 1) / SEGMENTS * channels;
+        segmentEnergy[s] = (double) simd::sumOfSquares(samples + start, end - start) / (FULL_SCALE * FULL_SCALE);
+        total += segmentEnergy[s];
+    }
+
+    loudness.peak = (float) (simd::peak(samples, frames * channels) / FULL_SCALE);
+    loudness.energy = (float) total;
+    loudness.rms = (float) std::sqrt(total / (frames * channels));
+
+    double left = total;
+    double decayFrame = 0.0;
+    bool decayed = false;
+    for (int s = 0; s < SEGMENTS; s++) {
+        loudness.remaining[s] = (total > 0.0) ? (float) (left / total) : 0.0f;
+        double after = left - segmentEnergy[s];
+        // Interpolates within the segment in which the energy drops below the threshold.
+        if (!decayed && total > 0.0 && after <= total * (1.0 - DECAY_FRACTION)) {
+            double within = (left - total * (1.0 - DECAY_FRACTION)) / std::max(segmentEnergy[s], 1e-12);
+            decayFrame = (frames * s + frames * std::min(1.0, within)) / SEGMENTS;
+            decayed = true;
+        }
+        left = std::max(0.0, after);
+    }
+    loudness.decayMillis = (float) (decayFrame * 1000.0 / samplingRate);
+
+    return loudness;
+}
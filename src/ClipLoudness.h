@@ -0,0 +1,50 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+/*
+ * Levels of a clip measured when the sound pack is loaded,
+ * full scale being 1.
+ */
+struct ClipLoudness {
+
+    static constexpr int SEGMENTS = 16;
+
+    float peak = 0.0f;
+    float rms = 0.0f;
+    // Sum of the squared samples.
+    float energy = 0.0f;
+    // Time by which 90 percent of the energy has been played.
+    float decayMillis = 0.0f;
+    // Fraction of the energy left at the start of each of the segments of equal length.
+    float remaining[SEGMENTS] = {};
+    // Gain bringing the clip in line with the others of the pack.
+    float gain = 1.0f;
+
+    static ClipLoudness analyze(const std::int16_t* samples, std::uint64_t length, int channels, int samplingRate);
+
+    // Energy left to play from a position in samples, with the gain applied.
+    float getRemainingEnergy(std::uint64_t position, std::uint64_t length) const {
+        if (length == 0 || position >= length) {
+            return 0.0f;
+        }
+        float x = (float) position / length * SEGMENTS;
+        int segment = (int) x;
+        float next = (segment + 1 < SEGMENTS) ? remaining[segment + 1] : 0.0f;
+        float fraction = remaining[segment] + (next - remaining[segment]) * (x - segment);
+        return energy * gain * gain * fraction;
+    }
+};
@@ -0,0 +1,240 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "ConvolutionReverb.h"
+#include "SoundResource.h"
+#include "Simd.h"
+
+/*
+ * Impulse responses are normalized to unit energy, so that the wet gain
+ * alone sets the level of the reverberation.
+ */
+ConvolutionReverb* ConvolutionReverb::create(SoundResource* impulse, int numberOfChannels, int samplingRate, float wet)
+{
+    if (impulse->getSamplingRate() != samplingRate) {
+        std::cerr << "Impulse response sampled at " << impulse->getSamplingRate()
+            << " Hz rather than " << samplingRate << " Hz" << std::endl;
+        return nullptr;
+    }
+    if (impulse->getBitsPerSample() != 16 || impulse->getNumberOfChannels() > 2 || numberOfChannels > 2) {
+        std::cerr << "Unsupported impulse response" << std::endl;
+        return nullptr;
+    }
+
+    const int impulseChannels = impulse->getNumberOfChannels();
+    const std::int16_t* samples = reinterpret_cast<const std::int16_t*>(impulse->getData());
+    std::uint64_t frames = impulse->getLength() / (2 * impulseChannels);
+    frames = std::min<std::uint64_t>(frames, (std::uint64_t) MAX_IMPULSE_SECONDS * samplingRate);
+    if (frames == 0) {
+        return nullptr;
+    }
+
+    std::vector<float> left(frames);
+    std::vector<float> right(frames);
+    double energy = 0.0;
+    for (std::uint64_t i = 0; i < frames; i++) {
+        left[i] = samples[i * impulseChannels] / 32768.0f;
+        right[i] = samples[i * impulseChannels + impulseChannels - 1] / 32768.0f;
+        energy += (double) left[i] * left[i] + (double) right[i] * right[i];
+    }
+    if (energy <= 0.0) {
+        return nullptr;
+    }
+
+    const float scale = (float) (1.0 / std::sqrt(energy / 2));
+    simd::scale(left.data(), frames, scale);
+    simd::scale(right.data(), frames, scale);
+
+    bool stereoImpulse = impulseChannels == 2 && numberOfChannels == 2;
+    return new ConvolutionReverb(left, right, numberOfChannels, stereoImpulse, wet);
+}
+
+ConvolutionReverb::ConvolutionReverb(
+    const std::vector<float>& left,
+    const std::vector<float>& right,
+    int numberOfChannels,
+    bool stereoImpulse,
+    float wet)
+:   numberOfChannels(numberOfChannels),
+    partitions((int) ((left.size() + PARTITION_FRAMES - 1) / PARTITION_FRAMES)),
+    stereoImpulse(stereoImpulse),
+    wet(wet),
+    fft(FFT_SIZE),
+    meanRe((std::size_t) partitions * FFT_SIZE),
+    meanIm((std::size_t) partitions * FFT_SIZE),
+    historyRe((std::size_t) partitions * FFT_SIZE),
+    historyIm((std::size_t) partitions * FFT_SIZE),
+    head(0),
+    inputLeft(FFT_SIZE),
+    inputRight(FFT_SIZE),
+    output((std::size_t) PARTITION_FRAMES * numberOfChannels),
+    position(0),
+    silentPartitions(partitions + 1),
+    sumRe(FFT_SIZE),
+    sumIm(FFT_SIZE)
+{
+    if (stereoImpulse) {
+        differenceRe.resize(meanRe.size());
+        differenceIm.resize(meanIm.size());
+        mirrorRe.resize(historyRe.size());
+        mirrorIm.resize(historyIm.size());
+    }
+
+    // Both channels of a partition are transformed at once and told apart by symmetry.
+    std::vector<float> re(FFT_SIZE);
+    std::vector<float> im(FFT_SIZE);
+    const float scale = 1.0f / FFT_SIZE;
+
+    for (int p = 0; p < partitions; p++) {
+        std::fill(re.begin(), re.end(), 0.0f);
+        std::fill(im.begin(), im.end(), 0.0f);
+        std::size_t start = (std::size_t) p * PARTITION_FRAMES;
+        std::size_t count = std::min<std::size_t>(PARTITION_FRAMES, left.size() - start);
+        std::copy(left.begin() + start, left.begin() + start + count, re.begin());
+        std::copy(right.begin() + start, right.begin() + start + count, im.begin());
+        fft.forward(re.data(), im.data());
+
+        float* mr = meanRe.data() + (std::size_t) p * FFT_SIZE;
+        float* mi = meanIm.data() + (std::size_t) p * FFT_SIZE;
+        for (int k = 0; k < FFT_SIZE; k++) {
+            int mirror = (FFT_SIZE - k) % FFT_SIZE;
+            // Transforms of the left and right responses.
+            float lr = 0.5f * (re[k] + re[mirror]);
+            float li = 0.5f * (im[k] - im[mirror]);
+            float rr = 0.5f * (im[k] + im[mirror]);
+            float ri = -0.5f * (re[k] - re[mirror]);
+            mr[k] = 0.5f * (lr + rr) * scale;
+            mi[k] = 0.5f * (li + ri) * scale;
+            if (stereoImpulse) {
+                differenceRe[(std::size_t) p * FFT_SIZE + k] = 0.5f * (lr - rr) * scale;
+                differenceIm[(std::size_t) p * FFT_SIZE + k] = 0.5f * (li - ri) * scale;
+            }
+        }
+    }
+}
+
+void ConvolutionReverb::reset()
+{
+    std::fill(historyRe.begin(), historyRe.end(), 0.0f);
+    std::fill(historyIm.begin(), historyIm.end(), 0.0f);
+    std::fill(mirrorRe.begin(), mirrorRe.end(), 0.0f);
+    std::fill(mirrorIm.begin(), mirrorIm.end(), 0.0f);
+    std::fill(inputLeft.begin(), inputLeft.end(), 0.0f);
+    std::fill(inputRight.begin(), inputRight.end(), 0.0f);
+    std::fill(output.begin(), output.end(), 0.0f);
+    position = 0;
+    silentPartitions = partitions + 1;
+}
+
+void ConvolutionReverb::process(float* buffer, int frames)
+{
+    run<false>(buffer, frames);
+}
+
+void ConvolutionReverb::ringOut(float* buffer, int frames)
+{
+    run<true>(buffer, frames);
+}
+
+template<bool silentInput>
+void ConvolutionReverb::run(float* buffer, int frames)
+{
+    const bool stereo = numberOfChannels == 2;
+
+    for (int done = 0; done < frames; ) {
+        const int n = std::min(frames - done, PARTITION_FRAMES - position);
+        float* samples = buffer + (std::size_t) done * numberOfChannels;
+        float* left = inputLeft.data() + PARTITION_FRAMES + position;
+        float* right = inputRight.data() + PARTITION_FRAMES + position;
+        const float* reverberated = output.data() + (std::size_t) position * numberOfChannels;
+
+        for (int i = 0; i < n; i++) {
+            left[i] = silentInput ? 0.0f : samples[i * numberOfChannels];
+            right[i] = (silentInput || !stereo) ? 0.0f : samples[i * numberOfChannels + 1];
+        }
+        for (int i = 0; i < n * numberOfChannels; i++) {
+            samples[i] += wet * reverberated[i];
+        }
+
+        position += n;
+        done += n;
+        if (position == PARTITION_FRAMES) {
+            convolve();
+            position = 0;
+        }
+    }
+}
+
+/*
+ * Transforms the last two blocks of input, and sums the products of the
+ * transforms of the recent blocks with those of the matching partitions.
+ * The second half of the result is free of wrap around.
+ */
+void ConvolutionReverb::convolve()
+{
+    auto isZero = [](float sample) { return sample == 0.0f; };
+    const bool silent = std::all_of(inputLeft.begin() + PARTITION_FRAMES, inputLeft.end(), isZero)
+        && std::all_of(inputRight.begin() + PARTITION_FRAMES, inputRight.end(), isZero);
+    silentPartitions = silent ? std::min(silentPartitions + 1, partitions + 1) : 0;
+
+    head = (head + partitions - 1) % partitions;
+    float* re = historyRe.data() + (std::size_t) head * FFT_SIZE;
+    float* im = historyIm.data() + (std::size_t) head * FFT_SIZE;
+    std::copy(inputLeft.begin(), inputLeft.end(), re);
+    std::copy(inputRight.begin(), inputRight.end(), im);
+    fft.forward(re, im);
+
+    if (stereoImpulse) {
+        float* mr = mirrorRe.data() + (std::size_t) head * FFT_SIZE;
+        float* mi = mirrorIm.data() + (std::size_t) head * FFT_SIZE;
+        for (int k = 0; k < FFT_SIZE; k++) {
+            int mirror = (FFT_SIZE - k) % FFT_SIZE;
+            mr[k] = re[mirror];
+            mi[k] = -im[mirror];
+        }
+    }
+
+    std::fill(sumRe.begin(), sumRe.end(), 0.0f);
+    std::fill(sumIm.begin(), sumIm.end(), 0.0f);
+    for (int p = 0; p < partitions; p++) {
+        std::size_t block = (std::size_t) ((head + p) % partitions) * FFT_SIZE;
+        std::size_t partition = (std::size_t) p * FFT_SIZE;
+        simd::multiplyAdd(
+            sumRe.data(), sumIm.data(),
+            historyRe.data() + block, historyIm.data() + block,
+            meanRe.data() + partition, meanIm.data() + partition,
+            FFT_SIZE);
+        if (stereoImpulse) {
+            simd::multiplyAdd(
+                sumRe.data(), sumIm.data(),
+                mirrorRe.data() + block, mirrorIm.data() + block,
+                differenceRe.data() + partition, differenceIm.data() + partition,
+                FFT_SIZE);
+        }
+    }
+
+    fft.inverse(sumRe.data(), sumIm.data());
+
+    for (int i = 0; i < PARTITION_FRAMES; i++) {
+        output[(std::size_t) i * numberOfChannels] = sumRe[PARTITION_FRAMES + i];
+        if (numberOfChannels == 2) {
+            output[(std::size_t) i * 2 + 1] = sumIm[PARTITION_FRAMES + i];
+        }
+    }
+
+    // The current block becomes the previous one.
+    std::copy(inputLeft.begin() + PARTITION_FRAMES, inputLeft.end(), inputLeft.begin());
+    std::copy(inputRight.begin() + PARTITION_FRAMES, inputRight.end(), inputRight.begin());
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "Fft.h"
+
+class SoundResource;
+
+/*
+ * Reverberation of the mixed output by an impulse response, convolved
+ * with uniformly partitioned overlap-save in the frequency domain.
+ *
+ * Both channels of a stereo output share one complex transform, the
+ * left channel as the real part and the right as the imaginary part.
+ * The cost per block depends on the length of the impulse response
+ * only, whatever the number of voices. The reverberated signal lags
+ * by one partition, which the ear takes as part of the room.
+ */
+class ConvolutionReverb {
+private:
+
+    static constexpr int PARTITION_FRAMES = 256;
+    static constexpr int FFT_SIZE = 2 * PARTITION_FRAMES;
+    static constexpr int MAX_IMPULSE_SECONDS = 3;
+
+    const int numberOfChannels;
+    const int partitions;
+    // Whether the channels have impulse responses of their own.
+    const bool stereoImpulse;
+    const float wet;
+
+    Fft fft;
+
+    // Transforms of the partitions of the impulse response, scaled by the
+    // size of the transform. The mean of the channels applies to the
+    // input, and half their difference to the mirrored input.
+    std::vector<float> meanRe;
+    std::vector<float> meanIm;
+    std::vector<float> differenceRe;
+    std::vector<float> differenceIm;
+
+    // Transforms of the last blocks of input, newest at head, and their mirrors.
+    std::vector<float> historyRe;
+    std::vector<float> historyIm;
+    std::vector<float> mirrorRe;
+    std::vector<float> mirrorIm;
+    int head;
+
+    // Previous and current block of input of the left and right channels.
+    std::vector<float> inputLeft;
+    std::vector<float> inputRight;
+    // Reverberated block being played, interleaved.
+    std::vector<float> output;
+    // Frames into the current block.
+    int position;
+    // Blocks of silent input in a row, silent output once they outlast the history.
+    int silentPartitions;
+
+    std::vector<float> sumRe;
+    std::vector<float> sumIm;
+
+public:
+
+    // Returns nullptr if the impulse response does not suit the output.
+    static ConvolutionReverb* create(SoundResource* impulse, int numberOfChannels, int samplingRate, float wet);
+
+    // Forgets the input so far, without allocating.
+    void reset();
+
+    // Adds the reverberation of the block to it.
+    void process(float* buffer, int frames);
+
+    // Adds what is left of the reverberation to the block, as if the input
+    // had fallen silent, so that a reverb no longer in use dies away.
+    void ringOut(float* buffer, int frames);
+
+    // Whether the input has been silent for longer than the impulse response,
+    // so that nothing is left to add.
+    bool isSilent() const {
+        return silentPartitions > partitions;
+    }
+
+private:
+
+    ConvolutionReverb(const std::vector<float>& left, const std::vector<float>& right, int numberOfChannels, bool stereoImpulse, float wet);
+
+    template<bool silentInput>
+    void run(float* buffer, int frames);
+
+    void convolve();
+};
@@ -0,0 +1,33 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "Envelope.h"
+
+static void fillFadeIn(std::vector<float>& table, int frames)
+{
+    const double pi = 3.14159265358979323846;
+    table.resize(frames);
+    for (int i = 0; i < frames; i++) {
+        // Raised cosine, which has no corner at either end.
+        table[i] = (float) (0.5 * (1.0 - std::cos(pi * (i + 0.5) / frames)));
+    }
+}
+
+Envelope::Envelope(int samplingRate, int attackMillis, int releaseMillis)
+{
+    fillFadeIn(attack, std::max(0, samplingRate * attackMillis / 1000));
+    fillFadeIn(release, std::max(0, samplingRate * releaseMillis / 1000));
+    std::reverse(release.begin(), release.end());
+}
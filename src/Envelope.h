@@ -0,0 +1,53 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+/*
+ * Fade in and fade out curves applied to the clips of a sound pack.
+ */
+class Envelope {
+private:
+
+    // Gain of each frame from the start of the clip.
+    std::vector<float> attack;
+    // Gain of each frame from the start of the release.
+    std::vector<float> release;
+
+public:
+
+    static const int DEFAULT_ATTACK_MILLIS = 1;
+    static const int DEFAULT_RELEASE_MILLIS = 5;
+
+    Envelope() {}
+
+    Envelope(int samplingRate, int attackMillis, int releaseMillis);
+
+    std::uint64_t getAttackFrames() const {
+        return attack.size();
+    }
+
+    std::uint64_t getReleaseFrames() const {
+        return release.size();
+    }
+
+    const float* getAttack() const {
+        return attack.data();
+    }
+
+    const float* getRelease() const {
+        return release.data();
+    }
+};
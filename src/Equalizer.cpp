@@ -0,0 +1,238 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "Equalizer.h"
+#include "Simd.h"
+
+Equalizer::Equalizer()
+:   numberOfChannels(0),
+    samplingRate(0),
+    numberOfBands(0),
+    states(),
+    activeBands(0),
+    settled(true),
+    smoothing(1.0f)
+{
+}
+
+void Equalizer::configure(int numberOfChannels, int samplingRate)
+{
+    this->numberOfChannels = numberOfChannels;
+    this->samplingRate = samplingRate;
+    smoothing = 1.0f - std::exp(-1000.0f * SUBBLOCK_FRAMES / (SMOOTHING_MILLIS * samplingRate));
+
+    // Nothing was heard through the previous coefficients.
+    updateTargets();
+    for (int i = 0; i < MAX_BANDS; i++) {
+        current[i] = target[i];
+        states[i] = State();
+    }
+    activeBands = numberOfBands;
+    settled = true;
+}
+
+void Equalizer::setBands(const std::vector<EqualizerBand>& bands)
+{
+    numberOfBands = std::min((int) bands.size(), MAX_BANDS);
+    std::copy(bands.begin(), bands.begin() + numberOfBands, this->bands);
+    if (samplingRate > 0) {
+        updateTargets();
+        activeBands = std::max(activeBands, numberOfBands);
+        settled = false;
+    }
+}
+
+void Equalizer::updateTargets()
+{
+    for (int i = 0; i < MAX_BANDS; i++) {
+        target[i] = (i < numberOfBands) ? design(bands[i], samplingRate) : Coefficients();
+    }
+}
+
+/*
+ * Coefficients of the Audio EQ Cookbook by Robert Bristow-Johnson.
+ */
+Equalizer::Coefficients Equalizer::design(const EqualizerBand& band, int samplingRate)
+{
+    const double pi = 3.14159265358979323846;
+    const double frequency = std::clamp((double) band.frequency, 10.0, 0.45 * samplingRate);
+    const double q = std::max(0.1, (double) band.q);
+    const double w0 = 2.0 * pi * frequency / samplingRate;
+    const double cosW0 = std::cos(w0);
+    const double alpha = std::sin(w0) / (2.0 * q);
+    const double a = std::pow(10.0, band.gain / 40.0);
+    const double shelf = 2.0 * std::sqrt(a) * alpha;
+
+    double b0, b1, b2, a0, a1, a2;
+    switch (band.type) {
+    case FilterType::LOW_SHELF:
+        b0 = a * ((a + 1) - (a - 1) * cosW0 + shelf);
+        b1 = 2 * a * ((a - 1) - (a + 1) * cosW0);
+        b2 = a * ((a + 1) - (a - 1) * cosW0 - shelf);
+        a0 = (a + 1) + (a - 1) * cosW0 + shelf;
+        a1 = -2 * ((a - 1) + (a + 1) * cosW0);
+        a2 = (a + 1) + (a - 1) * cosW0 - shelf;
+        break;
+    case FilterType::HIGH_SHELF:
+        b0 = a * ((a + 1) + (a - 1) * cosW0 + shelf);
+        b1 = -2 * a * ((a - 1) + (a + 1) * cosW0);
+        b2 = a * ((a + 1) + (a - 1) * cosW0 - shelf);
+        a0 = (a + 1) - (a - 1) * cosW0 + shelf;
+        a1 = 2 * ((a - 1) - (a + 1) * cosW0);
+        a2 = (a + 1) - (a - 1) * cosW0 - shelf;
+        break;
+    case FilterType::LOW_PASS:
+        b0 = (1 - cosW0) / 2;
+        b1 = 1 - cosW0;
+        b2 = b0;
+        a0 = 1 + alpha;
+        a1 = -2 * cosW0;
+        a2 = 1 - alpha;
+        break;
+    case FilterType::HIGH_PASS:
+        b0 = (1 + cosW0) / 2;
+        b1 = -(1 + cosW0);
+        b2 = b0;
+        a0 = 1 + alpha;
+        a1 = -2 * cosW0;
+        a2 = 1 - alpha;
+        break;
+    default:
+        b0 = 1 + alpha * a;
+        b1 = -2 * cosW0;
+        b2 = 1 - alpha * a;
+        a0 = 1 + alpha / a;
+        a1 = -2 * cosW0;
+        a2 = 1 - alpha / a;
+        break;
+    }
+
+    Coefficients c;
+    c.b0 = (float) (b0 / a0);
+    c.b1 = (float) (b1 / a0);
+    c.b2 = (float) (b2 / a0);
+    c.a1 = (float) (a1 / a0);
+    c.a2 = (float) (a2 / a0);
+    return c;
+}
+
+/*
+ * Moves the coefficients towards their targets. Any mix of two stable
+ * biquads is stable, since the stable region of (a1, a2) is a triangle.
+ */
+void Equalizer::glide()
+{
+    float distance = 0.0f;
+    for (int i = 0; i < activeBands; i++) {
+        float* from = &current[i].b0;
+        const float* to = &target[i].b0;
+        for (int j = 0; j < 5; j++) {
+            from[j] += (to[j] - from[j]) * smoothing;
+            distance = std::max(distance, std::fabs(to[j] - from[j]));
+        }
+    }
+    if (distance < 1e-5f) {
+        for (int i = 0; i < activeBands; i++) {
+            current[i] = target[i];
+        }
+        // Removed bands are flat by now.
+        for (int i = numberOfBands; i < activeBands; i++) {
+            states[i] = State();
+        }
+        activeBands = numberOfBands;
+        settled = true;
+    }
+}
+
+void Equalizer::process(float* buffer, int frames)
+{
+    if (isBypassed()) {
+        return;
+    }
+
+    for (int offset = 0; offset < frames; offset += SUBBLOCK_FRAMES) {
+        const int n = std::min(SUBBLOCK_FRAMES, frames - offset);
+        float* samples = buffer + (std::size_t) offset * numberOfChannels;
+
+        if (!settled) {
+            glide();
+        }
+
+        // One frame per vector, unused lanes kept at zero.
+        alignas(16) float lanes[SUBBLOCK_FRAMES * LANES] = {};
+        for (int i = 0; i < n; i++) {
+            for (int channel = 0; channel < numberOfChannels; channel++) {
+                lanes[i * LANES + channel] = samples[i * numberOfChannels + channel];
+            }
+        }
+        for (int band = 0; band < activeBands; band++) {
+            filter(current[band], states[band], lanes, n);
+        }
+        for (int i = 0; i < n; i++) {
+            for (int channel = 0; channel < numberOfChannels; channel++) {
+                samples[i * numberOfChannels + channel] = lanes[i * LANES + channel];
+            }
+        }
+    }
+
+    // Denormals of a decaying state would slow down the silence that follows.
+    for (int band = 0; band < activeBands; band++) {
+        for (int lane = 0; lane < LANES; lane++) {
+            State& state = states[band];
+            if (std::fabs(state.s1[lane]) < 1e-15f) {
+                state.s1[lane] = 0.0f;
+            }
+            if (std::fabs(state.s2[lane]) < 1e-15f) {
+                state.s2[lane] = 0.0f;
+            }
+        }
+    }
+}
+
+void Equalizer::filter(const Coefficients& c, State& state, float* lanes, int frames)
+{
+#ifdef ROAR_SSE2
+    const __m128 b0 = _mm_set1_ps(c.b0);
+    const __m128 b1 = _mm_set1_ps(c.b1);
+    const __m128 b2 = _mm_set1_ps(c.b2);
+    const __m128 a1 = _mm_set1_ps(c.a1);
+    const __m128 a2 = _mm_set1_ps(c.a2);
+    __m128 s1 = _mm_loadu_ps(state.s1);
+    __m128 s2 = _mm_loadu_ps(state.s2);
+    for (int i = 0; i < frames; i++) {
+        __m128 x = _mm_load_ps(lanes + i * LANES);
+        __m128 y = _mm_add_ps(_mm_mul_ps(b0, x), s1);
+        s1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1, x), _mm_mul_ps(a1, y)), s2);
+        s2 = _mm_sub_ps(_mm_mul_ps(b2, x), _mm_mul_ps(a2, y));
+        _mm_store_ps(lanes + i * LANES, y);
+    }
+    _mm_storeu_ps(state.s1, s1);
+    _mm_storeu_ps(state.s2, s2);
+#else
+    for (int lane = 0; lane < LANES; lane++) {
+        float s1 = state.s1[lane];
+        float s2 = state.s2[lane];
+        for (int i = 0; i < frames; i++) {
+            float x = lanes[i * LANES + lane];
+            float y = c.b0 * x + s1;
+            s1 = c.b1 * x - c.a1 * y + s2;
+            s2 = c.b2 * x - c.a2 * y;
+            lanes[i * LANES + lane] = y;
+        }
+        state.s1[lane] = s1;
+        state.s2[lane] = s2;
+    }
+#endif
+}
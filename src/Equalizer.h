@@ -0,0 +1,105 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+enum class FilterType {
+    PEAK,
+    LOW_SHELF,
+    HIGH_SHELF,
+    LOW_PASS,
+    HIGH_PASS
+};
+
+struct EqualizerBand {
+    FilterType type = FilterType::PEAK;
+    // Center or corner frequency in Hz.
+    float frequency = 1000.0f;
+    // Boost or cut in decibels, ignored by the pass filters.
+    float gain = 0.0f;
+    float q = 0.7071f;
+};
+
+/*
+ * Cascade of biquad filters applied to the mixed output.
+ *
+ * The channels of a frame are filtered together in the lanes of a vector,
+ * one band after another over a sub-block. When the bands change, the
+ * coefficients glide to their new values sub-block by sub-block, which
+ * keeps every step stable and avoids clicks.
+ */
+class Equalizer {
+private:
+
+    static constexpr int MAX_BANDS = 8;
+    static constexpr int LANES = 4;
+    static constexpr int SUBBLOCK_FRAMES = 32;
+    static constexpr float SMOOTHING_MILLIS = 30.0f;
+
+    // Normalized so that a0 is one.
+    struct Coefficients {
+        float b0 = 1.0f;
+        float b1 = 0.0f;
+        float b2 = 0.0f;
+        float a1 = 0.0f;
+        float a2 = 0.0f;
+    };
+
+    // Transposed direct form II state of each lane.
+    struct State {
+        float s1[LANES];
+        float s2[LANES];
+    };
+
+    int numberOfChannels;
+    int samplingRate;
+
+    EqualizerBand bands[MAX_BANDS];
+    int numberOfBands;
+
+    Coefficients current[MAX_BANDS];
+    Coefficients target[MAX_BANDS];
+    State states[MAX_BANDS];
+    // Bands filtered, including removed ones still fading to flat.
+    int activeBands;
+    bool settled;
+    // Fraction of the distance to the target coefficients covered per sub-block.
+    float smoothing;
+
+public:
+
+    Equalizer();
+
+    void configure(int numberOfChannels, int samplingRate);
+
+    // Bands beyond the eighth are ignored.
+    void setBands(const std::vector<EqualizerBand>& bands);
+
+    bool isBypassed() {
+        return activeBands == 0 || numberOfChannels > LANES;
+    }
+
+    void process(float* buffer, int frames);
+
+private:
+
+    static Coefficients design(const EqualizerBand& band, int samplingRate);
+
+    void updateTargets();
+
+    void glide();
+
+    static void filter(const Coefficients& c, State& state, float* lanes, int frames);
+};
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "Fft.h"
+#include "Simd.h"
+
+static const double PI = 3.14159265358979323846;
+
+Fft::Fft(int size)
+:   size(size),
+    twiddleRe(size),
+    twiddleIm(size)
+{
+    int bits = 0;
+    while ((1 << bits) < size) {
+        bits++;
+    }
+
+    for (int i = 0; i < size; i++) {
+        int reversed = 0;
+        for (int b = 0; b < bits; b++) {
+            reversed |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        if (i < reversed) {
+            swaps.push_back((std::uint32_t) i);
+            swaps.push_back((std::uint32_t) reversed);
+        }
+    }
+
+    for (int half = 1; half < size; half *= 2) {
+        for (int j = 0; j < half; j++) {
+            double angle = -PI * j / half;
+            twiddleRe[half + j] = (float) std::cos(angle);
+            twiddleIm[half + j] = (float) std::sin(angle);
+        }
+    }
+}
+
+void Fft::forward(float* re, float* im) const
+{
+    for (std::size_t i = 0; i < swaps.size(); i += 2) {
+        std::swap(re[swaps[i]], re[swaps[i + 1]]);
+        std::swap(im[swaps[i]], im[swaps[i + 1]]);
+    }
+
+    for (int half = 1; half < size; half *= 2) {
+        combine(re, im, half);
+    }
+}
+
+/*
+ * Radix-2 butterflies merging transforms of length half into transforms of
+ * twice the length.
+ */
+void Fft::combine(float* re, float* im, int half) const
+{
+    const float* wRe = twiddleRe.data() + half;
+    const float* wIm = twiddleIm.data() + half;
+
+    for (int start = 0; start < size; start += 2 * half) {
+        float* aRe = re + start;
+        float* aIm = im + start;
+        float* bRe = aRe + half;
+        float* bIm = aIm + half;
+
+        int j = 0;
+#ifdef ROAR_SSE2
+        for (; j + 4 <= half; j += 4) {
+            __m128 wr = _mm_loadu_ps(wRe + j);
+            __m128 wi = _mm_loadu_ps(wIm + j);
+            __m128 br = _mm_loadu_ps(bRe + j);
+            __m128 bi = _mm_loadu_ps(bIm + j);
+            __m128 tr = _mm_sub_ps(_mm_mul_ps(wr, br), _mm_mul_ps(wi, bi));
+            __m128 ti = _mm_add_ps(_mm_mul_ps(wr, bi), _mm_mul_ps(wi, br));
+            __m128 ar = _mm_loadu_ps(aRe + j);
+            __m128 ai = _mm_loadu_ps(aIm + j);
+            _mm_storeu_ps(bRe + j, _mm_sub_ps(ar, tr));
+            _mm_storeu_ps(bIm + j, _mm_sub_ps(ai, ti));
+            _mm_storeu_ps(aRe + j, _mm_add_ps(ar, tr));
+            _mm_storeu_ps(aIm + j, _mm_add_ps(ai, ti));
+        }
+#endif
+        for (; j < half; j++) {
+            float tr = wRe[j] * bRe[j] - wIm[j] * bIm[j];
+            float ti = wRe[j] * bIm[j] + wIm[j] * bRe[j];
+            bRe[j] = aRe[j] - tr;
+            bIm[j] = aIm[j] - ti;
+            aRe[j] += tr;
+            aIm[j] += ti;
+        }
+    }
+}
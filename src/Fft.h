@@ -0,0 +1,55 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+/*
+ * Fast Fourier transform of a power of two size, on complex numbers
+ * held as separate arrays of real and imaginary parts so that the
+ * butterflies of the later stages run four at a time.
+ */
+class Fft {
+private:
+
+    int size;
+
+    // Pairs of indexes exchanged to put the input in bit reversed order.
+    std::vector<std::uint32_t> swaps;
+
+    // Twiddle factors of the stage combining halves of length m start at m.
+    std::vector<float> twiddleRe;
+    std::vector<float> twiddleIm;
+
+public:
+
+    Fft(int size);
+
+    int getSize() const {
+        return size;
+    }
+
+    // Transforms in place.
+    void forward(float* re, float* im) const;
+
+    // Transforms back in place, scaled by the size.
+    void inverse(float* re, float* im) const {
+        // Exchanging the parts conjugates, up to a factor of i on each side.
+        forward(im, re);
+    }
+
+private:
+
+    void combine(float* re, float* im, int half) const;
+};
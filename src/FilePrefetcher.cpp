@@ -0,0 +1,136 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "FilePrefetcher.h"
+#include "Trace.h"
+
+FilePrefetcher* FilePrefetcher::start(FILE* file)
+{
+    if (::fseek(file, 0, SEEK_END) != 0) {
+        ::fclose(file);
+        return nullptr;
+    }
+    long size = ::ftell(file);
+    if (size <= 0) {
+        ::fclose(file);
+        return nullptr;
+    }
+
+    auto prefetcher = new FilePrefetcher(file, (std::size_t) size);
+    prefetcher->reader = std::thread(&FilePrefetcher::run, prefetcher);
+    return prefetcher;
+}
+
+FilePrefetcher::FilePrefetcher(FILE* file, std::size_t size)
+:   file(file),
+    data(size),
+    headBytes(0),
+    tailOffset(size > TAIL_SIZE ? size - TAIL_SIZE : 0),
+    tailRead(false),
+    failed(false),
+    stopping(false),
+    readMicros(0)
+{
+}
+
+FilePrefetcher::~FilePrefetcher()
+{
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    if (reader.joinable()) {
+        reader.join();
+    }
+    ::fclose(file);
+}
+
+bool FilePrefetcher::waitFor(std::size_t offset, std::size_t length, std::uint64_t& waitMicros)
+{
+    const std::size_t end = offset + length;
+    if (end > data.size()) {
+        return false;
+    }
+    // Once the head has come this far the bytes stay put, so no lock is needed.
+    if (end <= headBytes.load(std::memory_order_acquire)) {
+        return true;
+    }
+
+    TRACE_ZONE("FilePrefetcher::waitFor");
+    auto start = std::chrono::steady_clock::now();
+    std::unique_lock lock(mutex);
+    readMore.wait(lock, [&] {
+        return failed
+            || end <= headBytes.load(std::memory_order_relaxed)
+            || (tailRead && offset >= tailOffset);
+    });
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    waitMicros += std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    return !failed;
+}
+
+std::uint64_t FilePrefetcher::getReadMicros()
+{
+    std::lock_guard lock(mutex);
+    return readMicros;
+}
+
+void FilePrefetcher::run()
+{
+    TRACE_ZONE("FilePrefetcher::run");
+    auto start = std::chrono::steady_clock::now();
+
+    bool succeeded = readBlock(tailOffset, data.size() - tailOffset);
+    {
+        std::lock_guard lock(mutex);
+        tailRead = succeeded;
+        failed = !succeeded;
+    }
+    readMore.notify_all();
+
+    // Stops short of the tail, which is already in.
+    std::size_t offset = 0;
+    while (succeeded && offset < tailOffset) {
+        std::size_t length = std::min(BLOCK_SIZE, tailOffset - offset);
+        succeeded = readBlock(offset, length);
+        offset += length;
+        {
+            std::lock_guard lock(mutex);
+            if (succeeded) {
+                headBytes.store(offset >= tailOffset ? data.size() : offset, std::memory_order_release);
+            }
+            failed = !succeeded;
+            succeeded = succeeded && !stopping;
+        }
+        readMore.notify_all();
+    }
+
+    if (tailOffset == 0 && tailRead) {
+        std::lock_guard lock(mutex);
+        headBytes.store(data.size(), std::memory_order_release);
+    }
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    std::lock_guard lock(mutex);
+    readMicros = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+
+bool FilePrefetcher::readBlock(std::size_t offset, std::size_t length)
+{
+    if (::fseek(file, (long) offset, SEEK_SET) != 0) {
+        return false;
+    }
+    return ::fread(data.data() + offset, length, 1, file) == 1;
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+/*
+ * Reads a whole file into memory on a thread of its own, in large blocks,
+ * so that decoding works on the bytes read so far while the rest is still
+ * on its way from a slow disk or a network share. The last block is read
+ * first, since decoders look at the end of a stream for its length.
+ */
+class FilePrefetcher {
+private:
+
+    static constexpr std::size_t BLOCK_SIZE = 1 << 20;
+    static constexpr std::size_t TAIL_SIZE = 64 * 1024;
+
+    FILE* file;
+    std::vector<std::uint8_t> data;
+
+    std::mutex mutex;
+    std::condition_variable readMore;
+    // Bytes read from the start, and the tail from its offset on.
+    std::atomic<std::size_t> headBytes;
+    std::size_t tailOffset;
+    bool tailRead;
+    bool failed;
+    bool stopping;
+
+    std::thread reader;
+    std::uint64_t readMicros;
+
+public:
+
+    // Takes over the file and starts reading it, nullptr if its size is unknown.
+    static FilePrefetcher* start(FILE* file);
+
+    // Stops reading and closes the file.
+    ~FilePrefetcher();
+
+    // The bytes are valid once waited for.
+    const std::uint8_t* getData() {
+        return data.data();
+    }
+
+    std::size_t getSize() {
+        return data.size();
+    }
+
+    // Blocks until the bytes are read, adding the time blocked to waitMicros,
+    // false if the file could not be read.
+    bool waitFor(std::size_t offset, std::size_t length, std::uint64_t& waitMicros);
+
+    // Time spent reading the whole file, zero until done.
+    std::uint64_t getReadMicros();
+
+private:
+
+    FilePrefetcher(FILE* file, std::size_t size);
+
+    void run();
+
+    bool readBlock(std::size_t offset, std::size_t length);
+};
@@ -0,0 +1,166 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "FlightRecorder.h"
+
+static const char* const TYPE_NAMES[] = {
+    "key-down",
+    "key-up",
+    "voice-start",
+    "voice-stop",
+    "voice-steal",
+    "voice-drop",
+    "throttle",
+    "render",
+    "buffer-submit",
+    "underrun",
+    "pack-switch",
+    "suspend",
+    "resume",
+    "trim",
+    "rematerialize"
+};
+
+static_assert(sizeof(TYPE_NAMES) / sizeof(TYPE_NAMES[0]) == (size_t) FlightEventType::COUNT);
+static_assert(sizeof(FlightEvent) == 16);
+
+FlightRecorder& FlightRecorder::get()
+{
+    static FlightRecorder recorder;
+    return recorder;
+}
+
+const char* FlightRecorder::getTypeName(std::uint16_t type)
+{
+    if (type >= (std::uint16_t) FlightEventType::COUNT) {
+        return "unknown";
+    }
+    return TYPE_NAMES[type];
+}
+
+FlightRecorder::FlightRecorder()
+:   slots{},
+    head(0),
+    originTicks(readTimestamp()),
+    origin(Clock::now()),
+    path{}
+{
+}
+
+void FlightRecorder::setPath(const std::filesystem::path& path)
+{
+    const auto& native = path.native();
+    if (native.size() >= MAX_PATH_CHARS) {
+        this->path[0] = 0;
+        return;
+    }
+    std::copy(native.begin(), native.end(), this->path);
+    this->path[native.size()] = 0;
+}
+
+bool FlightRecorder::dump()
+{
+    if (path[0] == 0) {
+        return false;
+    }
+    return write(path);
+}
+
+bool FlightRecorder::dump(const std::filesystem::path& path)
+{
+    return write(path.c_str());
+}
+
+/*
+ * Copies the ring without stopping the writers. Slots overwritten while
+ * being copied are left out rather than written torn. Nothing is
+ * allocated, as the heap may be what crashed, and the path is opened
+ * as it is, without a conversion to the ANSI code page.
+ */
+bool FlightRecorder::write(const PathChar* fileName)
+{
+#ifdef _WIN32
+    FILE* file = ::_wfopen(fileName, L"wb");
+#else
+    FILE* file = ::fopen(fileName, "wb");
+#endif
+    if (file == nullptr) {
+        return false;
+    }
+
+    FlightDumpHeader header{
+        {MAGIC[0], MAGIC[1], MAGIC[2], MAGIC[3]},
+        0,
+        getTicksPerSecond()
+    };
+    bool written = ::fwrite(&header, sizeof(header), 1, file) == 1;
+
+    std::uint64_t end = head.load(std::memory_order_acquire);
+    std::uint64_t begin = (end > CAPACITY) ? end - CAPACITY : 0;
+
+    FlightEvent events[DUMP_CHUNK];
+    size_t count = 0;
+    for (std::uint64_t index = begin; index < end && written; index++) {
+        const Slot& slot = slots[index & (CAPACITY - 1)];
+        std::uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence != index + 1) {
+            continue;
+        }
+        std::uint64_t timestamp = slot.timestamp.load(std::memory_order_relaxed);
+        std::uint64_t payload = slot.payload.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != sequence) {
+            continue;
+        }
+
+        events[count++] = FlightEvent{
+            timestamp,
+            (std::uint16_t) payload,
+            (std::uint16_t) (payload >> 16),
+            (std::uint32_t) (payload >> 32)
+        };
+        if (count == DUMP_CHUNK) {
+            written = ::fwrite(events, sizeof(FlightEvent), count, file) == count;
+            header.count += (std::uint32_t) count;
+            count = 0;
+        }
+    }
+    if (written && count > 0) {
+        written = ::fwrite(events, sizeof(FlightEvent), count, file) == count;
+        header.count += (std::uint32_t) count;
+    }
+
+    // The count is only known at the end.
+    if (written) {
+        written = ::fseek(file, 0, SEEK_SET) == 0
+            && ::fwrite(&header, sizeof(header), 1, file) == 1;
+    }
+    ::fclose(file);
+    return written;
+}
+
+double FlightRecorder::getTicksPerSecond()
+{
+#ifdef ROAR_FLIGHT_TSC
+    std::uint64_t ticks = readTimestamp() - originTicks;
+    double seconds = std::chrono::duration<double>(Clock::now() - origin).count();
+    if (seconds <= 0.0) {
+        return 0.0;
+    }
+    return ticks / seconds;
+#else
+    return 1e9;
+#endif
+}
@@ -0,0 +1,160 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define ROAR_FLIGHT_TSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define ROAR_FLIGHT_TSC
+#endif
+
+/*
+ * Ring of the most recent playback events, always recording. Writers
+ * claim a slot with a single atomic increment and never block or
+ * allocate, so events can be recorded from the audio thread. The ring
+ * is written to a file on request or after a crash and decoded with
+ * roar-flight.
+ */
+
+enum class FlightEventType : std::uint16_t {
+    KEY_DOWN,
+    KEY_UP,
+    VOICE_START,
+    VOICE_STOP,
+    VOICE_STEAL,
+    VOICE_DROP,
+    THROTTLE,
+    RENDER,
+    BUFFER_SUBMIT,
+    UNDERRUN,
+    PACK_SWITCH,
+    SUSPEND,
+    RESUME,
+    TRIM,
+    REMATERIALIZE,
+    COUNT
+};
+
+// Event as stored in dump files.
+struct FlightEvent {
+    // Ticks of the time stamp counter.
+    std::uint64_t timestamp;
+    std::uint16_t type;
+    // Meaning depends on the type, see roar-flight.
+    std::uint16_t code;
+    std::uint32_t value;
+};
+
+struct FlightDumpHeader {
+    char magic[4];
+    std::uint32_t count;
+    // Estimated from the steady clock while recording.
+    double ticksPerSecond;
+};
+
+class FlightRecorder {
+public:
+
+    static constexpr char MAGIC[4] = {'R', 'F', 'R', '1'};
+
+    // Power of two, about 768 KB of slots.
+    static constexpr std::uint64_t CAPACITY = 1 << 15;
+
+private:
+
+    using Clock = std::chrono::steady_clock;
+
+    using PathChar = std::filesystem::path::value_type;
+
+    // Events copied to the file at a time.
+    static constexpr size_t DUMP_CHUNK = 256;
+
+    // Longest dump path kept, in native characters including the terminator.
+    static constexpr size_t MAX_PATH_CHARS = 1024;
+
+    // Written with plain atomics so that a dump taken while recording is not a data race.
+    struct Slot {
+        // Index of the event plus one once complete, zero while being written.
+        std::atomic<std::uint64_t> sequence;
+        std::atomic<std::uint64_t> timestamp;
+        std::atomic<std::uint64_t> payload;
+    };
+
+    Slot slots[CAPACITY];
+    std::atomic<std::uint64_t> head;
+
+    std::uint64_t originTicks;
+    Clock::time_point origin;
+
+    // Native path of the dump file, empty if none. Kept in place so that a
+    // crash handler can open it without converting or allocating.
+    PathChar path[MAX_PATH_CHARS];
+
+public:
+
+    static FlightRecorder& get();
+
+    static const char* getTypeName(std::uint16_t type);
+
+    static std::uint64_t readTimestamp()
+    {
+#ifdef ROAR_FLIGHT_TSC
+        return __rdtsc();
+#else
+        auto now = Clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+#endif
+    }
+
+    void record(FlightEventType type, std::uint16_t code = 0, std::uint32_t value = 0)
+    {
+        std::uint64_t index = head.fetch_add(1, std::memory_order_relaxed);
+        Slot& slot = slots[index & (CAPACITY - 1)];
+        std::uint64_t payload = (std::uint64_t) type
+            | ((std::uint64_t) code << 16)
+            | ((std::uint64_t) value << 32);
+
+        slot.sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.timestamp.store(readTimestamp(), std::memory_order_relaxed);
+        slot.payload.store(payload, std::memory_order_relaxed);
+        slot.sequence.store(index + 1, std::memory_order_release);
+    }
+
+    // Paths too long for the buffer leave no path configured.
+    void setPath(const std::filesystem::path& path);
+
+    std::filesystem::path getPath() const
+    {
+        return std::filesystem::path(path);
+    }
+
+    // Writes the events still in the ring to the configured path.
+    bool dump();
+
+    bool dump(const std::filesystem::path& path);
+
+    // Rate of readTimestamp(), measured since the recorder was created.
+    double getTicksPerSecond();
+
+private:
+
+    FlightRecorder();
+
+    bool write(const PathChar* fileName);
+};
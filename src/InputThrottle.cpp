@@ -0,0 +1,153 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "InputThrottle.h"
+
+InputThrottle::InputThrottle()
+:   samplingRate(0),
+    keyFrames(KEY_SLOTS, NEVER),
+    block(NEVER),
+    blockStarts(0),
+    tokens(0.0),
+    refillFrame(0),
+    lastEventFrame(NEVER),
+    runFrame(0),
+    runLength(0),
+    flooding(false)
+{
+}
+
+void InputThrottle::configure(int samplingRate)
+{
+    this->samplingRate = samplingRate;
+    std::fill(keyFrames.begin(), keyFrames.end(), NEVER);
+    block = NEVER;
+    blockStarts = 0;
+    tokens = std::max(1, limits.burst);
+    refillFrame = 0;
+    lastEventFrame = NEVER;
+    runFrame = 0;
+    runLength = 0;
+    flooding = false;
+}
+
+void InputThrottle::setLimits(const Limits& limits)
+{
+    this->limits = limits;
+    tokens = std::min(tokens, (double) std::max(1, limits.burst));
+}
+
+InputThrottle::Decision InputThrottle::admit(int scanCode, std::uint64_t frame, int blockFrames)
+{
+    const bool wasFlooding = flooding;
+    trackFlood(frame);
+
+    if (limits.collapseFloods && flooding) {
+        return wasFlooding ? Decision::SUPPRESS : Decision::COLLAPSE;
+    }
+
+    if (blockFrames <= 0) {
+        blockFrames = (int) toFrames(DEFAULT_BLOCK_MILLIS);
+    }
+
+    const int slot = getKeySlot(scanCode);
+    const std::uint64_t keyFrame = keyFrames[slot];
+    const std::uint64_t frameBlock = frame / std::max(1, blockFrames);
+
+    if (frameBlock != block) {
+        block = frameBlock;
+        blockStarts = 0;
+    }
+
+    if (keyFrame != NEVER && keyFrame / std::max(1, blockFrames) == frameBlock) {
+        return Decision::COALESCE;
+    }
+    if (limits.startsPerBlock > 0 && blockStarts >= limits.startsPerBlock) {
+        return Decision::COALESCE;
+    }
+
+    if (limits.keyIntervalMillis > 0 && keyFrame != NEVER
+            && frame < keyFrame + toFrames(limits.keyIntervalMillis)) {
+        return Decision::LIMIT;
+    }
+    if (!takeToken(frame)) {
+        return Decision::LIMIT;
+    }
+
+    keyFrames[slot] = frame;
+    blockStarts++;
+    return Decision::PLAY;
+}
+
+/*
+ * A flood starts with a run of events in quick succession,
+ * and lasts until the input pauses.
+ */
+void InputThrottle::trackFlood(std::uint64_t frame)
+{
+    std::uint64_t gap = NEVER;
+    if (lastEventFrame != NEVER) {
+        gap = (frame > lastEventFrame) ? frame - lastEventFrame : 0;
+    }
+    lastEventFrame = frame;
+
+    if (flooding && gap > toFrames(FLOOD_QUIET_MILLIS)) {
+        flooding = false;
+    }
+
+    if (gap <= toFrames(FLOOD_GAP_MILLIS)) {
+        runLength++;
+    } else {
+        runLength = 1;
+        if (!flooding) {
+            runFrame = frame;
+        }
+    }
+
+    if (!flooding && runLength >= FLOOD_EVENTS) {
+        flooding = true;
+    }
+}
+
+// Token bucket holding up to the burst, refilled at the allowed rate.
+bool InputThrottle::takeToken(std::uint64_t frame)
+{
+    if (limits.startsPerSecond <= 0 || samplingRate <= 0) {
+        return true;
+    }
+
+    if (frame > refillFrame) {
+        tokens += (double) (frame - refillFrame) * limits.startsPerSecond / samplingRate;
+        tokens = std::min(tokens, (double) std::max(1, limits.burst));
+        refillFrame = frame;
+    }
+
+    if (tokens < 1.0) {
+        return false;
+    }
+    tokens -= 1.0;
+    return true;
+}
+
+std::uint64_t InputThrottle::toFrames(int millis)
+{
+    return (std::uint64_t) millis * samplingRate / 1000;
+}
+
+// Extended keys share the upper half of the slots.
+int InputThrottle::getKeySlot(int scanCode)
+{
+    return (scanCode & 0xff) | ((scanCode & 0xff00) != 0 ? 0x100 : 0);
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+/*
+ * Decides which key events start a sound, so that injected or
+ * macro-generated input cannot start more voices than the mixer
+ * can handle. Works on output frames and never allocates once created.
+ */
+class InputThrottle {
+public:
+
+    enum class Decision {
+        PLAY,
+        // Another sound of the key, or too many sounds, start in the same block.
+        COALESCE,
+        // Over the rate allowed for the key or for all keys.
+        LIMIT,
+        // A flood was detected, plays in place of the sounds started by the flood.
+        COLLAPSE,
+        // Part of a flood already represented by a sound.
+        SUPPRESS,
+    };
+
+    // Zero lifts the respective limit.
+    struct Limits {
+        int startsPerBlock = 4;
+        int keyIntervalMillis = 25;
+        int startsPerSecond = 60;
+        int burst = 20;
+        bool collapseFloods = false;
+    };
+
+private:
+
+    static constexpr int KEY_SLOTS = 0x200;
+    static constexpr int DEFAULT_BLOCK_MILLIS = 10;
+    // Key events this close to each other, this many times in a row, are no typing.
+    static constexpr int FLOOD_EVENTS = 6;
+    static constexpr int FLOOD_GAP_MILLIS = 15;
+    // Pause in the input which ends a flood.
+    static constexpr int FLOOD_QUIET_MILLIS = 100;
+    static constexpr std::uint64_t NEVER = ~(std::uint64_t) 0;
+
+    Limits limits;
+    int samplingRate;
+
+    // Start frame of the last sound of each key.
+    std::vector<std::uint64_t> keyFrames;
+
+    std::uint64_t block;
+    int blockStarts;
+
+    double tokens;
+    std::uint64_t refillFrame;
+
+    std::uint64_t lastEventFrame;
+    std::uint64_t runFrame;
+    int runLength;
+    bool flooding;
+
+public:
+
+    InputThrottle();
+
+    // Forgets all past events.
+    void configure(int samplingRate);
+
+    void setLimits(const Limits& limits);
+
+    const Limits& getLimits() {
+        return limits;
+    }
+
+    // Frame of the first event of the current flood.
+    std::uint64_t getFloodFrame() {
+        return runFrame;
+    }
+
+    Decision admit(int scanCode, std::uint64_t frame, int blockFrames);
+
+private:
+
+    void trackFlood(std::uint64_t frame);
+
+    bool takeToken(std::uint64_t frame);
+
+    std::uint64_t toFrames(int millis);
+
+    static int getKeySlot(int scanCode);
+};
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "KeyTrace.h"
+
+static const char MAGIC[4] = {'R', 'K', 'T', '1'};
+
+static const std::uint16_t FLAG_DOWN = 0x0001;
+
+// Times are stored as deltas to keep records small.
+struct KeyRecord {
+    std::uint32_t delta;
+    std::uint16_t scanCode;
+    std::uint16_t flags;
+};
+
+KeyTraceWriter* KeyTraceWriter::create(const std::filesystem::path& path)
+{
+    FILE* file = ::fopen(path.string().c_str(), "wb");
+    if (file == nullptr) {
+        return nullptr;
+    }
+
+    if (::fwrite(MAGIC, sizeof(MAGIC), 1, file) != 1) {
+        ::fclose(file);
+        return nullptr;
+    }
+
+    return new KeyTraceWriter(file);
+}
+
+KeyTraceWriter::KeyTraceWriter(FILE* file)
+:   file(file),
+    lastTimestamp(0),
+    started(false)
+{
+}
+
+KeyTraceWriter::~KeyTraceWriter()
+{
+    ::fclose(file);
+}
+
+void KeyTraceWriter::record(std::uint16_t scanCode, bool down)
+{
+    auto now = Clock::now();
+    if (!started) {
+        origin = now;
+        started = true;
+    }
+
+    std::uint64_t timestamp = std::chrono::duration_cast<std::chrono::microseconds>(now - origin).count();
+    std::uint64_t delta = std::min<std::uint64_t>(timestamp - lastTimestamp, UINT32_MAX);
+    lastTimestamp = timestamp;
+
+    KeyRecord record{
+        (std::uint32_t) delta,
+        scanCode,
+        (std::uint16_t) (down ? FLAG_DOWN : 0)
+    };
+    ::fwrite(&record, sizeof(record), 1, file);
+}
+
+bool KeyTraceReader::read(const std::filesystem::path& path, std::vector<KeyEvent>& events)
+{
+    FILE* file = ::fopen(path.string().c_str(), "rb");
+    if (file == nullptr) {
+        return false;
+    }
+
+    char magic[4]{};
+    if (::fread(magic, sizeof(magic), 1, file) != 1 || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+        ::fclose(file);
+        return false;
+    }
+
+    std::uint64_t timestamp = 0;
+    KeyRecord record{};
+    while (::fread(&record, sizeof(record), 1, file) == 1) {
+        timestamp += record.delta;
+        events.push_back(KeyEvent{timestamp, record.scanCode, (record.flags & FLAG_DOWN) != 0});
+    }
+
+    ::fclose(file);
+    return true;
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+struct KeyEvent {
+    // Microseconds since the first event of the trace.
+    std::uint64_t timestamp;
+    std::uint16_t scanCode;
+    bool down;
+};
+
+/*
+ * Records keyboard events into a compact binary trace.
+ */
+class KeyTraceWriter {
+private:
+
+    using Clock = std::chrono::steady_clock;
+
+    FILE* file;
+    Clock::time_point origin;
+    std::uint64_t lastTimestamp;
+    bool started;
+
+public:
+
+    static KeyTraceWriter* create(const std::filesystem::path& path);
+
+    ~KeyTraceWriter();
+
+    void record(std::uint16_t scanCode, bool down);
+
+private:
+
+    KeyTraceWriter(FILE* file);
+};
+
+class KeyTraceReader {
+public:
+
+    static bool read(const std::filesystem::path& path, std::vector<KeyEvent>& events);
+};
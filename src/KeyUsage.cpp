@@ -0,0 +1,176 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "KeyUsage.h"
+
+using json = nlohmann::json;
+
+static const int PREFIXES[] = {0x0000, 0xe000, 0xe100};
+
+const int KeyUsage::COMMON_KEYS[COMMON_KEY_COUNT] = {
+    0x39, // space
+    0x12, // e
+    0x14, // t
+    0x1e, // a
+    0x18, // o
+    0x17, // i
+    0x31, // n
+    0x1f, // s
+    0x23, // h
+    0x13, // r
+    0x0e, // backspace
+    0x20, // d
+    0x26, // l
+    0x1c, // enter
+    0x16, // u
+    0x2e, // c
+};
+
+KeyUsage::KeyUsage(const std::filesystem::path& path)
+:   path(path),
+    counts{},
+    changes(0),
+    savedChanges(0)
+{
+}
+
+/*
+ * Reads counts saved as e.g. { "keys": { "57": 1024, "30": 512 } }
+ * with the scan codes in decimal, as in the sound pack configurations.
+ */
+bool KeyUsage::load()
+{
+    std::ifstream stream(path);
+    if (!stream) {
+        return false;
+    }
+
+    json usage = json::parse(stream, nullptr, false);
+    if (!usage.is_object() || !usage.contains("keys") || !usage.at("keys").is_object()) {
+        return false;
+    }
+
+    std::lock_guard lock(mutex);
+    for (auto& [key, value] : usage.at("keys").items()) {
+        try {
+            int slot = getSlot(std::stoi(key));
+            if (slot >= 0 && value.is_number_unsigned()) {
+                counts[slot] = value.get<std::uint64_t>();
+            }
+        } catch (const std::exception& e) {
+        }
+    }
+    savedChanges = changes;
+    return true;
+}
+
+/*
+ * Writes a temporary file and renames it over the previous one, so that
+ * a failed write keeps both the counts of the last save and the changes
+ * still to be saved.
+ */
+bool KeyUsage::save()
+{
+    json keys = json::object();
+    std::uint64_t saving;
+    {
+        std::lock_guard lock(mutex);
+        if (changes == savedChanges) {
+            return true;
+        }
+        for (int slot = 0; slot < SLOTS; slot++) {
+            if (counts[slot] > 0) {
+                keys[std::to_string(getScanCode(slot))] = counts[slot];
+            }
+        }
+        saving = changes;
+    }
+
+    std::filesystem::path temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream stream(temporary, std::ios::trunc);
+        stream << json{{"keys", keys}}.dump(2) << std::endl;
+        stream.close();
+        if (!stream) {
+            std::error_code error;
+            std::filesystem::remove(temporary, error);
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if (error) {
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+
+    // Keys counted while writing are left for the next save.
+    std::lock_guard lock(mutex);
+    savedChanges = saving;
+    return true;
+}
+
+void KeyUsage::count(int scanCode)
+{
+    int slot = getSlot(scanCode);
+    if (slot < 0) {
+        return;
+    }
+    std::lock_guard lock(mutex);
+    counts[slot]++;
+    changes++;
+}
+
+std::uint64_t KeyUsage::getCount(int scanCode) const
+{
+    int slot = getSlot(scanCode);
+    if (slot < 0) {
+        return 0;
+    }
+    std::lock_guard lock(mutex);
+    return counts[slot];
+}
+
+KeyUsage::Counts KeyUsage::getCounts() const
+{
+    Counts result;
+    std::lock_guard lock(mutex);
+    for (int slot = 0; slot < SLOTS; slot++) {
+        if (counts[slot] > 0) {
+            result[getScanCode(slot)] = counts[slot];
+        }
+    }
+    return result;
+}
+
+int KeyUsage::getSlot(int scanCode)
+{
+    if (scanCode < 0 || scanCode > 0xffff) {
+        return -1;
+    }
+    for (int i = 0; i < 3; i++) {
+        if ((scanCode & 0xff00) == PREFIXES[i]) {
+            return (i << 8) | (scanCode & 0xff);
+        }
+    }
+    return -1;
+}
+
+int KeyUsage::getScanCode(int slot)
+{
+    return PREFIXES[slot >> 8] | (slot & 0xff);
+}
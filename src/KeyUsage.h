@@ -0,0 +1,70 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+/*
+ * Number of times each key has been pressed, kept across runs so that
+ * the clips of the keys pressed most are loaded first. Only counts are
+ * kept, never the order in which keys were pressed.
+ */
+class KeyUsage {
+public:
+
+    using Counts = std::unordered_map<int, std::uint64_t>;
+
+    static constexpr int COMMON_KEY_COUNT = 16;
+
+    // Keys typed most in English text, the most common first, which stand
+    // in for the counts while there is no history.
+    static const int COMMON_KEYS[COMMON_KEY_COUNT];
+
+private:
+
+    // Plain, 0xe0 and 0xe1 prefixed scan codes.
+    static constexpr int SLOTS = 0x300;
+
+    std::filesystem::path path;
+
+    mutable std::mutex mutex;
+    // Fixed up front, so that counting a key press never allocates.
+    std::uint64_t counts[SLOTS];
+    // Key presses counted so far, and up to the last load or successful save.
+    std::uint64_t changes;
+    std::uint64_t savedChanges;
+
+public:
+
+    KeyUsage(const std::filesystem::path& path);
+
+    // Reads the counts saved before, if any.
+    bool load();
+
+    // Writes the counts if they changed since loaded or saved.
+    bool save();
+
+    void count(int scanCode);
+
+    std::uint64_t getCount(int scanCode) const;
+
+    // Keys pressed at least once.
+    Counts getCounts() const;
+
+private:
+
+    static int getSlot(int scanCode);
+
+    static int getScanCode(int slot);
+};
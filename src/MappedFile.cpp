@@ -0,0 +1,132 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+:   data(nullptr),
+    size(0),
+#ifdef _WIN32
+    file(INVALID_HANDLE_VALUE),
+    mapping(nullptr)
+#else
+    descriptor(-1)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+    unmap();
+}
+
+#ifdef _WIN32
+
+MappedFile* MappedFile::open(const std::filesystem::path& path)
+{
+    std::unique_ptr<MappedFile> mapped(new MappedFile());
+
+    mapped->file = ::CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (mapped->file == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+
+    LARGE_INTEGER fileSize{};
+    if (!::GetFileSizeEx(mapped->file, &fileSize) || fileSize.QuadPart == 0) {
+        return nullptr;
+    }
+
+    mapped->mapping = ::CreateFileMappingW(mapped->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapped->mapping == nullptr) {
+        return nullptr;
+    }
+
+    void* view = ::MapViewOfFile(mapped->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr) {
+        return nullptr;
+    }
+
+    mapped->data = static_cast<const std::uint8_t*>(view);
+    mapped->size = (std::size_t) fileSize.QuadPart;
+    return mapped.release();
+}
+
+void MappedFile::unmap()
+{
+    if (data != nullptr) {
+        ::UnmapViewOfFile(data);
+        data = nullptr;
+    }
+    if (mapping != nullptr) {
+        ::CloseHandle(mapping);
+        mapping = nullptr;
+    }
+    if (file != INVALID_HANDLE_VALUE) {
+        ::CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+    }
+}
+
+#else
+
+MappedFile* MappedFile::open(const std::filesystem::path& path)
+{
+    std::unique_ptr<MappedFile> mapped(new MappedFile());
+
+    mapped->descriptor = ::open(path.c_str(), O_RDONLY);
+    if (mapped->descriptor < 0) {
+        return nullptr;
+    }
+
+    struct stat status{};
+    if (::fstat(mapped->descriptor, &status) != 0 || status.st_size == 0) {
+        return nullptr;
+    }
+
+    void* view = ::mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, mapped->descriptor, 0);
+    if (view == MAP_FAILED) {
+        return nullptr;
+    }
+
+    mapped->data = static_cast<const std::uint8_t*>(view);
+    mapped->size = (std::size_t) status.st_size;
+    return mapped.release();
+}
+
+void MappedFile::unmap()
+{
+    if (data != nullptr) {
+        ::munmap(const_cast<std::uint8_t*>(data), size);
+        data = nullptr;
+    }
+    if (descriptor >= 0) {
+        ::close(descriptor);
+        descriptor = -1;
+    }
+}
+
+#endif
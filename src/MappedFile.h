@@ -0,0 +1,54 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+/*
+ * Read-only view of a whole file mapped into memory.
+ */
+class MappedFile {
+private:
+
+    const std::uint8_t* data;
+    std::size_t size;
+
+#ifdef _WIN32
+    void* file;
+    void* mapping;
+#else
+    int descriptor;
+#endif
+
+public:
+
+    // Returns nullptr if the file cannot be mapped.
+    static MappedFile* open(const std::filesystem::path& path);
+
+    ~MappedFile();
+
+    const std::uint8_t* getData() {
+        return data;
+    }
+
+    std::size_t getSize() {
+        return size;
+    }
+
+private:
+
+    MappedFile();
+
+    void unmap();
+};
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "MasterBus.h"
+#include "Simd.h"
+
+MasterBus::MasterBus()
+:   numberOfChannels(0),
+    samplingRate(0),
+    volume(1.0f),
+    trim(1.0f),
+    limiting(true),
+    gain(1.0f),
+    limiterGain(1.0f),
+    smoothing(1.0f),
+    release(1.0f),
+    limitedBlocks(0)
+{
+}
+
+void MasterBus::configure(int numberOfChannels, int samplingRate)
+{
+    this->numberOfChannels = numberOfChannels;
+    this->samplingRate = samplingRate;
+    gain = volume * trim;
+    limiterGain = 1.0f;
+    equalizer.configure(numberOfChannels, samplingRate);
+    smoothing = 1.0f - std::exp(-1000.0f / (SMOOTHING_MILLIS * samplingRate));
+    release = 1.0f - std::exp(-1000.0f * SUBBLOCK_FRAMES / (RELEASE_MILLIS * samplingRate));
+}
+
+void MasterBus::setVolume(float volume)
+{
+    this->volume = std::max(0.0f, volume);
+}
+
+void MasterBus::setTrim(float trim)
+{
+    this->trim = std::max(0.0f, trim);
+}
+
+void MasterBus::setLimiting(bool enabled)
+{
+    limiting = enabled;
+}
+
+void MasterBus::setEqualizer(const std::vector<EqualizerBand>& bands)
+{
+    equalizer.setBands(bands);
+}
+
+void MasterBus::process(float* buffer, int frames)
+{
+    const std::size_t count = (std::size_t) frames * numberOfChannels;
+    const float target = volume * trim;
+
+    equalizer.process(buffer, frames);
+
+    if (gain != target) {
+        // One pole smoothing evaluated once per block, ramped linearly within it.
+        float next = gain + (target - gain) * std::min(1.0f, smoothing * frames);
+        if (std::fabs(target - next) < 1e-4f) {
+            next = target;
+        }
+        simd::ramp(buffer, frames, numberOfChannels, gain, next);
+        gain = next;
+    } else if (gain != 1.0f) {
+        simd::scale(buffer, count, gain);
+    }
+
+    if (limiting && limit(buffer, frames)) {
+        limitedBlocks++;
+    }
+}
+
+bool MasterBus::limit(float* buffer, int frames)
+{
+    bool reduced = false;
+
+    for (int offset = 0; offset < frames; offset += SUBBLOCK_FRAMES) {
+        const int n = std::min(SUBBLOCK_FRAMES, frames - offset);
+        float* samples = buffer + (std::size_t) offset * numberOfChannels;
+
+        float peak = simd::peak(samples, (std::size_t) n * numberOfChannels);
+        float needed = (peak > THRESHOLD) ? THRESHOLD / peak : 1.0f;
+        float released = limiterGain + (1.0f - limiterGain) * release;
+        float next = std::min(needed, released);
+
+        if (limiterGain < 1.0f || next < 1.0f) {
+            simd::ramp(samples, n, numberOfChannels, limiterGain, next);
+            reduced = true;
+        }
+        limiterGain = (next > 0.9999f) ? 1.0f : next;
+    }
+
+    if (reduced) {
+        // The ramp into a sudden peak may overshoot slightly.
+        simd::clamp(buffer, (std::size_t) frames * numberOfChannels, 1.0f);
+    }
+    return reduced;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "Equalizer.h"
+
+/*
+ * Last stage of the mix, applying the equalizer, the volume and the
+ * loudness trim of the sound pack, followed by a peak limiter.
+ * Everything is processed per block, whatever the number of voices.
+ */
+class MasterBus {
+private:
+
+    static constexpr int SUBBLOCK_FRAMES = 32;
+    static constexpr float THRESHOLD = 0.98f;
+    static constexpr float SMOOTHING_MILLIS = 20.0f;
+    static constexpr float RELEASE_MILLIS = 80.0f;
+
+    int numberOfChannels;
+    int samplingRate;
+
+    std::atomic<float> volume;
+    std::atomic<float> trim;
+    std::atomic<bool> limiting;
+
+    Equalizer equalizer;
+
+    // Gain applied at the end of the previous block.
+    float gain;
+    float limiterGain;
+    // Fraction of the distance to the target covered per frame.
+    float smoothing;
+    float release;
+
+    std::atomic<std::uint64_t> limitedBlocks;
+
+public:
+
+    MasterBus();
+
+    void configure(int numberOfChannels, int samplingRate);
+
+    void setVolume(float volume);
+
+    float getVolume() {
+        return volume;
+    }
+
+    void setTrim(float trim);
+
+    void setLimiting(bool enabled);
+
+    // Not thread safe, to be called while no block is processed.
+    void setEqualizer(const std::vector<EqualizerBand>& bands);
+
+    // Blocks in which the limiter reduced the gain.
+    std::uint64_t getLimitedBlocks() {
+        return limitedBlocks;
+    }
+
+    // True if processing would leave the samples untouched.
+    bool isBypassed() {
+        return !limiting && gain == 1.0f && volume * trim == 1.0f && equalizer.isBypassed();
+    }
+
+    void process(float* buffer, int frames);
+
+private:
+
+    bool limit(float* buffer, int frames);
+};
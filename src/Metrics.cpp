@@ -0,0 +1,50 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "Metrics.h"
+
+std::string Metrics::format()
+{
+    std::ostringstream out;
+    auto line = [&](const char* name, const std::atomic<std::uint64_t>& value) {
+        out << "roar_" << name << ' ' << value.load(std::memory_order_relaxed) << '\n';
+    };
+
+    line("plays_total", plays);
+    line("drops_total", drops);
+    line("steals_total", steals);
+    line("coalesced_total", coalesced);
+    line("limited_total", limited);
+    line("collapsed_total", collapsed);
+    line("underruns_total", underruns);
+    line("limited_blocks_total", limitedBlocks);
+    line("suspends_total", suspends);
+    line("resumes_total", resumes);
+    line("trims_total", trims);
+    line("render_microseconds_total", renderMicros);
+    line("active_voices", activeVoices);
+    line("peak_voices", peakVoices);
+    line("voice_pool_size", voicePoolSize);
+    line("pack_load_microseconds", packLoadMicros);
+    line("decode_microseconds", decodeMicros);
+    line("io_wait_microseconds", ioWaitMicros);
+    line("resident_pcm_bytes", residentBytes);
+    line("resume_microseconds", resumeMicros);
+    line("max_resume_microseconds", maxResumeMicros);
+    line("rematerialize_microseconds", rematerializeMicros);
+    line("max_rematerialize_microseconds", maxRematerializeMicros);
+
+    return out.str();
+}
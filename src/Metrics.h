@@ -0,0 +1,72 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+/*
+ * Counters and gauges of the audio engine.
+ * Written with relaxed atomics, so that readers never block the engine.
+ */
+struct Metrics {
+    using Counter = std::atomic<std::uint64_t>;
+    using Gauge = std::atomic<std::uint64_t>;
+
+    Counter plays{0};
+    // Sounds not played because no voice was available.
+    Counter drops{0};
+    Counter steals{0};
+    // Key events which started no sound because of the input limits.
+    Counter coalesced{0};
+    Counter limited{0};
+    // Sounds of input floods dropped or cut short to play a single one.
+    Counter collapsed{0};
+    // Blocks the device had to play before they were rendered.
+    Counter underruns{0};
+    // Blocks in which the limiter reduced the gain.
+    Counter limitedBlocks{0};
+    // Times the output was stopped for being idle, and restarted by a key.
+    Counter suspends{0};
+    Counter resumes{0};
+    // Times the samples were released after a long silence.
+    Counter trims{0};
+    // Time spent rendering blocks.
+    Counter renderMicros{0};
+
+    Gauge activeVoices{0};
+    Gauge peakVoices{0};
+    Gauge voicePoolSize{0};
+    Gauge packLoadMicros{0};
+    Gauge decodeMicros{0};
+    // Time loading was held up reading the sound file, apart from decoding.
+    Gauge ioWaitMicros{0};
+    Gauge residentBytes{0};
+    // Time the last resume took until the device was running again.
+    Gauge resumeMicros{0};
+    Gauge maxResumeMicros{0};
+    // Time the last restore of released samples took, delaying its key.
+    Gauge rematerializeMicros{0};
+    Gauge maxRematerializeMicros{0};
+
+    static void increment(Counter& counter) {
+        counter.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static void set(Gauge& gauge, std::uint64_t value) {
+        gauge.store(value, std::memory_order_relaxed);
+    }
+
+    // One "name value" line per metric.
+    std::string format();
+};
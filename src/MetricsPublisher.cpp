@@ -0,0 +1,156 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "MetricsPublisher.h"
+#include "SoundPlayer.h"
+
+MetricsPublisher* MetricsPublisher::create(SoundPlayer* soundPlayer, const Path& filePath, const std::wstring& pipeName) {
+    if (filePath.empty() && pipeName.empty()) {
+        return nullptr;
+    }
+
+    HANDLE stopEvent = ::CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    if (stopEvent == nullptr) {
+        return nullptr;
+    }
+
+    return new MetricsPublisher(soundPlayer, filePath, pipeName, stopEvent);
+}
+
+MetricsPublisher::MetricsPublisher(SoundPlayer* soundPlayer, const Path& filePath, const std::wstring& pipeName, HANDLE stopEvent)
+:   soundPlayer(soundPlayer),
+    filePath(filePath),
+    pipeName(pipeName),
+    stopEvent(stopEvent) {
+
+    thread = std::thread(&MetricsPublisher::run, this);
+}
+
+MetricsPublisher::~MetricsPublisher() {
+    ::SetEvent(stopEvent);
+    if (thread.joinable()) {
+        thread.join();
+    }
+    ::CloseHandle(stopEvent);
+}
+
+void MetricsPublisher::run() {
+    OVERLAPPED overlapped{};
+    overlapped.hEvent = ::CreateEventW(nullptr, TRUE, FALSE, nullptr);
+
+    HANDLE pipe = INVALID_HANDLE_VALUE;
+    ULONGLONG nextWrite = ::GetTickCount64();
+
+    for (;;) {
+        if (pipe == INVALID_HANDLE_VALUE && !pipeName.empty()) {
+            pipe = listen(&overlapped);
+        }
+
+        if (!filePath.empty() && ::GetTickCount64() >= nextWrite) {
+            writeFile();
+            nextWrite = ::GetTickCount64() + FILE_INTERVAL_MILLIS;
+        }
+
+        HANDLE handles[] = { stopEvent, overlapped.hEvent };
+        DWORD count = (pipe != INVALID_HANDLE_VALUE) ? 2 : 1;
+        DWORD timeout = filePath.empty() ? INFINITE : FILE_INTERVAL_MILLIS;
+
+        DWORD result = ::WaitForMultipleObjects(count, handles, FALSE, timeout);
+        if (result == WAIT_OBJECT_0) {
+            break;
+        } else if (result == WAIT_OBJECT_0 + 1) {
+            answer(pipe);
+            ::CloseHandle(pipe);
+            pipe = INVALID_HANDLE_VALUE;
+        }
+    }
+
+    if (pipe != INVALID_HANDLE_VALUE) {
+        ::CancelIo(pipe);
+        ::CloseHandle(pipe);
+    }
+    ::CloseHandle(overlapped.hEvent);
+}
+
+/*
+ * Creates an instance of the pipe and starts waiting for a client.
+ */
+HANDLE MetricsPublisher::listen(OVERLAPPED* overlapped) {
+    std::wstring name = L"\\\\.\\pipe\\" + pipeName;
+    HANDLE pipe = ::CreateNamedPipeW(
+        name.c_str(),
+        PIPE_ACCESS_OUTBOUND | FILE_FLAG_OVERLAPPED,
+        PIPE_TYPE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+        1,
+        4096,
+        0,
+        0,
+        nullptr);
+
+    if (pipe == INVALID_HANDLE_VALUE) {
+        return pipe;
+    }
+
+    ::ResetEvent(overlapped->hEvent);
+    if (!::ConnectNamedPipe(pipe, overlapped)) {
+        switch (::GetLastError()) {
+            case ERROR_IO_PENDING:
+                break;
+            case ERROR_PIPE_CONNECTED:
+                ::SetEvent(overlapped->hEvent);
+                break;
+            default:
+                ::CloseHandle(pipe);
+                return INVALID_HANDLE_VALUE;
+        }
+    }
+
+    return pipe;
+}
+
+void MetricsPublisher::answer(HANDLE pipe) {
+    std::string text = soundPlayer->getMetrics().format();
+
+    OVERLAPPED overlapped{};
+    overlapped.hEvent = ::CreateEventW(nullptr, TRUE, FALSE, nullptr);
+
+    DWORD written = 0;
+    if (::WriteFile(pipe, text.data(), (DWORD) text.size(), nullptr, &overlapped)
+        || ::GetLastError() == ERROR_IO_PENDING) {
+        ::GetOverlappedResult(pipe, &overlapped, &written, TRUE);
+    }
+
+    ::CloseHandle(overlapped.hEvent);
+    ::FlushFileBuffers(pipe);
+    ::DisconnectNamedPipe(pipe);
+}
+
+/*
+ * Replaces the file at once so that scrapers never see a partial one.
+ */
+void MetricsPublisher::writeFile() {
+    Path temporary = filePath;
+    temporary += L".tmp";
+
+    {
+        std::ofstream stream(temporary, std::ios::binary | std::ios::trunc);
+        if (!stream) {
+            return;
+        }
+        stream << soundPlayer->getMetrics().format();
+    }
+
+    ::MoveFileExW(temporary.c_str(), filePath.c_str(), MOVEFILE_REPLACE_EXISTING);
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+class SoundPlayer;
+
+/*
+ * Publishes the metrics of the sound player from a thread of its own,
+ * by answering clients of a named pipe and by rewriting a text file periodically.
+ */
+class MetricsPublisher {
+private:
+
+    static const DWORD FILE_INTERVAL_MILLIS = 10000;
+
+    using Path = std::filesystem::path;
+
+    SoundPlayer* soundPlayer;
+    Path filePath;
+    std::wstring pipeName;
+
+    HANDLE stopEvent;
+    std::thread thread;
+
+public:
+
+    // Either of the path and the pipe name may be empty.
+    static MetricsPublisher* create(SoundPlayer* soundPlayer, const Path& filePath, const std::wstring& pipeName);
+
+    ~MetricsPublisher();
+
+private:
+
+    MetricsPublisher(SoundPlayer* soundPlayer, const Path& filePath, const std::wstring& pipeName, HANDLE stopEvent);
+
+    void run();
+
+    HANDLE listen(OVERLAPPED* overlapped);
+
+    void answer(HANDLE pipe);
+
+    void writeFile();
+};
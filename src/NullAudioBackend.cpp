@@ -0,0 +1,185 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "NullAudioBackend.h"
+#include "FlightRecorder.h"
+
+static const std::uint16_t WAVE_FORMAT_IEEE_FLOAT_TAG = 3;
+
+// Canonical 44-byte header of a WAV file.
+struct WaveFileHeader {
+    char riff[4];
+    std::uint32_t riffSize;
+    char wave[4];
+    char fmt[4];
+    std::uint32_t fmtSize;
+    std::uint16_t formatTag;
+    std::uint16_t numberOfChannels;
+    std::uint32_t samplingRate;
+    std::uint32_t bytesPerSec;
+    std::uint16_t blockAlign;
+    std::uint16_t bitsPerSample;
+    char data[4];
+    std::uint32_t dataSize;
+};
+
+NullAudioBackend::NullAudioBackend(int blockFrames)
+:   blockFrames(blockFrames),
+    renderer(nullptr),
+    format{0, 0},
+    framePosition(0),
+    suspended(false),
+    sink(nullptr),
+    sinkBytes(0)
+{
+}
+
+NullAudioBackend* NullAudioBackend::create(const std::filesystem::path& sinkPath, int blockFrames)
+{
+    auto backend = new NullAudioBackend(blockFrames);
+    backend->sinkPath = sinkPath;
+    return backend;
+}
+
+NullAudioBackend::~NullAudioBackend()
+{
+    close();
+}
+
+bool NullAudioBackend::open(const AudioFormat& format, AudioRenderer* renderer)
+{
+    close();
+
+    this->format = format;
+    this->renderer = renderer;
+    this->framePosition = 0;
+    this->suspended = false;
+    block.assign((size_t) blockFrames * format.numberOfChannels, 0.0f);
+
+    if (!sinkPath.empty() && !openSink()) {
+        // Nothing is rendered without the sink it would be written to.
+        renderer = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void NullAudioBackend::close()
+{
+    closeSink();
+    renderer = nullptr;
+    suspended = false;
+}
+
+void NullAudioBackend::suspend()
+{
+    if (renderer != nullptr) {
+        suspended = true;
+    }
+}
+
+bool NullAudioBackend::resume()
+{
+    suspended = false;
+    return renderer != nullptr;
+}
+
+std::uint64_t NullAudioBackend::getTime()
+{
+    if (format.samplingRate == 0) {
+        return 0;
+    }
+    return framePosition * 1000000 / format.samplingRate;
+}
+
+bool NullAudioBackend::renderBlock()
+{
+    if (renderer == nullptr) {
+        return false;
+    }
+
+    if (suspended) {
+        std::fill(block.begin(), block.end(), 0.0f);
+    } else {
+        renderer->render(block.data(), blockFrames);
+    }
+    framePosition += blockFrames;
+    FlightRecorder::get().record(FlightEventType::BUFFER_SUBMIT, (std::uint16_t) blockFrames, (std::uint32_t) framePosition);
+
+    if (sink != nullptr) {
+        size_t bytes = block.size() * sizeof(float);
+        if (::fwrite(block.data(), bytes, 1, sink) == 1) {
+            sinkBytes += (std::uint32_t) bytes;
+        }
+    }
+    return true;
+}
+
+void NullAudioBackend::advanceTo(std::uint64_t frame)
+{
+    while (framePosition < frame) {
+        if (!renderBlock()) {
+            break;
+        }
+    }
+}
+
+bool NullAudioBackend::openSink()
+{
+    sink = ::fopen(sinkPath.string().c_str(), "wb");
+    if (sink == nullptr) {
+        return false;
+    }
+
+    sinkBytes = 0;
+
+    // Sizes are patched when the sink is closed.
+    WaveFileHeader header{};
+    if (::fwrite(&header, sizeof(header), 1, sink) != 1) {
+        closeSink();
+        return false;
+    }
+    return true;
+}
+
+void NullAudioBackend::closeSink()
+{
+    if (sink == nullptr) {
+        return;
+    }
+
+    const std::uint16_t blockAlign = format.numberOfChannels * sizeof(float);
+
+    WaveFileHeader header{
+        {'R', 'I', 'F', 'F'},
+        (std::uint32_t) (sizeof(WaveFileHeader) - 8 + sinkBytes),
+        {'W', 'A', 'V', 'E'},
+        {'f', 'm', 't', ' '},
+        16,
+        WAVE_FORMAT_IEEE_FLOAT_TAG,
+        (std::uint16_t) format.numberOfChannels,
+        (std::uint32_t) format.samplingRate,
+        (std::uint32_t) format.samplingRate * blockAlign,
+        blockAlign,
+        32,
+        {'d', 'a', 't', 'a'},
+        sinkBytes
+    };
+
+    ::fseek(sink, 0, SEEK_SET);
+    ::fwrite(&header, sizeof(header), 1, sink);
+    ::fclose(sink);
+    sink = nullptr;
+}
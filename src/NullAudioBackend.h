@@ -0,0 +1,102 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "AudioBackend.h"
+
+/*
+ * Backend driven by a simulated clock instead of a device.
+ * Blocks are pulled only when the clock is advanced,
+ * and are optionally written to a WAV file.
+ */
+class NullAudioBackend: public AudioBackend {
+private:
+
+    static const int DEFAULT_BLOCK_FRAMES = 480;
+
+    const int blockFrames;
+
+    AudioRenderer* renderer;
+    AudioFormat format;
+
+    std::vector<float> block;
+    std::uint64_t framePosition;
+    bool suspended;
+
+    std::filesystem::path sinkPath;
+    FILE* sink;
+    std::uint32_t sinkBytes;
+
+public:
+
+    NullAudioBackend(int blockFrames = DEFAULT_BLOCK_FRAMES);
+
+    // Creates a backend writing everything rendered to a WAV file.
+    static NullAudioBackend* create(const std::filesystem::path& sinkPath, int blockFrames = DEFAULT_BLOCK_FRAMES);
+
+    virtual ~NullAudioBackend();
+
+    virtual bool open(const AudioFormat& format, AudioRenderer* renderer);
+
+    virtual void close();
+
+    virtual std::uint64_t getFramePosition() {
+        return framePosition;
+    }
+
+    // Simulated time, which is the position of the next block.
+    virtual std::uint64_t getTime();
+
+    // The simulated clock never runs ahead of rendering.
+    virtual std::uint64_t getUnderruns() {
+        return 0;
+    }
+
+    // Blocks are played as soon as they are rendered.
+    virtual std::uint64_t getOutputDelay() {
+        return 0;
+    }
+
+    // Blocks are silent and not rendered while suspended.
+    virtual void suspend();
+
+    virtual bool resume();
+
+    virtual bool isSuspended() {
+        return suspended;
+    }
+
+    int getBlockFrames() {
+        return blockFrames;
+    }
+
+    // Samples of the block rendered last.
+    const float* getBlock() {
+        return block.data();
+    }
+
+    // Renders one block and advances the clock by its length.
+    bool renderBlock();
+
+    // Renders blocks until the clock reaches at least the given frame.
+    void advanceTo(std::uint64_t frame);
+
+private:
+
+    bool openSink();
+
+    void closeSink();
+};
@@ -14,62 +14,314 @@
  * limitations under the License.
  */
 #include "OggSoundResourceReader.h"
+#include "FilePrefetcher.h"
 #include "SoundResource.h"
+#include "Trace.h"
 #include <vorbis/vorbisfile.h>
 
-OggSoundResourceReader::OggSoundResourceReader(FILE* file)
-:   file(file)
+/*
+ * Seekable view of the encoded stream held in memory, waiting for
+ * the bytes still being read from the file.
+ */
+struct MemoryStream {
+    const std::uint8_t* data;
+    size_t size;
+    size_t position;
+    FilePrefetcher* prefetcher;
+    std::uint64_t waitMicros;
+
+    static size_t read(void* ptr, size_t size, size_t count, void* source) {
+        auto stream = static_cast<MemoryStream*>(source);
+        size_t available = stream->size - stream->position;
+        size_t bytes = std::min(size * count, available);
+        if (stream->prefetcher != nullptr && bytes > 0
+                && !stream->prefetcher->waitFor(stream->position, bytes, stream->waitMicros)) {
+            // The decoder takes nothing read with errno set for an error.
+            errno = EIO;
+            return 0;
+        }
+        std::memcpy(ptr, stream->data + stream->position, bytes);
+        stream->position += bytes;
+        return bytes / size;
+    }
+
+    static int seek(void* source, ogg_int64_t offset, int whence) {
+        auto stream = static_cast<MemoryStream*>(source);
+        ogg_int64_t base = 0;
+        switch (whence) {
+            case SEEK_SET: base = 0; break;
+            case SEEK_CUR: base = stream->position; break;
+            case SEEK_END: base = stream->size; break;
+            default: return -1;
+        }
+        if (base + offset < 0 || base + offset > (ogg_int64_t) stream->size) {
+            return -1;
+        }
+        stream->position = (size_t) (base + offset);
+        return 0;
+    }
+
+    static long tell(void* source) {
+        return (long) static_cast<MemoryStream*>(source)->position;
+    }
+};
+
+static const ov_callbacks MEMORY_CALLBACKS = {
+    MemoryStream::read,
+    MemoryStream::seek,
+    nullptr,
+    MemoryStream::tell
+};
+
+/*
+ * Decodes bytes of 16-bit samples at the position of the decoder.
+ */
+static bool decodeSamples(OggVorbis_File* vf, std::uint8_t* output, size_t bytes)
+{
+    size_t offset = 0;
+    size_t remaining = bytes;
+    int currentSection = 0;
+
+    while (remaining > 0) {
+        long bytesRead = ::ov_read(
+            vf,
+            (char*) output + offset,
+            (int) std::min<size_t>(remaining, 4096),
+            0, // little endian
+            2, // bytes per sample
+            1, // signed
+            &currentSection);
+
+        if (bytesRead == 0) {
+            break;
+        } else if (bytesRead > 0) {
+            offset += bytesRead;
+            remaining -= bytesRead;
+        } else {
+            return false;
+        }
+    }
+
+    // Stream ended early; keep the tail silent rather than uninitialized.
+    if (remaining > 0) {
+        std::memset(output + offset, 0, remaining);
+    }
+    return true;
+}
+
+OggSoundResourceReader::OggSoundResourceReader(FilePrefetcher* prefetcher)
+:   prefetcher(prefetcher),
+    memory(prefetcher->getData()),
+    memorySize(prefetcher->getSize()),
+    waitMicros(0),
+    rangeStream(nullptr),
+    rangeDecoder(nullptr),
+    rangeBytesPerFrame(0)
+{
+}
+
+OggSoundResourceReader::OggSoundResourceReader(const std::uint8_t* memory, std::size_t memorySize)
+:   prefetcher(nullptr),
+    memory(memory),
+    memorySize(memorySize),
+    waitMicros(0),
+    rangeStream(nullptr),
+    rangeDecoder(nullptr),
+    rangeBytesPerFrame(0)
 {
 }
 
 OggSoundResourceReader::~OggSoundResourceReader()
 {
-    ::fclose(file);
+    closeRange();
+
+    if (prefetcher != nullptr) {
+        delete prefetcher;
+    }
 }
 
 SoundResource* OggSoundResourceReader::read()
 {
+    TRACE_ZONE("OggSoundResourceReader::read");
+
+    MemoryStream stream{memory, memorySize, 0, prefetcher, 0};
     OggVorbis_File vf{};
 
-    if (::ov_open_callbacks(file, &vf, nullptr, 0, OV_CALLBACKS_NOCLOSE) < 0) {
+    if (::ov_open_callbacks(&stream, &vf, nullptr, 0, MEMORY_CALLBACKS) < 0) {
         std::cerr << "Not an Ogg bitstream" << std::endl;
         return nullptr;
     }
+    waitMicros = stream.waitMicros;
 
     vorbis_info* info = ::ov_info(&vf, -1);
+    const int channels = info->channels;
+    const long rate = info->rate;
+
+    // Chained streams may change the format between links.
+    const bool chained = ::ov_streams(&vf) != 1;
 
     ogg_int64_t numberOfSamples = ::ov_pcm_total(&vf, -1);
-    size_t totalBytes = numberOfSamples * 2 * info->channels;
+    ::ov_clear(&vf);
+
+    if (numberOfSamples < 0) {
+        return nullptr;
+    }
+
+    const int bytesPerFrame = 2 * channels;
+    size_t totalBytes = numberOfSamples * bytesPerFrame;
 
     std::uint8_t* decoded = new std::uint8_t[totalBytes];
 
-    size_t offset = 0;
-    int currentSection = 0;
-    for (;;) {
-        long bytesRead = ::ov_read(
-            &vf,
-            (char*) decoded + offset,
-            4096,
-            0, // little endian
-            2, // bytes per sample
-            1, // signed
-            &currentSection);
+    int segments = chained ? 1 : countSegments(numberOfSamples, rate);
+    bool succeeded = true;
 
-        if (bytesRead == 0) {
-            break;
-        } else if (bytesRead > 0) {
-            offset += bytesRead;
-        } else {
-            delete [] decoded;
-            return nullptr;
+    if (segments <= 1) {
+        std::uint64_t segmentWait = 0;
+        succeeded = decodeSegment(decoded, 0, numberOfSamples, bytesPerFrame, segmentWait);
+        waitMicros += segmentWait;
+    } else {
+        std::atomic<bool> failed(false);
+        std::vector<std::thread> workers;
+        workers.reserve(segments - 1);
+        std::vector<std::uint64_t> segmentWaits(segments, 0);
+
+        auto decodeNth = [&](int n) {
+            std::int64_t start = numberOfSamples * n / segments;
+            std::int64_t end = numberOfSamples * (n + 1) / segments;
+            if (!decodeSegment(decoded + start * bytesPerFrame, start, end, bytesPerFrame, segmentWaits[n])) {
+                failed = true;
+            }
+        };
+
+        for (int n = 1; n < segments; n++) {
+            workers.emplace_back(decodeNth, n);
         }
+        // The calling thread takes the first segment.
+        decodeNth(0);
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        // Segments wait side by side, so the longest wait is what held up the whole.
+        waitMicros += *std::max_element(segmentWaits.begin(), segmentWaits.end());
+        succeeded = !failed;
+    }
+
+    if (!succeeded) {
+        delete [] decoded;
+        return nullptr;
     }
 
     return new SoundResource(
-        info->channels,
-        info->rate,
+        channels,
+        rate,
         16,
         decoded,
         totalBytes
     );
 }
+
+/*
+ * Decodes the encoded stream in place, be it an archive entry or a file
+ * kept by its prefetcher, so the first clips are decoded while the rest
+ * is still being read. Chained streams are read whole, since their
+ * format may change between links.
+ */
+bool OggSoundResourceReader::open(Format& format)
+{
+    TRACE_ZONE("OggSoundResourceReader::open");
+
+    closeRange();
+
+    rangeStream = new MemoryStream{memory, memorySize, 0, prefetcher, 0};
+    rangeDecoder = new OggVorbis_File{};
+
+    if (::ov_open_callbacks(rangeStream, rangeDecoder, nullptr, 0, MEMORY_CALLBACKS) < 0) {
+        delete rangeDecoder;
+        rangeDecoder = nullptr;
+        closeRange();
+        return false;
+    }
+
+    ogg_int64_t numberOfSamples = ::ov_pcm_total(rangeDecoder, -1);
+    if (::ov_streams(rangeDecoder) != 1 || numberOfSamples < 0) {
+        closeRange();
+        return false;
+    }
+
+    vorbis_info* info = ::ov_info(rangeDecoder, -1);
+    rangeBytesPerFrame = 2 * info->channels;
+
+    format = Format{
+        info->channels,
+        (int) info->rate,
+        16,
+        (std::uint64_t) numberOfSamples * rangeBytesPerFrame
+    };
+    return true;
+}
+
+bool OggSoundResourceReader::readRange(std::uint64_t offset, std::uint64_t length, std::uint8_t* output)
+{
+    if (rangeDecoder == nullptr) {
+        return false;
+    }
+
+    if (::ov_pcm_seek(rangeDecoder, (ogg_int64_t) (offset / rangeBytesPerFrame)) != 0) {
+        return false;
+    }
+    return decodeSamples(rangeDecoder, output, length);
+}
+
+std::uint64_t OggSoundResourceReader::getWaitMicros()
+{
+    return waitMicros + ((rangeStream != nullptr) ? rangeStream->waitMicros : 0);
+}
+
+void OggSoundResourceReader::closeRange()
+{
+    if (rangeDecoder != nullptr) {
+        ::ov_clear(rangeDecoder);
+        delete rangeDecoder;
+        rangeDecoder = nullptr;
+    }
+    if (rangeStream != nullptr) {
+        delete rangeStream;
+        rangeStream = nullptr;
+    }
+}
+
+int OggSoundResourceReader::countSegments(std::int64_t numberOfSamples, long samplingRate)
+{
+    int cores = (int) std::thread::hardware_concurrency();
+    std::int64_t bySize = numberOfSamples / (samplingRate * MIN_SEGMENT_SECONDS);
+    return (int) std::max<std::int64_t>(1, std::min<std::int64_t>({cores, bySize, MAX_SEGMENTS}));
+}
+
+/*
+ * Decodes samples in [start, end) into output with a decoder of its own.
+ */
+bool OggSoundResourceReader::decodeSegment(
+    std::uint8_t* output, std::int64_t start, std::int64_t end, int bytesPerFrame, std::uint64_t& waitMicros)
+{
+    TRACE_ZONE("OggSoundResourceReader::decodeSegment");
+
+    MemoryStream stream{memory, memorySize, 0, prefetcher, 0};
+    OggVorbis_File vf{};
+
+    if (::ov_open_callbacks(&stream, &vf, nullptr, 0, MEMORY_CALLBACKS) < 0) {
+        return false;
+    }
+
+    if (start > 0 && ::ov_pcm_seek(&vf, start) != 0) {
+        ::ov_clear(&vf);
+        return false;
+    }
+
+    bool succeeded = decodeSamples(&vf, output, (end - start) * bytesPerFrame);
+    waitMicros = stream.waitMicros;
+
+    ::ov_clear(&vf);
+    return succeeded;
+}
@@ -17,18 +17,54 @@
 
 #include "SoundResourceReader.h"
 
+struct MemoryStream;
+struct OggVorbis_File;
+class FilePrefetcher;
+
 class OggSoundResourceReader: public SoundResourceReader {
 private:
 
-    FILE* file;
+    // Segments shorter than this are not worth a decoder of their own.
+    static const int MIN_SEGMENT_SECONDS = 2;
+    static const int MAX_SEGMENTS = 8;
+
+    // Reads the file while the stream is decoded, if there is one.
+    FilePrefetcher* prefetcher;
+
+    // Whole compressed stream, shared by all decoders.
+    const std::uint8_t* memory;
+    std::size_t memorySize;
+
+    // Time the whole stream was held up by reading the file.
+    std::uint64_t waitMicros;
+
+    // Decoder kept open for reading ranges.
+    MemoryStream* rangeStream;
+    OggVorbis_File* rangeDecoder;
+    int rangeBytesPerFrame;
 
 public:
 
-    OggSoundResourceReader(FILE* file);
+    OggSoundResourceReader(FilePrefetcher* prefetcher);
+
+    // The memory must outlive the reader.
+    OggSoundResourceReader(const std::uint8_t* memory, std::size_t memorySize);
 
     virtual ~OggSoundResourceReader();
 
     virtual SoundResource* read();
 
+    virtual bool open(Format& format);
+
+    virtual bool readRange(std::uint64_t offset, std::uint64_t length, std::uint8_t* output);
+
+    virtual std::uint64_t getWaitMicros();
+
 private:
+
+    void closeRange();
+
+    int countSegments(std::int64_t numberOfSamples, long samplingRate);
+
+    bool decodeSegment(std::uint8_t* output, std::int64_t start, std::int64_t end, int bytesPerFrame, std::uint64_t& waitMicros);
 };
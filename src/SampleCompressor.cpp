@@ -0,0 +1,91 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "SampleCompressor.h"
+#include "Trace.h"
+#include <zlib.h>
+
+bool SampleCompressor::compress(const std::int16_t* input, std::size_t count, int channels, std::vector<std::uint8_t>& output)
+{
+    TRACE_ZONE("SampleCompressor::compress");
+
+    z_stream stream{};
+    if (::deflateInit(&stream, Z_BEST_SPEED) != Z_OK) {
+        return false;
+    }
+
+    output.resize(::deflateBound(&stream, (uLong) (count * sizeof(std::int16_t))));
+    stream.next_out = output.data();
+    stream.avail_out = (uInt) output.size();
+
+    // Wraps around, which the sums on expanding undo.
+    std::vector<std::uint16_t> deltas(CHUNK_SAMPLES);
+    std::vector<std::uint16_t> previous(channels, 0);
+    int channel = 0;
+    int result = Z_OK;
+    for (std::size_t start = 0; start < count && result == Z_OK; start += CHUNK_SAMPLES) {
+        const std::size_t length = std::min(CHUNK_SAMPLES, count - start);
+        for (std::size_t i = 0; i < length; i++) {
+            const std::uint16_t sample = (std::uint16_t) input[start + i];
+            deltas[i] = (std::uint16_t) (sample - previous[channel]);
+            previous[channel] = sample;
+            channel = (channel + 1 == channels) ? 0 : channel + 1;
+        }
+        stream.next_in = reinterpret_cast<Bytef*>(deltas.data());
+        stream.avail_in = (uInt) (length * sizeof(std::uint16_t));
+        result = ::deflate(&stream, start + length < count ? Z_NO_FLUSH : Z_FINISH);
+    }
+    if (count == 0) {
+        result = ::deflate(&stream, Z_FINISH);
+    }
+    ::deflateEnd(&stream);
+
+    if (result != Z_STREAM_END) {
+        return false;
+    }
+    output.resize(stream.total_out);
+    output.shrink_to_fit();
+    return true;
+}
+
+bool SampleCompressor::expand(const std::vector<std::uint8_t>& input, std::int16_t* output, std::size_t count, int channels)
+{
+    TRACE_ZONE("SampleCompressor::expand");
+
+    z_stream stream{};
+    if (::inflateInit(&stream) != Z_OK) {
+        return false;
+    }
+    stream.next_in = const_cast<Bytef*>(input.data());
+    stream.avail_in = (uInt) input.size();
+    stream.next_out = reinterpret_cast<Bytef*>(output);
+    stream.avail_out = (uInt) (count * sizeof(std::int16_t));
+    int result = ::inflate(&stream, Z_FINISH);
+    ::inflateEnd(&stream);
+
+    if (result != Z_STREAM_END || stream.total_out != count * sizeof(std::int16_t)) {
+        return false;
+    }
+
+    std::vector<std::uint16_t> previous(channels, 0);
+    std::uint16_t* samples = reinterpret_cast<std::uint16_t*>(output);
+    int channel = 0;
+    for (std::size_t i = 0; i < count; i++) {
+        previous[channel] = (std::uint16_t) (previous[channel] + samples[i]);
+        samples[i] = previous[channel];
+        channel = (channel + 1 == channels) ? 0 : channel + 1;
+    }
+    return true;
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+/*
+ * Losslessly compresses interleaved 16-bit samples, storing the difference
+ * of each sample from the previous one of its channel, which is small for
+ * sounds and silence alike, and deflating the differences at the fastest level.
+ */
+class SampleCompressor {
+public:
+
+    // Compresses count samples, false if zlib fails.
+    static bool compress(const std::int16_t* input, std::size_t count, int channels, std::vector<std::uint8_t>& output);
+
+    // Restores count samples compressed with the same channels.
+    static bool expand(const std::vector<std::uint8_t>& input, std::int16_t* output, std::size_t count, int channels);
+
+private:
+
+    // Samples differenced and deflated at a time.
+    static constexpr std::size_t CHUNK_SAMPLES = 32 * 1024;
+};
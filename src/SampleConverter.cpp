@@ -0,0 +1,120 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "SampleConverter.h"
+#include "Simd.h"
+
+int SampleConverter::getBytesPerSample(SampleFormat format)
+{
+    switch (format) {
+        case SampleFormat::UNSIGNED_8: return 1;
+        case SampleFormat::SIGNED_16: return 2;
+        case SampleFormat::SIGNED_24: return 3;
+        case SampleFormat::SIGNED_32: return 4;
+        case SampleFormat::FLOAT_32: return 4;
+    }
+    return 0;
+}
+
+void SampleConverter::toSigned16(SampleFormat format, const std::uint8_t* input, std::size_t count, std::int16_t* output)
+{
+    switch (format) {
+        case SampleFormat::UNSIGNED_8:
+            fromUnsigned8(input, count, output);
+            break;
+        case SampleFormat::SIGNED_16:
+            std::memcpy(output, input, count * sizeof(std::int16_t));
+            break;
+        case SampleFormat::SIGNED_24:
+            fromSigned24(input, count, output);
+            break;
+        case SampleFormat::SIGNED_32:
+            fromSigned32(input, count, output);
+            break;
+        case SampleFormat::FLOAT_32:
+            fromFloat32(input, count, output);
+            break;
+    }
+}
+
+void SampleConverter::fromUnsigned8(const std::uint8_t* input, std::size_t count, std::int16_t* output)
+{
+    std::size_t i = 0;
+#ifdef ROAR_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16(128);
+    for (; i + 16 <= count; i += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+        __m128i low = _mm_slli_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(x, zero), bias), 8);
+        __m128i high = _mm_slli_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(x, zero), bias), 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), low);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i + 8), high);
+    }
+#endif
+    for (; i < count; i++) {
+        output[i] = (std::int16_t) ((input[i] - 128) * 256);
+    }
+}
+
+// Keeps the two most significant bytes, there is no SSE2 shuffle for 3-byte samples.
+void SampleConverter::fromSigned24(const std::uint8_t* input, std::size_t count, std::int16_t* output)
+{
+    for (std::size_t i = 0; i < count; i++) {
+        const std::uint8_t* sample = input + i * 3;
+        output[i] = (std::int16_t) (sample[1] | (sample[2] << 8));
+    }
+}
+
+void SampleConverter::fromSigned32(const std::uint8_t* input, std::size_t count, std::int16_t* output)
+{
+    std::size_t i = 0;
+#ifdef ROAR_SSE2
+    for (; i + 8 <= count; i += 8) {
+        const __m128i* source = reinterpret_cast<const __m128i*>(input + i * 4);
+        __m128i low = _mm_srai_epi32(_mm_loadu_si128(source), 16);
+        __m128i high = _mm_srai_epi32(_mm_loadu_si128(source + 1), 16);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_packs_epi32(low, high));
+    }
+#endif
+    for (; i < count; i++) {
+        std::int32_t sample;
+        std::memcpy(&sample, input + i * 4, sizeof(sample));
+        output[i] = (std::int16_t) (sample >> 16);
+    }
+}
+
+void SampleConverter::fromFloat32(const std::uint8_t* input, std::size_t count, std::int16_t* output)
+{
+    std::size_t i = 0;
+#ifdef ROAR_SSE2
+    const __m128 scale = _mm_set1_ps(32767.0f);
+    const __m128 lower = _mm_set1_ps(-1.0f);
+    const __m128 upper = _mm_set1_ps(1.0f);
+    for (; i + 8 <= count; i += 8) {
+        const float* source = reinterpret_cast<const float*>(input) + i;
+        __m128 x0 = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(source), lower), upper);
+        __m128 x1 = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(source + 4), lower), upper);
+        __m128i low = _mm_cvtps_epi32(_mm_mul_ps(x0, scale));
+        __m128i high = _mm_cvtps_epi32(_mm_mul_ps(x1, scale));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_packs_epi32(low, high));
+    }
+#endif
+    for (; i < count; i++) {
+        float sample;
+        std::memcpy(&sample, input + i * 4, sizeof(sample));
+        sample = std::max(-1.0f, std::min(1.0f, sample));
+        output[i] = (std::int16_t) std::lrint(sample * 32767.0f);
+    }
+}
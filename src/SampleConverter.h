@@ -0,0 +1,43 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+enum class SampleFormat {
+    UNSIGNED_8,
+    SIGNED_16,
+    SIGNED_24,
+    SIGNED_32,
+    FLOAT_32,
+};
+
+/*
+ * Converts samples to the signed 16-bit format mixed by the engine.
+ */
+class SampleConverter {
+public:
+
+    static int getBytesPerSample(SampleFormat format);
+
+    // Converts count samples from input to output.
+    static void toSigned16(SampleFormat format, const std::uint8_t* input, std::size_t count, std::int16_t* output);
+
+private:
+
+    static void fromUnsigned8(const std::uint8_t* input, std::size_t count, std::int16_t* output);
+    static void fromSigned24(const std::uint8_t* input, std::size_t count, std::int16_t* output);
+    static void fromSigned32(const std::uint8_t* input, std::size_t count, std::int16_t* output);
+    static void fromFloat32(const std::uint8_t* input, std::size_t count, std::int16_t* output);
+};
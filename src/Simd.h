@@ -0,0 +1,215 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ROAR_SSE2 1
+#include <emmintrin.h>
+#endif
+
+/*
+ * Vectorized loops over samples, with scalar fallbacks.
+ */
+namespace simd {
+
+// Largest absolute value of the samples.
+inline float peak(const float* samples, std::size_t count) {
+    std::size_t i = 0;
+    float result = 0.0f;
+#ifdef ROAR_SSE2
+    const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 m = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4) {
+        m = _mm_max_ps(m, _mm_and_ps(_mm_loadu_ps(samples + i), mask));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, m);
+    result = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#endif
+    for (; i < count; i++) {
+        result = std::max(result, std::fabs(samples[i]));
+    }
+    return result;
+}
+
+inline void scale(float* samples, std::size_t count, float gain) {
+    std::size_t i = 0;
+#ifdef ROAR_SSE2
+    const __m128 g = _mm_set1_ps(gain);
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(samples + i, _mm_mul_ps(_mm_loadu_ps(samples + i), g));
+    }
+#endif
+    for (; i < count; i++) {
+        samples[i] *= gain;
+    }
+}
+
+inline void clamp(float* samples, std::size_t count, float limit) {
+    std::size_t i = 0;
+#ifdef ROAR_SSE2
+    const __m128 high = _mm_set1_ps(limit);
+    const __m128 low = _mm_set1_ps(-limit);
+    for (; i + 4 <= count; i += 4) {
+        __m128 x = _mm_loadu_ps(samples + i);
+        _mm_storeu_ps(samples + i, _mm_max_ps(low, _mm_min_ps(high, x)));
+    }
+#endif
+    for (; i < count; i++) {
+        samples[i] = std::max(-limit, std::min(limit, samples[i]));
+    }
+}
+
+// Largest absolute value of 16-bit samples.
+inline int peak(const std::int16_t* samples, std::size_t count) {
+    std::size_t i = 0;
+    int result = 0;
+#ifdef ROAR_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    __m128i m = zero;
+    for (; i + 8 <= count; i += 8) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+        // Saturates -32768 to 32767.
+        m = _mm_max_epi16(m, _mm_max_epi16(x, _mm_subs_epi16(zero, x)));
+    }
+    std::int16_t lanes[8];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), m);
+    for (int lane = 0; lane < 8; lane++) {
+        result = std::max(result, (int) lanes[lane]);
+    }
+#endif
+    for (; i < count; i++) {
+        result = std::max(result, std::abs((int) samples[i]));
+    }
+    return result;
+}
+
+// Sum of the squares of 16-bit samples.
+inline std::uint64_t sumOfSquares(const std::int16_t* samples, std::size_t count) {
+    std::size_t i = 0;
+    std::uint64_t result = 0;
+#ifdef ROAR_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = zero;
+    for (; i + 8 <= count; i += 8) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+        // Pairs of squares fit in 32 bits when taken as unsigned.
+        __m128i squares = _mm_madd_epi16(x, x);
+        sum = _mm_add_epi64(sum, _mm_unpacklo_epi32(squares, zero));
+        sum = _mm_add_epi64(sum, _mm_unpackhi_epi32(squares, zero));
+    }
+    std::uint64_t lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum);
+    result = lanes[0] + lanes[1];
+#endif
+    for (; i < count; i++) {
+        result += (std::int64_t) samples[i] * samples[i];
+    }
+    return result;
+}
+
+// Energies of the mid (L + R) and side (L - R) signals of 16-bit stereo frames.
+inline void stereoEnergy(const std::int16_t* samples, std::size_t frames, double& mid, double& side) {
+    std::size_t i = 0;
+    mid = 0.0;
+    side = 0.0;
+#ifdef ROAR_SSE2
+    const __m128i sum = _mm_set1_epi16(1);
+    const __m128i difference = _mm_set1_epi32((int) 0xffff0001);
+    __m128d midSum = _mm_setzero_pd();
+    __m128d sideSum = _mm_setzero_pd();
+    for (; i + 4 <= frames; i += 4) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i * 2));
+        __m128 m = _mm_cvtepi32_ps(_mm_madd_epi16(x, sum));
+        __m128 d = _mm_cvtepi32_ps(_mm_madd_epi16(x, difference));
+        m = _mm_mul_ps(m, m);
+        d = _mm_mul_ps(d, d);
+        // Doubles keep the sums of long clips exact enough.
+        midSum = _mm_add_pd(midSum, _mm_add_pd(_mm_cvtps_pd(m), _mm_cvtps_pd(_mm_movehl_ps(m, m))));
+        sideSum = _mm_add_pd(sideSum, _mm_add_pd(_mm_cvtps_pd(d), _mm_cvtps_pd(_mm_movehl_ps(d, d))));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, midSum);
+    mid = lanes[0] + lanes[1];
+    _mm_storeu_pd(lanes, sideSum);
+    side = lanes[0] + lanes[1];
+#endif
+    for (; i < frames; i++) {
+        double m = (double) samples[i * 2] + samples[i * 2 + 1];
+        double d = (double) samples[i * 2] - samples[i * 2 + 1];
+        mid += m * m;
+        side += d * d;
+    }
+}
+
+// Averages the channels of 16-bit stereo frames into mono samples.
+inline void foldToMono(const std::int16_t* stereo, std::size_t frames, std::int16_t* mono) {
+    std::size_t i = 0;
+#ifdef ROAR_SSE2
+    const __m128i sum = _mm_set1_epi16(1);
+    for (; i + 8 <= frames; i += 8) {
+        const __m128i* source = reinterpret_cast<const __m128i*>(stereo + i * 2);
+        __m128i low = _mm_srai_epi32(_mm_madd_epi16(_mm_loadu_si128(source), sum), 1);
+        __m128i high = _mm_srai_epi32(_mm_madd_epi16(_mm_loadu_si128(source + 1), sum), 1);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(mono + i), _mm_packs_epi32(low, high));
+    }
+#endif
+    for (; i < frames; i++) {
+        mono[i] = (std::int16_t) ((stereo[i * 2] + stereo[i * 2 + 1]) >> 1);
+    }
+}
+
+// Scales interleaved frames by a gain moving linearly from one value to another.
+inline void ramp(float* samples, std::size_t frames, int channels, float from, float to) {
+    const float step = (to - from) / frames;
+    float gain = from;
+    for (std::size_t i = 0; i < frames; i++) {
+        gain += step;
+        for (int c = 0; c < channels; c++) {
+            samples[c] *= gain;
+        }
+        samples += channels;
+    }
+}
+
+// Adds the products of two sequences of complex numbers held as separate
+// real and imaginary parts to the accumulators.
+inline void multiplyAdd(
+    float* accRe, float* accIm,
+    const float* aRe, const float* aIm,
+    const float* bRe, const float* bIm,
+    std::size_t count) {
+    std::size_t i = 0;
+#ifdef ROAR_SSE2
+    const std::size_t vectorized = count & ~(std::size_t) 3;
+    for (; i < vectorized; i += 4) {
+        __m128 ar = _mm_loadu_ps(aRe + i);
+        __m128 ai = _mm_loadu_ps(aIm + i);
+        __m128 br = _mm_loadu_ps(bRe + i);
+        __m128 bi = _mm_loadu_ps(bIm + i);
+        __m128 re = _mm_sub_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi));
+        __m128 im = _mm_add_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br));
+        _mm_storeu_ps(accRe + i, _mm_add_ps(_mm_loadu_ps(accRe + i), re));
+        _mm_storeu_ps(accIm + i, _mm_add_ps(_mm_loadu_ps(accIm + i), im));
+    }
+#endif
+    for (; i < count; i++) {
+        accRe[i] += aRe[i] * bRe[i] - aIm[i] * bIm[i];
+        accIm[i] += aRe[i] * bIm[i] + aIm[i] * bRe[i];
+    }
+}
+
+}
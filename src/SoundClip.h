@@ -15,11 +15,15 @@
  */
 #pragma once
 
+struct ClipLoudness;
+
 struct SoundClip {
-    const std::uint8_t* data;
-    const std::uint64_t length;
+    const std::uint8_t* data = nullptr;
+    std::uint64_t length = 0;
+    // Known once the clip belongs to a sound pack.
+    const ClipLoudness* loudness = nullptr;
 
-    bool isEmpty() {
+    bool isEmpty() const {
         return length == 0;
     }
 };
@@ -14,32 +14,515 @@
  * limitations under the License.
  */
 #include "SoundPack.h"
-#include "SoundResource.h"
+#include "SoundResourceReader.h"
+#include "SampleCompressor.h"
+#include "ConvolutionReverb.h"
+#include "Simd.h"
+#include "Trace.h"
 
-SoundPack::SoundPack(SoundResource* resource, SoundClipMap* map)
-:   resource(resource),
-    map(map) {
+static std::size_t alignUp(std::size_t size) {
+    return (size + SoundPack::ALIGNMENT - 1) / SoundPack::ALIGNMENT * SoundPack::ALIGNMENT;
 }
 
-SoundPack::~SoundPack() {
-    if (map != nullptr) {
-        std::set<SoundClip*> distinct;
-        for (const auto& pair : *map) {
-            distinct.insert(pair.second);
+SoundPack::SoundPack(SoundResource* resource, const SoundClipMap& map, const Envelope& envelope)
+:   numberOfChannels(resource->getNumberOfChannels()),
+    samplingRate(resource->getSamplingRate()),
+    bitsPerSample(resource->getBitsPerSample()),
+    clipChannels(resource->getNumberOfChannels()),
+    arena(nullptr),
+    arenaSize(0),
+    numberOfPages(0),
+    tableBytes(0),
+    samplesBytes(0),
+    numberOfClips(0),
+    fallbackClip(NO_ENTRY),
+    normalizedLevel(0.0f),
+    stopStreaming(false),
+    streamMicros(0),
+    envelope(envelope),
+    trim(1.0f),
+    reverb(nullptr),
+    loadMicros(0),
+    decodeMicros(0),
+    ioWaitMicros(0) {
+
+    // Aliased keys share the same slice, which is stored once.
+    std::vector<std::pair<int, int>> keys;
+    std::vector<SoundClip> distinct;
+
+    for (const auto& [scanCode, clip] : map) {
+        if (clip.isEmpty() || scanCode < 0 || scanCode > 0xffff) {
+            continue;
+        }
+        auto found = std::find_if(distinct.begin(), distinct.end(), [&](const SoundClip& other) {
+            return other.data == clip.data && other.length == clip.length;
+        });
+        keys.emplace_back(scanCode, (int) (found - distinct.begin()));
+        if (found == distinct.end()) {
+            distinct.push_back(clip);
+        }
+    }
+
+    if (isDualMono(distinct)) {
+        clipChannels = 1;
+    }
+    const std::uint64_t folding = numberOfChannels / clipChannels;
+
+    std::vector<std::uint64_t> lengths;
+    for (const auto& clip : distinct) {
+        lengths.push_back(clip.length / folding);
+    }
+
+    allocate(keys, lengths);
+
+    for (int i = 0; i < numberOfClips; i++) {
+        const SoundClip& clip = distinct[i];
+        if (folding > 1) {
+            simd::foldToMono(
+                reinterpret_cast<const std::int16_t*>(clip.data),
+                clipLengths[i] / sizeof(std::int16_t),
+                reinterpret_cast<std::int16_t*>(getClipBuffer(i)));
+        } else {
+            std::memcpy(getClipBuffer(i), clip.data, clipLengths[i]);
+        }
+    }
+
+    analyzeClips();
+
+    for (int i = 0; i < numberOfClips; i++) {
+        publishClip(i);
+    }
+}
+
+/*
+ * Clips are laid out with the channels of the resource, as whether they
+ * can be folded is only known once the first of them are decoded.
+ */
+SoundPack::SoundPack(int numberOfChannels, int samplingRate, int bitsPerSample, const SampleRangeMap& map, const Envelope& envelope)
+:   numberOfChannels(numberOfChannels),
+    samplingRate(samplingRate),
+    bitsPerSample(bitsPerSample),
+    clipChannels(numberOfChannels),
+    arena(nullptr),
+    arenaSize(0),
+    numberOfPages(0),
+    tableBytes(0),
+    samplesBytes(0),
+    numberOfClips(0),
+    fallbackClip(NO_ENTRY),
+    normalizedLevel(0.0f),
+    stopStreaming(false),
+    streamMicros(0),
+    envelope(envelope),
+    trim(1.0f),
+    reverb(nullptr),
+    loadMicros(0),
+    decodeMicros(0),
+    ioWaitMicros(0) {
+
+    std::vector<std::pair<int, int>> keys;
+    std::vector<std::uint64_t> lengths;
+
+    for (const auto& [scanCode, range] : map) {
+        if (range.isEmpty() || scanCode < 0 || scanCode > 0xffff) {
+            continue;
+        }
+        auto found = std::find(sourceRanges.begin(), sourceRanges.end(), range);
+        keys.emplace_back(scanCode, (int) (found - sourceRanges.begin()));
+        if (found == sourceRanges.end()) {
+            sourceRanges.push_back(range);
+            lengths.push_back(range.length);
+        }
+    }
+
+    allocate(keys, lengths);
+}
+
+/*
+ * Lays out the tables and room for the samples of clips of the given
+ * lengths, with the keys pointing at the indexes of their clips.
+ */
+void SoundPack::allocate(const std::vector<std::pair<int, int>>& keys, const std::vector<std::uint64_t>& lengths) {
+    bool usedPages[PAGE_SIZE]{};
+    numberOfPages = 0;
+    for (const auto& key : keys) {
+        if (!usedPages[key.first >> 8]) {
+            usedPages[key.first >> 8] = true;
+            numberOfPages++;
+        }
+    }
+
+    numberOfClips = (int) lengths.size();
+
+    std::size_t pageIndexBytes = PAGE_SIZE * sizeof(std::uint16_t);
+    std::size_t pagesBytes = (std::size_t) numberOfPages * PAGE_SIZE * sizeof(std::uint16_t);
+    std::size_t clipBytes = numberOfClips * sizeof(std::uint64_t);
+    std::size_t loudnessBytes = numberOfClips * sizeof(ClipLoudness);
+    std::size_t statesBytes = numberOfClips * sizeof(std::atomic<std::uint8_t>);
+    tableBytes = alignUp(pageIndexBytes + pagesBytes + 2 * clipBytes + loudnessBytes + statesBytes);
+
+    samplesBytes = 0;
+    for (std::uint64_t length : lengths) {
+        samplesBytes += alignUp(length);
+    }
+
+    arenaSize = tableBytes + samplesBytes;
+    arena = static_cast<std::uint8_t*>(::operator new(arenaSize, std::align_val_t(ALIGNMENT)));
+    locateTables();
+
+    std::fill(pageIndex, pageIndex + PAGE_SIZE, NO_ENTRY);
+    std::fill(pages, pages + numberOfPages * PAGE_SIZE, NO_ENTRY);
+
+    std::uint64_t offset = 0;
+    for (int i = 0; i < numberOfClips; i++) {
+        const std::uint64_t length = lengths[i];
+        // Padding is silent so that SIMD loads past the end are harmless.
+        std::memset(samples + offset + length, 0, alignUp(length) - length);
+        clipOffsets[i] = offset;
+        clipLengths[i] = length;
+        new (&clipLoudness[i]) ClipLoudness();
+        new (&clipStates[i]) std::atomic<std::uint8_t>(CLIP_PENDING);
+        offset += alignUp(length);
+    }
+
+    std::uint16_t nextPage = 0;
+    for (const auto& [scanCode, clip] : keys) {
+        std::uint16_t& page = pageIndex[scanCode >> 8];
+        if (page == NO_ENTRY) {
+            page = nextPage++;
+        }
+        pages[page * PAGE_SIZE + (scanCode & 0xff)] = (std::uint16_t) clip;
+    }
+}
+
+void SoundPack::locateTables() {
+    clipOffsets = reinterpret_cast<std::uint64_t*>(arena);
+    clipLengths = clipOffsets + numberOfClips;
+    clipLoudness = reinterpret_cast<ClipLoudness*>(clipLengths + numberOfClips);
+    pageIndex = reinterpret_cast<std::uint16_t*>(clipLoudness + numberOfClips);
+    pages = pageIndex + PAGE_SIZE;
+    clipStates = reinterpret_cast<std::atomic<std::uint8_t>*>(pages + numberOfPages * PAGE_SIZE);
+    samples = (arenaSize > tableBytes) ? arena + tableBytes : nullptr;
+}
+
+/*
+ * The tables hold only plain values and atomics of bytes, which are
+ * copied as they are, as nothing else touches them meanwhile.
+ */
+void SoundPack::relocate(bool withSamples) {
+    std::uint8_t* previous = arena;
+    arenaSize = withSamples ? tableBytes + samplesBytes : tableBytes;
+    arena = static_cast<std::uint8_t*>(::operator new(arenaSize, std::align_val_t(ALIGNMENT)));
+    std::memcpy(arena, previous, tableBytes);
+    ::operator delete(previous, std::align_val_t(ALIGNMENT));
+    locateTables();
+}
+
+/*
+ * Checks whether the channels of 16-bit stereo clips differ by no more
+ * than the tolerance over all of them.
+ */
+bool SoundPack::isDualMono(const std::vector<SoundClip>& clips) {
+    if (numberOfChannels != 2 || bitsPerSample != 16) {
+        return false;
+    }
+
+    TRACE_ZONE("SoundPack::isDualMono");
+
+    double mid = 0.0;
+    double side = 0.0;
+    for (const auto& clip : clips) {
+        double clipMid = 0.0;
+        double clipSide = 0.0;
+        simd::stereoEnergy(reinterpret_cast<const std::int16_t*>(clip.data), clip.length / 4, clipMid, clipSide);
+        mid += clipMid;
+        side += clipSide;
+    }
+    return side <= mid * MONO_TOLERANCE;
+}
+
+/*
+ * Nothing is published yet, so the clips may move to a smaller arena.
+ * The clips decoded later are folded as they come, which the most pressed
+ * keys, decoded first, vouch for.
+ */
+bool SoundPack::foldDecodedClips(const std::vector<int>& decoded) {
+    if (clipChannels != numberOfChannels || decoded.empty()) {
+        return false;
+    }
+
+    std::vector<SoundClip> clips;
+    for (int index : decoded) {
+        clips.push_back(getClipAt(index));
+    }
+    if (!isDualMono(clips)) {
+        return false;
+    }
+
+    TRACE_ZONE("SoundPack::foldDecodedClips");
+
+    std::uint8_t* previous = arena;
+    const std::uint8_t* previousSamples = samples;
+    std::vector<std::uint64_t> previousOffsets(clipOffsets, clipOffsets + numberOfClips);
+
+    samplesBytes = 0;
+    for (int i = 0; i < numberOfClips; i++) {
+        samplesBytes += alignUp(clipLengths[i] / 2);
+    }
+    arenaSize = tableBytes + samplesBytes;
+    arena = static_cast<std::uint8_t*>(::operator new(arenaSize, std::align_val_t(ALIGNMENT)));
+    std::memcpy(arena, previous, tableBytes);
+    locateTables();
+
+    std::uint64_t offset = 0;
+    for (int i = 0; i < numberOfClips; i++) {
+        const std::uint64_t length = clipLengths[i] / 2;
+        std::memset(samples + offset + length, 0, alignUp(length) - length);
+        clipOffsets[i] = offset;
+        clipLengths[i] = length;
+        offset += alignUp(length);
+    }
+
+    for (int index : decoded) {
+        simd::foldToMono(
+            reinterpret_cast<const std::int16_t*>(previousSamples + previousOffsets[index]),
+            clipLengths[index] / sizeof(std::int16_t),
+            reinterpret_cast<std::int16_t*>(getClipBuffer(index)));
+    }
+
+    ::operator delete(previous, std::align_val_t(ALIGNMENT));
+    clipChannels = 1;
+    return true;
+}
+
+/*
+ * Clips of folded packs are decoded with both channels first.
+ */
+bool SoundPack::decodeClip(SoundResourceReader* reader, int index, std::vector<std::uint8_t>& scratch) {
+    const SampleRange& range = sourceRanges[index];
+    if (clipChannels == numberOfChannels) {
+        return reader->readRange(range.offset, range.length, getClipBuffer(index));
+    }
+
+    scratch.resize(range.length);
+    if (!reader->readRange(range.offset, range.length, scratch.data())) {
+        return false;
+    }
+    if (!isDualMono({SoundClip{scratch.data(), range.length}})) {
+        std::cerr << "Folding clip " << index << " whose channels differ" << std::endl;
+    }
+    simd::foldToMono(
+        reinterpret_cast<const std::int16_t*>(scratch.data()),
+        clipLengths[index] / sizeof(std::int16_t),
+        reinterpret_cast<std::int16_t*>(getClipBuffer(index)));
+    return true;
+}
+
+/*
+ * Measures the clips on as many threads as their size is worth,
+ * each thread taking the next clip not analyzed yet.
+ */
+void SoundPack::analyzeClips() {
+    TRACE_ZONE("SoundPack::analyzeClips");
+
+    std::size_t samplesBytes = arenaSize - (samples - arena);
+    int cores = (int) std::thread::hardware_concurrency();
+    int threads = (int) std::max<std::size_t>(1, std::min<std::size_t>({
+        (std::size_t) std::max(1, cores),
+        samplesBytes / MIN_ANALYSIS_BYTES,
+        (std::size_t) numberOfClips
+    }));
+
+    std::atomic<int> nextClip(0);
+    auto analyzeNext = [&]() {
+        for (int i = nextClip++; i < numberOfClips; i = nextClip++) {
+            analyzeClip(i);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (int n = 1; n < threads; n++) {
+        workers.emplace_back(analyzeNext);
+    }
+    // The calling thread takes its share too.
+    analyzeNext();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void SoundPack::analyzeClip(int index) {
+    ClipLoudness loudness = ClipLoudness::analyze(
+        reinterpret_cast<const std::int16_t*>(samples + clipOffsets[index]),
+        clipLengths[index] / sizeof(std::int16_t),
+        clipChannels,
+        samplingRate);
+    applyNormalizedGain(loudness);
+    clipLoudness[index] = loudness;
+}
+
+/*
+ * The first clip published stands in for those still pending.
+ */
+void SoundPack::publishClip(int index) {
+    clipStates[index].store(CLIP_READY, std::memory_order_release);
+
+    std::uint16_t none = NO_ENTRY;
+    fallbackClip.compare_exchange_strong(none, (std::uint16_t) index, std::memory_order_release);
+}
+
+void SoundPack::streamClips(SoundResourceReader* reader, const std::vector<int>& order) {
+    waitForClips();
+    stopStreaming = false;
+    streamer = std::thread(&SoundPack::stream, this, reader, order);
+}
+
+void SoundPack::waitForClips() {
+    if (streamer.joinable()) {
+        streamer.join();
+    }
+}
+
+void SoundPack::stream(SoundResourceReader* reader, std::vector<int> order) {
+    TRACE_ZONE("SoundPack::stream");
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::uint8_t> scratch;
+    for (int index : order) {
+        if (stopStreaming.load(std::memory_order_relaxed)) {
+            break;
         }
-        for (const auto* clip : distinct) {
-            delete clip;
+        if (isClipReady(index)) {
+            continue;
         }
-        delete map;
-        map = nullptr;
+        if (!decodeClip(reader, index, scratch)) {
+            // The key keeps sounding as the fallback.
+            std::cerr << "Cannot decode clip " << index << std::endl;
+            continue;
+        }
+        analyzeClip(index);
+        publishClip(index);
     }
 
-    if (resource != nullptr) {
-        delete resource;
-        resource = nullptr;
+    delete reader;
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    streamMicros.store(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count(), std::memory_order_release);
+}
+
+/*
+ * Aims at the median rather than the mean, so that a few odd clips
+ * do not move all the others. Gains never make a clip clip.
+ * Clips not analyzed yet are left out and get their gains once they
+ * are, so this is called before any clip is published.
+ */
+void SoundPack::normalize() {
+    std::vector<float> levels;
+    for (int i = 0; i < numberOfClips; i++) {
+        if (clipLoudness[i].rms > 0.0f) {
+            levels.push_back(clipLoudness[i].rms);
+        }
+    }
+    if (levels.empty()) {
+        return;
+    }
+
+    std::nth_element(levels.begin(), levels.begin() + levels.size() / 2, levels.end());
+    normalizedLevel = levels[levels.size() / 2];
+
+    for (int i = 0; i < numberOfClips; i++) {
+        applyNormalizedGain(clipLoudness[i]);
+    }
+}
+
+void SoundPack::applyNormalizedGain(ClipLoudness& loudness) {
+    if (normalizedLevel <= 0.0f || loudness.rms <= 0.0f) {
+        return;
+    }
+    float gain = std::max(MIN_CLIP_GAIN, std::min(MAX_CLIP_GAIN, normalizedLevel / loudness.rms));
+    if (loudness.peak > 0.0f) {
+        gain = std::min(gain, 1.0f / loudness.peak);
+    }
+    loudness.gain = gain;
+}
+
+/*
+ * Pending clips are left alone, as they are being written to
+ * and fault in as they are decoded anyway.
+ */
+void SoundPack::prime() {
+    const std::size_t pageSize = 4096;
+    volatile std::uint8_t sink = 0;
+    for (std::size_t offset = 0; offset < tableBytes; offset += pageSize) {
+        sink = sink + arena[offset];
+    }
+    for (int i = 0; i < numberOfClips && !isReleased(); i++) {
+        if (!isClipReady(i)) {
+            continue;
+        }
+        const std::uint8_t* clip = samples + clipOffsets[i];
+        for (std::uint64_t offset = 0; offset < clipLengths[i]; offset += pageSize) {
+            sink = sink + clip[offset];
+        }
     }
 }
 
-SoundClip* SoundPack::getClip(int scanCode) {
-    return (*map)[scanCode];
+bool SoundPack::releaseSamples() {
+    if (isReleased() || samplesBytes == 0) {
+        return false;
+    }
+    // Clips still streaming in are being written to.
+    if (streamer.joinable() && getStreamMicros() == 0) {
+        return false;
+    }
+    waitForClips();
+
+    TRACE_ZONE("SoundPack::releaseSamples");
+    std::vector<std::uint8_t> compressed;
+    if (!SampleCompressor::compress(reinterpret_cast<const std::int16_t*>(samples),
+            samplesBytes / sizeof(std::int16_t), clipChannels, compressed)) {
+        return false;
+    }
+    compactSamples = std::move(compressed);
+    relocate(false);
+    return true;
+}
+
+bool SoundPack::rematerialize() {
+    if (!isReleased()) {
+        return true;
+    }
+
+    TRACE_ZONE("SoundPack::rematerialize");
+    relocate(true);
+    if (!SampleCompressor::expand(compactSamples, reinterpret_cast<std::int16_t*>(samples),
+            samplesBytes / sizeof(std::int16_t), clipChannels)) {
+        // Silence rather than noise; the clips stay in place.
+        std::memset(samples, 0, samplesBytes);
+        std::cerr << "Cannot restore released samples" << std::endl;
+    }
+    compactSamples.clear();
+    compactSamples.shrink_to_fit();
+    return true;
+}
+
+void SoundPack::setReverb(ConvolutionReverb* reverb) {
+    if (this->reverb != nullptr) {
+        delete this->reverb;
+    }
+    this->reverb = reverb;
+}
+
+SoundPack::~SoundPack() {
+    stopStreaming = true;
+    waitForClips();
+
+    setReverb(nullptr);
+
+    if (arena != nullptr) {
+        ::operator delete(arena, std::align_val_t(ALIGNMENT));
+        arena = nullptr;
+    }
 }
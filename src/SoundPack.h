@@ -16,29 +16,292 @@
 #pragma once
 
 #include "SoundClip.h"
+#include "SoundResource.h"
+#include "ClipLoudness.h"
+#include "Envelope.h"
+#include "Equalizer.h"
 
-class SoundResource;
+class SoundResourceReader;
+class ConvolutionReverb;
 
+/*
+ * Clips of a sound pack, laid out in a single allocation.
+ *
+ * The arena holds a two level table from scan codes to clip indexes,
+ * the offsets, lengths and loudness of the clips as separate arrays,
+ * and the samples of the clips, each aligned for SIMD loads.
+ *
+ * Stereo packs whose channels carry the same signal are stored as mono,
+ * and upmixed by the voices.
+ *
+ * Packs may also be laid out before their samples are decoded, each clip
+ * being published once it is. Keys whose clips are still pending sound
+ * as the clip published first. Such packs are folded to mono when the
+ * clips decoded before any is published are.
+ *
+ * While nothing plays for long, the samples may be released, leaving only
+ * the tables and a compressed copy of the samples in memory.
+ */
 class SoundPack {
 public:
 
-    using SoundClipMap = std::unordered_map<int, SoundClip*>;
+    using SoundClipMap = std::unordered_map<int, SoundClip>;
+    using SampleRangeMap = std::unordered_map<int, SampleRange>;
+
+    static const int ALIGNMENT = 64;
 
 private:
 
-    SoundResource* resource;
-    SoundClipMap* map;
+    static constexpr std::uint16_t NO_ENTRY = 0xffff;
+    static constexpr std::uint8_t CLIP_PENDING = 0;
+    static constexpr std::uint8_t CLIP_READY = 1;
+    static const int PAGE_SIZE = 256;
+    // Clips are analyzed on several threads only with this many bytes per thread.
+    static const std::size_t MIN_ANALYSIS_BYTES = 1 << 20;
+    // Range of the gains applied by normalization.
+    static constexpr float MIN_CLIP_GAIN = 0.25f;
+    static constexpr float MAX_CLIP_GAIN = 4.0f;
+    // Energy of the difference between the channels, relative to their sum,
+    // below which stereo clips are folded to mono.
+    static constexpr double MONO_TOLERANCE = 1e-4;
+
+    const int numberOfChannels;
+    const int samplingRate;
+    const int bitsPerSample;
+    int clipChannels;
+
+    std::uint8_t* arena;
+    std::size_t arenaSize;
+    int numberOfPages;
+    // Bytes of the tables and of the samples in the arena.
+    std::size_t tableBytes;
+    std::size_t samplesBytes;
+    // Compressed samples while released, empty otherwise.
+    std::vector<std::uint8_t> compactSamples;
+
+    // Page of each high byte of scan codes.
+    std::uint16_t* pageIndex;
+    // Clip of each low byte of scan codes.
+    std::uint16_t* pages;
+    std::uint64_t* clipOffsets;
+    std::uint64_t* clipLengths;
+    ClipLoudness* clipLoudness;
+    std::atomic<std::uint8_t>* clipStates;
+    std::uint8_t* samples;
+    int numberOfClips;
+
+    // Clip played for keys whose clips are pending.
+    std::atomic<std::uint16_t> fallbackClip;
+    // Where the clips come from in the resource, when decoded after the layout.
+    std::vector<SampleRange> sourceRanges;
+    // Target level of normalization, zero if not normalized.
+    float normalizedLevel;
+
+    std::thread streamer;
+    std::atomic<bool> stopStreaming;
+    std::atomic<std::uint64_t> streamMicros;
+
+    Envelope envelope;
+    // Gain bringing the loudness of the pack in line with others.
+    float trim;
+    // Tonal correction of the recording.
+    std::vector<EqualizerBand> equalizer;
+    // Room the pack is heard in, if any.
+    ConvolutionReverb* reverb;
+
+    std::uint64_t loadMicros;
+    std::uint64_t decodeMicros;
+    std::uint64_t ioWaitMicros;
 
 public:
 
+    SoundPack(SoundResource* resource, const SoundClipMap& map, const Envelope& envelope);
+
+    // Lays out the clips of the ranges of a resource with all of them pending.
+    SoundPack(int numberOfChannels, int samplingRate, int bitsPerSample, const SampleRangeMap& map, const Envelope& envelope);
 
-    SoundPack(SoundResource* resource, SoundClipMap* map);
     virtual ~SoundPack();
 
-    SoundResource* getResource() {
-        return resource;
+    // Channels of the output, which may exceed the channels of the clips.
+    int getNumberOfChannels() {
+        return numberOfChannels;
     }
 
-    SoundClip* getClip(int scanCode);
-};
+    int getClipChannels() {
+        return clipChannels;
+    }
+
+    int getSamplingRate() {
+        return samplingRate;
+    }
+
+    int getBitsPerSample() {
+        return bitsPerSample;
+    }
 
+    const Envelope* getEnvelope() {
+        return &envelope;
+    }
+
+    float getTrim() {
+        return trim;
+    }
+
+    void setTrim(float trim) {
+        this->trim = trim;
+    }
+
+    const std::vector<EqualizerBand>& getEqualizer() {
+        return equalizer;
+    }
+
+    void setEqualizer(const std::vector<EqualizerBand>& equalizer) {
+        this->equalizer = equalizer;
+    }
+
+    ConvolutionReverb* getReverb() {
+        return reverb;
+    }
+
+    // Takes ownership of the reverb.
+    void setReverb(ConvolutionReverb* reverb);
+
+    int getNumberOfClips() {
+        return numberOfClips;
+    }
+
+    SoundClip getClipAt(int index) {
+        return SoundClip{samples + clipOffsets[index], clipLengths[index], &clipLoudness[index]};
+    }
+
+    const ClipLoudness& getLoudnessAt(int index) {
+        return clipLoudness[index];
+    }
+
+    // Sets the gain of every clip analyzed so far to match their median
+    // loudness, and of the clips analyzed later.
+    void normalize();
+
+    // Returns an empty clip if the key has no sound.
+    SoundClip getClip(int scanCode) {
+        int index = getClipIndex(scanCode);
+        if (index < 0) {
+            return SoundClip{};
+        }
+        if (clipStates[index].load(std::memory_order_acquire) != CLIP_READY) {
+            index = fallbackClip.load(std::memory_order_acquire);
+            if (index == NO_ENTRY) {
+                return SoundClip{};
+            }
+        }
+        return getClipAt(index);
+    }
+
+    // Returns -1 if the key has no sound.
+    int getClipIndex(int scanCode) {
+        if (scanCode < 0 || scanCode > 0xffff) {
+            return -1;
+        }
+        std::uint16_t page = pageIndex[scanCode >> 8];
+        if (page == NO_ENTRY) {
+            return -1;
+        }
+        std::uint16_t index = pages[page * PAGE_SIZE + (scanCode & 0xff)];
+        return (index == NO_ENTRY) ? -1 : index;
+    }
+
+    bool isClipReady(int index) {
+        return clipStates[index].load(std::memory_order_acquire) == CLIP_READY;
+    }
+
+    // Range of the resource to decode into a pending clip.
+    const SampleRange& getSourceRange(int index) {
+        return sourceRanges[index];
+    }
+
+    // Where the samples of a pending clip are decoded to.
+    std::uint8_t* getClipBuffer(int index) {
+        return samples + clipOffsets[index];
+    }
+
+    // Stores the clips as mono if the given clips, decoded but not yet
+    // published, carry the same signal in both channels.
+    bool foldDecodedClips(const std::vector<int>& decoded);
+
+    // Measures a clip once its samples are decoded.
+    void analyzeClip(int index);
+
+    // Makes an analyzed clip audible.
+    void publishClip(int index);
+
+    // Decodes the pending clips in the given order on a thread of its own,
+    // which owns the reader and stops when the pack is deleted.
+    void streamClips(SoundResourceReader* reader, const std::vector<int>& order);
+
+    // Blocks until the streaming thread is done.
+    void waitForClips();
+
+    // Time taken to stream in the clips, zero until done.
+    std::uint64_t getStreamMicros() {
+        return streamMicros.load(std::memory_order_acquire);
+    }
+
+    std::uint64_t getLoadMicros() {
+        return loadMicros;
+    }
+
+    // Decoding before the pack was returned, without waiting for the file.
+    std::uint64_t getDecodeMicros() {
+        return decodeMicros;
+    }
+
+    std::uint64_t getIoWaitMicros() {
+        return ioWaitMicros;
+    }
+
+    void setLoadTimes(std::uint64_t loadMicros, std::uint64_t decodeMicros, std::uint64_t ioWaitMicros) {
+        this->loadMicros = loadMicros;
+        this->decodeMicros = decodeMicros;
+        this->ioWaitMicros = ioWaitMicros;
+    }
+
+    // Touches every page of the tables and published clips so that none faults while playing.
+    void prime();
+
+    // Compresses the samples and releases them. Only while no clip is
+    // playing or streaming in, and clips must not be taken until restored.
+    bool releaseSamples();
+
+    // Brings back the samples released, moving the clips.
+    bool rematerialize();
+
+    bool isReleased() {
+        return !compactSamples.empty();
+    }
+
+    // Bytes held by the sound pack.
+    std::size_t getResidentBytes() {
+        return arenaSize + compactSamples.size();
+    }
+
+private:
+
+    void allocate(const std::vector<std::pair<int, int>>& keys, const std::vector<std::uint64_t>& lengths);
+
+    // Moves the tables to a new arena, with room for the samples or without.
+    void relocate(bool withSamples);
+
+    // Points the tables into the arena.
+    void locateTables();
+
+    bool isDualMono(const std::vector<SoundClip>& clips);
+
+    // Decodes a pending clip, folding it if the pack is folded.
+    bool decodeClip(SoundResourceReader* reader, int index, std::vector<std::uint8_t>& scratch);
+
+    void analyzeClips();
+
+    void applyNormalizedGain(ClipLoudness& loudness);
+
+    void stream(SoundResourceReader* reader, std::vector<int> order);
+};
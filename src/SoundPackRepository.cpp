@@ -17,39 +17,328 @@
 #include "SoundResource.h"
 #include "SoundResourceReader.h"
 #include "SoundPack.h"
+#include "ZipArchive.h"
+#include "KeyUsage.h"
+#include "ConvolutionReverb.h"
+#include "Trace.h"
 
 namespace fs = std::filesystem;
 using json = nlohmann::json;
 
 using SoundClipMap = SoundPack::SoundClipMap;
 
+using Clock = std::chrono::steady_clock;
+
+static std::uint64_t microsSince(Clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+}
+
+static bool endsWith(const std::string& text, const std::string& suffix)
+{
+    return text.size() >= suffix.size()
+        && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static const char CONFIG_NAME[] = "config.json";
+static const wchar_t ARCHIVE_EXTENSION[] = L".zip";
+
+// Level of the reverberation relative to the dry sound, in decibels.
+static const float DEFAULT_WET_DECIBELS = -18.0f;
+
 class SoundPackLoader {
 public:
 
+    // Decodes the clips in the order of the key usage if there is one.
+    SoundPackLoader(const KeyUsage* keyUsage);
+
     SoundPack* load(const fs::path& dir);
 
+    // Loads the pack whose files are under the prefix within the archive,
+    // which is kept for as long as clips are decoded from it.
+    SoundPack* load(std::unique_ptr<ZipArchive> archive, const std::string& prefix);
+
 private:
 
+    using KeyTimes = std::unordered_map<int, std::pair<int, int>>;
+
+    // Share of the key presses seen so far whose clips are decoded before
+    // the pack is returned, the others streaming in afterwards.
+    static constexpr double FIRST_CLIPS_COVERAGE = 0.9;
+    static constexpr size_t MIN_FIRST_CLIPS = 4;
+    static constexpr size_t MAX_FIRST_CLIPS = 16;
+
+    const KeyUsage* keyUsage;
+    std::uint64_t decodeMicros = 0;
+    std::uint64_t ioWaitMicros = 0;
+    // Impulse response of the reverberation, if the pack has one.
+    std::unique_ptr<SoundResource> impulse;
+
+    SoundPack* build(json& config, std::unique_ptr<SoundResourceReader> reader, Clock::time_point start);
+
+    SoundPack* buildProgressively(
+        json& config,
+        std::unique_ptr<SoundResourceReader> reader,
+        const SoundResourceReader::Format& format,
+        Clock::time_point start);
+
+    std::vector<int> orderClips(SoundPack& soundPack, size_t& firstClips);
+
     std::string getSound(json& config);
 
-    SoundResource* loadWaveResource(const fs::path& path);
+    SoundResource* readResource(SoundResourceReader* reader, bool timed = true);
+
+    KeyTimes readKeys(json& config);
+
+    SoundClipMap buildKeyMap(json& config, SoundResource* resource);
+
+    Envelope buildEnvelope(json& config, int samplingRate);
+
+    int getMillis(json& object, const char* name, int defaultValue);
+
+    float getTrim(json& config);
+
+    std::vector<EqualizerBand> getEqualizer(json& config);
+
+    std::string getImpulse(json& config);
+
+    float getWet(json& config);
 
-    SoundClipMap* buildKeyMap(json& config, SoundResource* resource);
+    void attachReverb(SoundPack& soundPack, json& config);
 
-    SoundClipMap* modifyKeyMap(SoundClipMap& map);
+    bool getNormalize(json& config);
+
+    void modifyKeyMap(KeyTimes& map);
 };
 
+SoundPackLoader::SoundPackLoader(const KeyUsage* keyUsage)
+:   keyUsage(keyUsage)
+{
+}
+
 SoundPack* SoundPackLoader::load(const fs::path& dir)
 {
+    TRACE_ZONE("SoundPackLoader::load");
+    auto start = Clock::now();
+
     fs::path configPath = dir / L"config.json";
 
-    std::ifstream stream(configPath);
-    json config = json::parse(stream);
+    json config;
+    {
+        TRACE_ZONE("json::parse");
+        std::ifstream stream(configPath);
+        config = json::parse(stream);
+    }
+
+    std::string impulseName = getImpulse(config);
+    if (!impulseName.empty()) {
+        std::unique_ptr<SoundResourceReader> impulseReader(SoundResourceReader::fromFile(dir / impulseName));
+        impulse.reset(readResource(impulseReader.get(), false));
+        if (!impulse) {
+            std::cerr << "Cannot read impulse response: " << impulseName << std::endl;
+        }
+    }
+
+    std::unique_ptr<SoundResourceReader> reader(SoundResourceReader::fromFile(dir / getSound(config)));
+    return build(config, std::move(reader), start);
+}
+
+SoundPack* SoundPackLoader::load(std::unique_ptr<ZipArchive> archive, const std::string& prefix)
+{
+    TRACE_ZONE("SoundPackLoader::load");
+    auto start = Clock::now();
+
+    const ZipArchive::Entry* configEntry = archive->find(prefix + CONFIG_NAME);
+    if (configEntry == nullptr) {
+        return nullptr;
+    }
+
+    json config;
+    {
+        TRACE_ZONE("json::parse");
+        std::vector<std::uint8_t> buffer;
+        const std::uint8_t* text = archive->read(*configEntry, buffer);
+        if (text == nullptr) {
+            return nullptr;
+        }
+        config = json::parse(text, text + configEntry->size);
+    }
+
+    std::string impulseName = getImpulse(config);
+    const ZipArchive::Entry* impulseEntry = impulseName.empty() ? nullptr : archive->find(prefix + impulseName);
+    if (impulseEntry != nullptr) {
+        std::vector<std::uint8_t> buffer;
+        const std::uint8_t* data = archive->read(*impulseEntry, buffer);
+        if (data != nullptr) {
+            std::unique_ptr<SoundResourceReader> impulseReader(SoundResourceReader::fromMemory(data, impulseEntry->size, impulseName));
+            impulse.reset(readResource(impulseReader.get(), false));
+        }
+    }
+    if (!impulseName.empty() && !impulse) {
+        std::cerr << "Cannot read impulse response: " << impulseName << std::endl;
+    }
+
+    std::string sound = getSound(config);
+    const ZipArchive::Entry* soundEntry = archive->find(prefix + sound);
+    if (soundEntry == nullptr) {
+        return nullptr;
+    }
+
+    // Stored entries are decoded straight from the mapped archive.
+    std::vector<std::uint8_t> buffer;
+    const std::uint8_t* data = archive->read(*soundEntry, buffer);
+    if (data == nullptr) {
+        return nullptr;
+    }
+
+    std::unique_ptr<SoundResourceReader> reader(SoundResourceReader::fromMemory(data, soundEntry->size, sound));
+    if (reader) {
+        reader->keepSource(archive.release(), std::move(buffer));
+    }
+    return build(config, std::move(reader), start);
+}
+
+SoundPack* SoundPackLoader::build(json& config, std::unique_ptr<SoundResourceReader> reader, Clock::time_point start)
+{
+    SoundResourceReader::Format format{};
+    if (keyUsage != nullptr && reader && reader->open(format)) {
+        return buildProgressively(config, std::move(reader), format, start);
+    }
+
+    // The sound pack copies what it needs from the decoded resource.
+    std::unique_ptr<SoundResource> resource(readResource(reader.get()));
+    if (!resource) {
+        return nullptr;
+    }
+
+    auto map = buildKeyMap(config, resource.get());
+    auto envelope = buildEnvelope(config, resource->getSamplingRate());
+
+    TRACE_ZONE("SoundPack::SoundPack");
+    auto soundPack = new SoundPack(resource.get(), map, envelope);
+    soundPack->setTrim(getTrim(config));
+    soundPack->setEqualizer(getEqualizer(config));
+    if (getNormalize(config)) {
+        soundPack->normalize();
+    }
+    attachReverb(*soundPack, config);
+    soundPack->setLoadTimes(microsSince(start), decodeMicros, ioWaitMicros);
+    return soundPack;
+}
+
+/*
+ * Decodes the clips of the keys pressed most before returning the pack,
+ * which streams in the others on a thread of its own.
+ */
+SoundPack* SoundPackLoader::buildProgressively(
+    json& config,
+    std::unique_ptr<SoundResourceReader> reader,
+    const SoundResourceReader::Format& format,
+    Clock::time_point start)
+{
+    TRACE_ZONE("SoundPackLoader::buildProgressively");
+
+    const int blockAlign = format.numberOfChannels * format.bitsPerSample / 8;
+    SoundPack::SampleRangeMap map;
+    for (const auto& [scanCode, times] : readKeys(config)) {
+        SampleRange range = SoundResource::getSliceRange(format.samplingRate, blockAlign, format.length, times.first, times.second);
+        if (!range.isEmpty()) {
+            map.insert(std::make_pair(scanCode, range));
+        }
+    }
 
-    auto resource = loadWaveResource(dir / getSound(config));
-    auto map = buildKeyMap(config, resource);
+    std::unique_ptr<SoundPack> soundPack(new SoundPack(
+        format.numberOfChannels,
+        format.samplingRate,
+        format.bitsPerSample,
+        map,
+        buildEnvelope(config, format.samplingRate)));
+    soundPack->setTrim(getTrim(config));
+    soundPack->setEqualizer(getEqualizer(config));
+    attachReverb(*soundPack, config);
+
+    size_t firstClips = 0;
+    std::vector<int> order = orderClips(*soundPack, firstClips);
+
+    auto decodeStart = Clock::now();
+    const std::uint64_t waitBefore = reader->getWaitMicros();
+    for (size_t i = 0; i < firstClips; i++) {
+        int index = order[i];
+        const SampleRange& range = soundPack->getSourceRange(index);
+        if (!reader->readRange(range.offset, range.length, soundPack->getClipBuffer(index))) {
+            return nullptr;
+        }
+    }
+    std::uint64_t elapsed = microsSince(decodeStart);
+    ioWaitMicros = std::min(reader->getWaitMicros() - waitBefore, elapsed);
+    decodeMicros = elapsed - ioWaitMicros;
+
+    // The clips streamed in later follow the first clips.
+    std::vector<int> decoded(order.begin(), order.begin() + firstClips);
+    soundPack->foldDecodedClips(decoded);
+    for (int index : decoded) {
+        soundPack->analyzeClip(index);
+    }
+
+    // Levels are taken from the first clips, the others are brought in line as they come.
+    if (getNormalize(config)) {
+        soundPack->normalize();
+    }
+    for (size_t i = 0; i < firstClips; i++) {
+        soundPack->publishClip(order[i]);
+    }
+
+    soundPack->setLoadTimes(microsSince(start), decodeMicros, ioWaitMicros);
+    soundPack->streamClips(reader.release(), std::vector<int>(order.begin() + firstClips, order.end()));
+    return soundPack.release();
+}
+
+/*
+ * Orders the clips by the number of presses of their keys, and then by
+ * how common their keys are in text. The first clips cover most of the
+ * key presses seen so far.
+ */
+std::vector<int> SoundPackLoader::orderClips(SoundPack& soundPack, size_t& firstClips)
+{
+    const int numberOfClips = soundPack.getNumberOfClips();
+    std::vector<std::uint64_t> presses(numberOfClips, 0);
+    std::vector<int> ranks(numberOfClips, KeyUsage::COMMON_KEY_COUNT);
+
+    std::uint64_t total = 0;
+    for (const auto& [scanCode, count] : keyUsage->getCounts()) {
+        int index = soundPack.getClipIndex(scanCode);
+        if (index >= 0) {
+            presses[index] += count;
+            total += count;
+        }
+    }
+
+    for (int rank = 0; rank < KeyUsage::COMMON_KEY_COUNT; rank++) {
+        int index = soundPack.getClipIndex(KeyUsage::COMMON_KEYS[rank]);
+        if (index >= 0) {
+            ranks[index] = std::min(ranks[index], rank);
+        }
+    }
+
+    std::vector<int> order(numberOfClips);
+    for (int i = 0; i < numberOfClips; i++) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        if (presses[a] != presses[b]) {
+            return presses[a] > presses[b];
+        }
+        return ranks[a] < ranks[b];
+    });
 
-    return new SoundPack(resource, map);
+    std::uint64_t covered = 0;
+    size_t count = 0;
+    while (count < order.size() && count < MAX_FIRST_CLIPS
+            && (count < MIN_FIRST_CLIPS || covered < total * FIRST_CLIPS_COVERAGE)) {
+        covered += presses[order[count++]];
+    }
+    firstClips = count;
+    return order;
 }
 
 std::string SoundPackLoader::getSound(json& config)
@@ -66,18 +355,143 @@ std::string SoundPackLoader::getSound(json& config)
     return "sound.wav";
 }
 
-SoundResource* SoundPackLoader::loadWaveResource(const fs::path& path)
+SoundResource* SoundPackLoader::readResource(SoundResourceReader* reader, bool timed)
 {
-    std::unique_ptr<SoundResourceReader> reader(SoundResourceReader::fromFile(path.c_str()));
-    if (!reader) {
+    if (reader == nullptr) {
         return nullptr;
     }
-    return reader->read();
+
+    auto start = Clock::now();
+    SoundResource* resource = reader->read();
+    if (timed) {
+        // Decoders waiting for the file side by side count once.
+        std::uint64_t elapsed = microsSince(start);
+        ioWaitMicros = std::min(reader->getWaitMicros(), elapsed);
+        decodeMicros = elapsed - ioWaitMicros;
+    }
+    return resource;
 }
 
-SoundClipMap* SoundPackLoader::buildKeyMap(json& config, SoundResource* resource)
+/*
+ * Reads the optional loudness trim of the pack in decibels, e.g. "trim": -3.0
+ */
+float SoundPackLoader::getTrim(json& config)
 {
-    auto map = new SoundClipMap();
+    if (config.contains("trim")) {
+        auto property = config.at("trim");
+        if (property.is_number()) {
+            return std::pow(10.0f, property.get<float>() / 20.0f);
+        }
+    }
+    return 1.0f;
+}
+
+/*
+ * Reads the optional bands of the equalizer, applied in order, e.g.
+ * "eq": [ { "type": "lowshelf", "frequency": 150, "gain": -4.0, "q": 0.7 } ]
+ */
+std::vector<EqualizerBand> SoundPackLoader::getEqualizer(json& config)
+{
+    static const std::pair<const char*, FilterType> types[] = {
+        {"peak", FilterType::PEAK},
+        {"lowshelf", FilterType::LOW_SHELF},
+        {"highshelf", FilterType::HIGH_SHELF},
+        {"lowpass", FilterType::LOW_PASS},
+        {"highpass", FilterType::HIGH_PASS}
+    };
+
+    std::vector<EqualizerBand> bands;
+    if (!config.contains("eq") || !config.at("eq").is_array()) {
+        return bands;
+    }
+    for (auto& object : config.at("eq")) {
+        if (!object.is_object() || !object.contains("frequency") || !object.at("frequency").is_number()) {
+            std::cerr << "Ignoring equalizer band without a frequency" << std::endl;
+            continue;
+        }
+        EqualizerBand band;
+        if (object.contains("type") && object.at("type").is_string()) {
+            std::string name = object.at("type").get<std::string>();
+            auto type = std::find_if(std::begin(types), std::end(types), [&](const auto& type) {
+                return name == type.first;
+            });
+            if (type == std::end(types)) {
+                std::cerr << "Ignoring equalizer band of unknown type: " << name << std::endl;
+                continue;
+            }
+            band.type = type->second;
+        }
+        band.frequency = object.at("frequency").get<float>();
+        if (object.contains("gain") && object.at("gain").is_number()) {
+            band.gain = object.at("gain").get<float>();
+        }
+        if (object.contains("q") && object.at("q").is_number()) {
+            band.q = object.at("q").get<float>();
+        }
+        bands.push_back(band);
+    }
+    return bands;
+}
+
+/*
+ * Reads the optional impulse response of the room the keyboard is heard in,
+ * a sound file of the pack, e.g. "reverb": { "impulse": "room.wav", "wet": -18.0 }
+ */
+std::string SoundPackLoader::getImpulse(json& config)
+{
+    if (config.contains("reverb")) {
+        auto reverb = config.at("reverb");
+        if (reverb.is_object() && reverb.contains("impulse") && reverb.at("impulse").is_string()) {
+            return reverb.at("impulse").get<std::string>();
+        }
+    }
+    return std::string();
+}
+
+// Level of the reverberation in decibels.
+float SoundPackLoader::getWet(json& config)
+{
+    float decibels = DEFAULT_WET_DECIBELS;
+    auto reverb = config.at("reverb");
+    if (reverb.contains("wet") && reverb.at("wet").is_number()) {
+        decibels = reverb.at("wet").get<float>();
+    }
+    return std::pow(10.0f, decibels / 20.0f);
+}
+
+void SoundPackLoader::attachReverb(SoundPack& soundPack, json& config)
+{
+    if (!impulse) {
+        return;
+    }
+    TRACE_ZONE("SoundPackLoader::attachReverb");
+    soundPack.setReverb(ConvolutionReverb::create(
+        impulse.get(),
+        soundPack.getNumberOfChannels(),
+        soundPack.getSamplingRate(),
+        getWet(config)));
+}
+
+/*
+ * Reads whether the levels of the clips are evened out, e.g. "normalize": true
+ */
+bool SoundPackLoader::getNormalize(json& config)
+{
+    if (config.contains("normalize")) {
+        auto property = config.at("normalize");
+        if (property.is_boolean()) {
+            return property.get<bool>();
+        }
+    }
+    return false;
+}
+
+/*
+ * Reads the start and duration of the clip of each key in milliseconds.
+ */
+SoundPackLoader::KeyTimes SoundPackLoader::readKeys(json& config)
+{
+    KeyTimes map;
 
     if (!config.contains("keys")) {
         return map;
@@ -94,38 +508,93 @@ SoundClipMap* SoundPackLoader::buildKeyMap(json& config, SoundResource* resource
             if (value.is_array() && value.size() == 2) {
                 int start = value.at(0);
                 int duration = value.at(1);
-                auto clip = resource->slice(start, duration);
-                if (clip != nullptr) {
-                   map->insert(std::make_pair(scanCode, clip));
-                }
+                map.insert(std::make_pair(scanCode, std::make_pair(start, duration)));
             }
         } catch (const std::exception& e) {
         }
     }
 
-    return modifyKeyMap(*map);
+    modifyKeyMap(map);
+    return map;
+}
+
+SoundClipMap SoundPackLoader::buildKeyMap(json& config, SoundResource* resource)
+{
+    SoundClipMap map;
+    for (const auto& [scanCode, times] : readKeys(config)) {
+        auto clip = resource->slice(times.first, times.second);
+        if (!clip.isEmpty()) {
+           map.insert(std::make_pair(scanCode, clip));
+        }
+    }
+    return map;
+}
+
+/*
+ * Reads the optional fade lengths of the clips, e.g.
+ * "envelope": { "attack": 1, "release": 5 }
+ */
+Envelope SoundPackLoader::buildEnvelope(json& config, int samplingRate)
+{
+    int attack = Envelope::DEFAULT_ATTACK_MILLIS;
+    int release = Envelope::DEFAULT_RELEASE_MILLIS;
+
+    if (config.contains("envelope")) {
+        auto envelope = config.at("envelope");
+        if (envelope.is_object()) {
+            attack = getMillis(envelope, "attack", attack);
+            release = getMillis(envelope, "release", release);
+        }
+    }
+
+    return Envelope(samplingRate, attack, release);
 }
 
-SoundClipMap* SoundPackLoader::modifyKeyMap(SoundClipMap& map)
+int SoundPackLoader::getMillis(json& object, const char* name, int defaultValue)
 {
-    map[0xe01d] = map[3613]; // right ctrl
-    map[0xe037] = map[3639]; // print screen
-    map[0xe038] = map[3640]; // right alt
-    map[0xe047] = map[3655]; // home
-    map[0xe049] = map[3657]; // page up
-    map[0xe04f] = map[3663]; // end
-    map[0xe051] = map[3665]; // page down
-    map[0xe052] = map[3666]; // insert
-    map[0xe053] = map[3667]; // delete
-    map[0xe05b] = map[3675]; // left win key
-    map[0xe05c] = map[3676]; // right win key
-    map[0xe11d] = map[3653]; // pause
-    return &map;
+    if (object.contains(name)) {
+        auto property = object.at(name);
+        if (property.is_number()) {
+            return std::max(0, property.get<int>());
+        }
+    }
+    return defaultValue;
+}
+
+void SoundPackLoader::modifyKeyMap(KeyTimes& map)
+{
+    static const std::pair<int, int> aliases[] = {
+        {0xe01d, 3613}, // right ctrl
+        {0xe037, 3639}, // print screen
+        {0xe038, 3640}, // right alt
+        {0xe047, 3655}, // home
+        {0xe049, 3657}, // page up
+        {0xe04f, 3663}, // end
+        {0xe051, 3665}, // page down
+        {0xe052, 3666}, // insert
+        {0xe053, 3667}, // delete
+        {0xe05b, 3675}, // left win key
+        {0xe05c, 3676}, // right win key
+        {0xe11d, 3653}, // pause
+    };
+
+    for (const auto& [alias, scanCode] : aliases) {
+        auto it = map.find(scanCode);
+        if (it != map.end()) {
+            map[alias] = it->second;
+        }
+    }
 }
 
 SoundPackRepository::SoundPackRepository(const PathSet& dirs)
-:   dirs(dirs)
+:   dirs(dirs),
+    keyUsage(nullptr)
+{
+}
+
+void SoundPackRepository::setKeyUsage(const KeyUsage* keyUsage)
 {
+    this->keyUsage = keyUsage;
 }
 
 SoundPackRepository:: ~SoundPackRepository()
@@ -139,13 +608,74 @@ SoundPack* SoundPackRepository::loadDefault()
 
 SoundPack* SoundPackRepository::load(const wchar_t* name)
 {
+    TRACE_ZONE("SoundPackRepository::load");
+
     for (const auto& dir : dirs) {
         std::filesystem::path path = dir / "sound" / name;
-        if (std::filesystem::exists(path / "config.json")) {
-            SoundPackLoader loader;
+        if (std::filesystem::exists(path / CONFIG_NAME)) {
+            SoundPackLoader loader(keyUsage);
             return loader.load(path);
         }
+
+        path += ARCHIVE_EXTENSION;
+        if (std::filesystem::is_regular_file(path)) {
+            std::unique_ptr<ZipArchive> archive(ZipArchive::open(path));
+            std::string prefix;
+            if (archive && findConfig(*archive, prefix)) {
+                SoundPackLoader loader(keyUsage);
+                return loader.load(std::move(archive), prefix);
+            }
+        }
     }
 
     return nullptr;
 }
+
+/*
+ * Names of the sound packs found in all directories, either unpacked
+ * or as zip archives named after the pack.
+ */
+std::vector<std::wstring> SoundPackRepository::list()
+{
+    std::set<std::wstring> names;
+
+    for (const auto& dir : dirs) {
+        std::error_code error;
+        for (const auto& item : fs::directory_iterator(dir / "sound", error)) {
+            const fs::path& path = item.path();
+            if (item.is_directory() && fs::exists(path / CONFIG_NAME)) {
+                names.insert(path.filename().wstring());
+            } else if (item.is_regular_file() && path.extension() == ARCHIVE_EXTENSION) {
+                std::unique_ptr<ZipArchive> archive(ZipArchive::open(path));
+                std::string prefix;
+                if (archive && findConfig(*archive, prefix)) {
+                    names.insert(path.stem().wstring());
+                }
+            }
+        }
+    }
+
+    return std::vector<std::wstring>(names.begin(), names.end());
+}
+
+/*
+ * Packs are zipped either with their files at the top or within a folder,
+ * so the configuration closest to the top is taken.
+ */
+bool SoundPackRepository::findConfig(ZipArchive& archive, std::string& prefix)
+{
+    const ZipArchive::Entry* found = nullptr;
+    for (const auto& entry : archive.getEntries()) {
+        const std::string& name = entry.name;
+        bool isConfig = name == CONFIG_NAME || endsWith(name, std::string("/") + CONFIG_NAME);
+        if (isConfig && (found == nullptr || name.size() < found->name.size())) {
+            found = &entry;
+        }
+    }
+
+    if (found == nullptr) {
+        return false;
+    }
+    prefix = found->name.substr(0, found->name.size() - (sizeof(CONFIG_NAME) - 1));
+    return true;
+}
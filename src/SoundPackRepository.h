@@ -17,6 +17,8 @@
 
 class SoundPack;
 class WaveResource;
+class ZipArchive;
+class KeyUsage;
 
 class SoundPackRepository {
 private:
@@ -25,13 +27,24 @@ private:
 
     PathSet dirs;
 
+    const KeyUsage* keyUsage;
+
 public:
 
     SoundPackRepository(const PathSet& dirs);
 
     ~SoundPackRepository();
 
+    // Packs are loaded progressively, the keys pressed most first.
+    void setKeyUsage(const KeyUsage* keyUsage);
+
     SoundPack* loadDefault();
 
     SoundPack* load(const wchar_t* name);
+
+    std::vector<std::wstring> list();
+
+private:
+
+    bool findConfig(ZipArchive& archive, std::string& prefix);
 };
@@ -15,202 +15,649 @@
  */
 #include "SoundPlayer.h"
 #include "SoundPack.h"
-#include "SoundResource.h"
+#include "FlightRecorder.h"
+#include "ConvolutionReverb.h"
 
-class ReusableVoice : public IXAudio2VoiceCallback {
-private:
+SoundPlayer* SoundPlayer::create(AudioBackend* backend) {
+    if (backend == nullptr) {
+        return nullptr;
+    }
+    return new SoundPlayer(backend);
+}
 
-    SoundPlayer* player;
-    IXAudio2SourceVoice* source;
+SoundPlayer::SoundPlayer(AudioBackend* backend)
+:   backend(backend),
+    format{0, 0},
+    soundPack(nullptr),
+    retiredSoundPack(nullptr),
+    reverbEnabled(true),
+    activeReverb(nullptr),
+    fadingReverb(nullptr),
+    voiceCount(DEFAULT_VOICES),
+    voiceStealing(false),
+    scheduling(true),
+    onsetStatistics{},
+    renderTicks(0),
+    nextBlockFrame(0),
+    lastBlockFrame(0),
+    lastBlockTime(0),
+    lastBlockFrames(0),
+    idleMicros(0),
+    trimMicros(0),
+    lastActiveTime(0) {
+
+    voices.resize(voiceCount);
+    Metrics::set(metrics.voicePoolSize, voices.size());
+}
 
-public:
+SoundPlayer::~SoundPlayer() {
 
-    ReusableVoice(SoundPlayer* player);
-    ~ReusableVoice();
+    clearSoundPack();
 
-    void setSourceVoice(IXAudio2SourceVoice* source) {
-        this->source = source;
+    if (backend != nullptr) {
+        delete backend;
+        backend = nullptr;
     }
+}
 
-    IXAudio2SourceVoice* getSourceVoice() {
-        return source;
+bool SoundPlayer::setSoundPack(SoundPack* soundPack) {
+    if (this->soundPack == soundPack) {
+        return true;
     }
 
-    virtual void OnStreamEnd();
+    if (soundPack == nullptr) {
+        clearSoundPack();
+        return true;
+    }
 
-    // Callbacks to ignore.
-    virtual void OnVoiceProcessingPassEnd() {}
-    virtual void OnVoiceProcessingPassStart(UINT32 SamplesRequired) {}
-    virtual void OnBufferEnd(void * pBufferContext) {}
-    virtual void OnBufferStart(void * pBufferContext) {}
-    virtual void OnLoopEnd(void * pBufferContext) {}
-    virtual void OnVoiceError(void * pBufferContext, HRESULT Error) {}
-};
+    AudioFormat format{
+        soundPack->getNumberOfChannels(),
+        soundPack->getSamplingRate()
+    };
 
-ReusableVoice::ReusableVoice(SoundPlayer* player)
-:   player(player), source(nullptr) {
+    // Pays for page faults now rather than on the first keys pressed.
+    soundPack->prime();
+
+    if (this->soundPack != nullptr && format == this->format) {
+        // The backend keeps running while the old sounds fade out.
+        SoundPack* expired = nullptr;
+        {
+            std::lock_guard lock(mutex);
+            releaseAllVoices();
+            // A new pool size cuts off the fading sounds.
+            prepareVoices();
+            reserveResidues(soundPack);
+            expired = retiredSoundPack;
+            retiredSoundPack = this->soundPack;
+            this->soundPack = soundPack;
+            // The reverb of the new pack starts afresh with the next block, while
+            // that of the old one, now retired, rings out. A tail still ringing
+            // from the expired pack is cut, as the pack is deleted.
+            fadingReverb = activeReverb;
+            activeReverb = nullptr;
+            lastActiveTime = backend->getTime();
+            masterBus.setTrim(soundPack->getTrim());
+            // Glides from the equalizer of the previous pack.
+            masterBus.setEqualizer(soundPack->getEqualizer());
+        }
+        FlightRecorder::get().record(FlightEventType::PACK_SWITCH, 0, soundPack->getNumberOfClips());
+        if (expired != nullptr) {
+            delete expired;
+        }
+        updatePackMetrics();
+        return true;
+    }
+
+    clearSoundPack();
+
+    {
+        std::lock_guard lock(mutex);
+        prepareVoices();
+        this->format = format;
+        reserveResidues(soundPack);
+        this->soundPack = soundPack;
+        // The backend restarts its clock.
+        nextBlockFrame = 0;
+        lastBlockFrame = 0;
+        lastBlockTime = 0;
+        lastBlockFrames = 0;
+        masterBus.setTrim(soundPack->getTrim());
+        masterBus.setEqualizer(soundPack->getEqualizer());
+        masterBus.configure(format.numberOfChannels, format.samplingRate);
+        throttle.configure(format.samplingRate);
+    }
+
+    FlightRecorder::get().record(FlightEventType::PACK_SWITCH, 1, soundPack->getNumberOfClips());
+
+    if (!backend->open(format, this)) {
+        // Keys are ignored rather than played into an output that is not there.
+        std::cerr << "Cannot open the audio output" << std::endl;
+        clearSoundPack();
+        return false;
+    }
+    {
+        std::lock_guard lock(mutex);
+        lastActiveTime = backend->getTime();
+    }
+    updatePackMetrics();
+    return true;
 }
 
-ReusableVoice::~ReusableVoice() {
-    if (source != nullptr) {
-        source->DestroyVoice();
-        source = nullptr;
+void SoundPlayer::clearSoundPack() {
+    // Stops the backend from rendering before the clips go away.
+    backend->close();
+
+    SoundPack* previous = nullptr;
+    SoundPack* retired = nullptr;
+    {
+        std::lock_guard lock(mutex);
+        stopAllVoices();
+        previous = this->soundPack;
+        retired = this->retiredSoundPack;
+        this->soundPack = nullptr;
+        this->retiredSoundPack = nullptr;
+        // Would otherwise dangle, and match a reverb allocated at the same address.
+        activeReverb = nullptr;
+        fadingReverb = nullptr;
+    }
+
+    if (previous != nullptr) {
+        delete previous;
+    }
+    if (retired != nullptr) {
+        delete retired;
     }
+
+    updatePackMetrics();
 }
 
-void ReusableVoice::OnStreamEnd() {
-    player->finishVoice(this);
+bool SoundPlayer::playSound(int scanCode) {
+    return playSound(scanCode, backend->getTime());
 }
 
-SoundPlayer* SoundPlayer::create() {
-    IXAudio2* audio = nullptr;
-    HRESULT hr = XAudio2Create(&audio, 0, XAUDIO2_DEFAULT_PROCESSOR);
-    if (FAILED(hr)) {
-        return nullptr;
+std::uint64_t SoundPlayer::getTime() {
+    return backend->getTime();
+}
+
+bool SoundPlayer::playSound(int scanCode, std::uint64_t timestamp) {
+    std::lock_guard device(deviceMutex);
+
+    // Samples are only released while suspended.
+    if (backend->isSuspended()) {
+        rematerialize();
     }
 
-    IXAudio2MasteringVoice* masterVoice = nullptr;
-    hr = audio->CreateMasteringVoice(&masterVoice);
-    if (FAILED(hr)) {
-        return nullptr;
+    bool played = startSound(scanCode, timestamp);
+
+    // The sound is already in the first block rendered after resuming.
+    if (backend->isSuspended()) {
+        resume();
+    }
+    return played;
+}
+
+bool SoundPlayer::startSound(int scanCode, std::uint64_t timestamp) {
+    std::lock_guard lock(mutex);
+
+    if (soundPack == nullptr) {
+        return false;
+    }
+
+    SoundClip clip = soundPack->getClip(scanCode);
+    if (clip.isEmpty()) {
+        return false;
+    }
+
+    std::uint64_t inputFrame = getInputFrame(timestamp);
+    std::uint64_t startFrame = scheduling ? inputFrame + lastBlockFrames : inputFrame;
+    if (!admitSound(scanCode, startFrame)) {
+        return false;
+    }
+
+    Voice* voice = findIdleVoice();
+    if (voice == nullptr && voiceStealing) {
+        voice = stealVoice();
     }
 
-    return new SoundPlayer(audio, masterVoice);
+    if (voice == nullptr) {
+        Metrics::increment(metrics.drops);
+        FlightRecorder::get().record(FlightEventType::VOICE_DROP, (std::uint16_t) scanCode);
+        return false;
+    }
+
+    voice->start(clip, soundPack->getClipChannels(), format.numberOfChannels, soundPack->getEnvelope(), inputFrame, startFrame);
+    FlightRecorder::get().record(FlightEventType::VOICE_START, (std::uint16_t) scanCode, getVoiceIndex(*voice));
+
+    Metrics::increment(metrics.plays);
+    std::uint64_t activeVoices = countActiveVoices();
+    if (activeVoices > metrics.peakVoices.load(std::memory_order_relaxed)) {
+        Metrics::set(metrics.peakVoices, activeVoices);
+    }
+    return true;
 }
 
-SoundPlayer::SoundPlayer(IXAudio2* audio, IXAudio2MasteringVoice* masterVoice)
-:   audio(audio),
-    masterVoice(masterVoice),
-    soundPack(nullptr) {
+void SoundPlayer::setVoiceCount(int count) {
+    std::lock_guard lock(mutex);
+    voiceCount = std::max(1, std::min(count, MAX_VOICES));
+}
 
-    voices.reserve(MAX_VOICES);
+void SoundPlayer::setVoiceStealing(bool enabled) {
+    std::lock_guard lock(mutex);
+    voiceStealing = enabled;
 }
 
-SoundPlayer::~SoundPlayer() {
+void SoundPlayer::setScheduling(bool enabled) {
+    std::lock_guard lock(mutex);
+    scheduling = enabled;
+}
 
-    destroyAllVoices();
+void SoundPlayer::setVolume(float volume) {
+    masterBus.setVolume(volume);
+}
 
-    clearSoundPack();
+void SoundPlayer::setLimiting(bool enabled) {
+    masterBus.setLimiting(enabled);
+}
 
-    if (masterVoice != nullptr) {
-        masterVoice->DestroyVoice();
-        masterVoice = nullptr;
+void SoundPlayer::setReverb(bool enabled) {
+    reverbEnabled = enabled;
+}
+
+void SoundPlayer::setInputLimits(const InputThrottle::Limits& limits) {
+    std::lock_guard lock(mutex);
+    throttle.setLimits(limits);
+}
+
+void SoundPlayer::setIdleTimeout(int millis) {
+    std::lock_guard lock(mutex);
+    idleMicros = (std::uint64_t) std::max(0, millis) * 1000;
+}
+
+bool SoundPlayer::suspendIfIdle() {
+    std::lock_guard device(deviceMutex);
+
+    if (backend->isSuspended()) {
+        return false;
+    }
+
+    {
+        std::lock_guard lock(mutex);
+        if (soundPack == nullptr || idleMicros == 0 || !isSilent()) {
+            return false;
+        }
+        if (backend->getTime() < lastActiveTime + idleMicros) {
+            return false;
+        }
     }
 
-    if (audio != nullptr) {
-        audio->Release();
-        audio = nullptr;
+    // Waits for the backend thread, which needs the lock to render.
+    backend->suspend();
+    FlightRecorder::get().record(FlightEventType::SUSPEND);
+
+    {
+        std::lock_guard lock(mutex);
+        // Sounds played while suspended start with the first block after resuming.
+        lastBlockFrame = nextBlockFrame;
+        lastBlockFrames = 0;
     }
+
+    Metrics::increment(metrics.suspends);
+    return true;
 }
 
-void SoundPlayer::setSoundPack(SoundPack* soundPack) {
-    if (this->soundPack != soundPack) {
-        clearSoundPack();
-        this->soundPack = soundPack;
+void SoundPlayer::setTrimTimeout(int millis) {
+    std::lock_guard lock(mutex);
+    trimMicros = (std::uint64_t) std::max(0, millis) * 1000;
+}
+
+/*
+ * Nothing renders while the backend is suspended, so the clips may move.
+ * The sounds of the retired pack have long faded out, so its samples go too.
+ */
+bool SoundPlayer::trimIfIdle() {
+    std::lock_guard device(deviceMutex);
+
+    if (!backend->isSuspended()) {
+        return false;
     }
+
+    {
+        std::lock_guard lock(mutex);
+        if (soundPack == nullptr || trimMicros == 0 || soundPack->isReleased()) {
+            return false;
+        }
+        if (backend->getTime() < lastActiveTime + trimMicros) {
+            return false;
+        }
+        stopAllVoices();
+        if (!soundPack->releaseSamples()) {
+            return false;
+        }
+        if (retiredSoundPack != nullptr) {
+            retiredSoundPack->releaseSamples();
+        }
+    }
+
+    updatePackMetrics();
+    Metrics::increment(metrics.trims);
+    std::uint64_t residentBytes = metrics.residentBytes;
+    FlightRecorder::get().record(FlightEventType::TRIM, 0, (std::uint32_t) std::min<std::uint64_t>(residentBytes, UINT32_MAX));
+    return true;
 }
 
-void SoundPlayer::clearSoundPack() {
-    if (this->soundPack != nullptr) {
-        delete this->soundPack;
-        this->soundPack = nullptr;
+/*
+ * Restores the samples released, which the key waiting for them pays for.
+ */
+void SoundPlayer::rematerialize() {
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::lock_guard lock(mutex);
+        if (soundPack == nullptr || !soundPack->isReleased()) {
+            return;
+        }
+        soundPack->rematerialize();
     }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    std::uint64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    FlightRecorder::get().record(FlightEventType::REMATERIALIZE, 0, (std::uint32_t) micros);
+
+    Metrics::set(metrics.rematerializeMicros, micros);
+    if (micros > metrics.maxRematerializeMicros.load(std::memory_order_relaxed)) {
+        Metrics::set(metrics.maxRematerializeMicros, micros);
+    }
+    updatePackMetrics();
 }
 
-bool SoundPlayer::playSound(int scanCode) {
+void SoundPlayer::resume() {
+    auto start = std::chrono::steady_clock::now();
+    if (!backend->resume()) {
+        return;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    std::uint64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    FlightRecorder::get().record(FlightEventType::RESUME, 0, (std::uint32_t) micros);
+
+    Metrics::increment(metrics.resumes);
+    Metrics::set(metrics.resumeMicros, micros);
+    if (micros > metrics.maxResumeMicros.load(std::memory_order_relaxed)) {
+        Metrics::set(metrics.maxResumeMicros, micros);
+    }
+}
 
-    if (soundPack == nullptr) {
-        return false;
+SoundPlayer::Statistics SoundPlayer::getStatistics() {
+    std::lock_guard lock(mutex);
+    return Statistics{
+        metrics.plays,
+        metrics.drops,
+        metrics.steals,
+        (int) metrics.peakVoices,
+        onsetStatistics
+    };
+}
+
+Metrics& SoundPlayer::getMetrics() {
+    // Values owned by other parts are pulled on demand.
+    Metrics::set(metrics.underruns, backend->getUnderruns());
+    Metrics::set(metrics.limitedBlocks, masterBus.getLimitedBlocks());
+    double ticksPerSecond = FlightRecorder::get().getTicksPerSecond();
+    if (ticksPerSecond > 0.0) {
+        Metrics::set(metrics.renderMicros, (std::uint64_t) (renderTicks * 1e6 / ticksPerSecond));
     }
+    return metrics;
+}
 
-    SoundClip* clip = soundPack->getClip(scanCode);
-    if (clip == nullptr) {
-        return false;
+/*
+ * Resizes the pool while the backend is closed, so that no voice is
+ * allocated once the sound pack is active.
+ */
+void SoundPlayer::prepareVoices() {
+    if ((int) voices.size() != voiceCount) {
+        voices.assign(voiceCount, Voice{});
+        Metrics::set(metrics.voicePoolSize, voices.size());
     }
+}
 
-    ReusableVoice* voice = findIdleVoice();
-    if (voice == nullptr) {
-        voice = createVoice();
-        if (voice == nullptr) {
-            return false;
+/*
+ * Grows the residues to the release of the pack, keeping what they hold.
+ */
+void SoundPlayer::reserveResidues(SoundPack* soundPack) {
+    const std::uint64_t releaseFrames = soundPack->getEnvelope()->getReleaseFrames();
+    for (auto& voice : voices) {
+        voice.reserveResidue(releaseFrames, format.numberOfChannels);
+    }
+}
+
+/*
+ * Called whenever the sound packs change, never while playing.
+ */
+void SoundPlayer::updatePackMetrics() {
+    std::uint64_t residentBytes = 0;
+    std::uint64_t loadMicros = 0;
+    std::uint64_t decodeMicros = 0;
+    std::uint64_t ioWaitMicros = 0;
+    {
+        std::lock_guard lock(mutex);
+        if (soundPack != nullptr) {
+            residentBytes += soundPack->getResidentBytes();
+            loadMicros = soundPack->getLoadMicros();
+            decodeMicros = soundPack->getDecodeMicros();
+            ioWaitMicros = soundPack->getIoWaitMicros();
+        }
+        if (retiredSoundPack != nullptr) {
+            residentBytes += retiredSoundPack->getResidentBytes();
         }
     }
+    Metrics::set(metrics.residentBytes, residentBytes);
+    Metrics::set(metrics.packLoadMicros, loadMicros);
+    Metrics::set(metrics.decodeMicros, decodeMicros);
+    Metrics::set(metrics.ioWaitMicros, ioWaitMicros);
+}
 
-    XAUDIO2_BUFFER buffer{};
-    buffer.AudioBytes = clip->length;
-    buffer.pAudioData = clip->data;
-    buffer.Flags = XAUDIO2_END_OF_STREAM;
+void SoundPlayer::render(float* buffer, int frames) {
+    std::lock_guard lock(mutex);
 
-    IXAudio2SourceVoice* source = voice->getSourceVoice();
-    HRESULT hr = source->SubmitSourceBuffer(&buffer);
-    if (SUCCEEDED(hr)) {
-        hr = source->Start(0);
-        if (SUCCEEDED(hr)) {
-            return true;
+    FlightRecorder& recorder = FlightRecorder::get();
+    const std::uint64_t startTicks = FlightRecorder::readTimestamp();
+
+    lastBlockFrame = nextBlockFrame;
+    lastBlockTime = backend->getTime();
+    lastBlockFrames = frames;
+
+    const std::uint64_t count = (std::uint64_t) frames * format.numberOfChannels;
+    std::fill(buffer, buffer + count, 0.0f);
+
+    std::uint64_t activeVoices = 0;
+    bool audible = false;
+    for (auto& voice : voices) {
+        if (voice.isFading()) {
+            voice.mixTails(buffer, frames, format.numberOfChannels);
+            audible = true;
+        }
+        if (voice.isActive()) {
+            mixVoice(voice, buffer, frames);
+            activeVoices++;
+            if (!voice.isActive()) {
+                recorder.record(FlightEventType::VOICE_STOP, 0, getVoiceIndex(voice));
+            }
         }
     }
+    Metrics::set(metrics.activeVoices, activeVoices);
 
-    return false;
+    if (audible || activeVoices > 0) {
+        lastActiveTime = lastBlockTime;
+    }
+
+    // Costs a comparison when there is no reverb.
+    ConvolutionReverb* reverb = (reverbEnabled && soundPack != nullptr) ? soundPack->getReverb() : nullptr;
+    if (reverb != activeReverb) {
+        if (reverb != nullptr && reverb == fadingReverb) {
+            // Turned on again while ringing out, so it carries on.
+            fadingReverb = nullptr;
+        } else if (reverb != nullptr) {
+            reverb->reset();
+        }
+        if (activeReverb != nullptr) {
+            fadingReverb = activeReverb;
+        }
+        activeReverb = reverb;
+    }
+    if (reverb != nullptr) {
+        reverb->process(buffer, frames);
+    }
+    // Added after the active reverb, so that it does not reverberate the old tail.
+    if (fadingReverb != nullptr) {
+        fadingReverb->ringOut(buffer, frames);
+        if (fadingReverb->isSilent()) {
+            fadingReverb = nullptr;
+        }
+    }
+
+    if (!masterBus.isBypassed()) {
+        masterBus.process(buffer, frames);
+    }
+
+    nextBlockFrame += frames;
+
+    // Time spent rendering, in ticks of the recorder.
+    std::uint64_t ticks = FlightRecorder::readTimestamp() - startTicks;
+    renderTicks.fetch_add(ticks, std::memory_order_relaxed);
+    recorder.record(FlightEventType::RENDER, (std::uint16_t) activeVoices, (std::uint32_t) std::min<std::uint64_t>(ticks, UINT32_MAX));
 }
 
-ReusableVoice* SoundPlayer::createVoice() {
+bool SoundPlayer::admitSound(int scanCode, std::uint64_t startFrame) {
+    InputThrottle::Decision decision = throttle.admit(scanCode, startFrame, lastBlockFrames);
+    if (decision != InputThrottle::Decision::PLAY) {
+        FlightRecorder::get().record(FlightEventType::THROTTLE, (std::uint16_t) scanCode, (std::uint32_t) decision);
+    }
 
-    if (voices.size() >= MAX_VOICES) {
-        return nullptr;
+    switch (decision) {
+        case InputThrottle::Decision::PLAY:
+            return true;
+        case InputThrottle::Decision::COALESCE:
+            Metrics::increment(metrics.coalesced);
+            return false;
+        case InputThrottle::Decision::LIMIT:
+            Metrics::increment(metrics.limited);
+            return false;
+        case InputThrottle::Decision::COLLAPSE:
+            // The flood is heard as this one sound.
+            releaseVoicesFrom(throttle.getFloodFrame());
+            return true;
+        case InputThrottle::Decision::SUPPRESS:
+            Metrics::increment(metrics.collapsed);
+            return false;
     }
+    return false;
+}
 
-    ReusableVoice* reusable = new ReusableVoice(this);
+/*
+ * Maps a backend time to the output frame being rendered at that time,
+ * extrapolating from the block rendered last. Rounds to the nearest frame,
+ * since times in whole microseconds fall short of most frames.
+ */
+std::uint64_t SoundPlayer::getInputFrame(std::uint64_t timestamp) {
+    if (lastBlockFrames == 0 || timestamp <= lastBlockTime) {
+        return lastBlockFrame;
+    }
+    std::uint64_t elapsed = timestamp - lastBlockTime;
+    return lastBlockFrame + (elapsed * format.samplingRate + 500000) / 1000000;
+}
 
-    auto resource = soundPack->getResource();
-    WAVEFORMATEX format{
-        WAVE_FORMAT_PCM,
-        (WORD) resource->getNumberOfChannels(),
-        (DWORD) resource->getSamplingRate(),
-        (DWORD) resource->getBytesPerSec(),
-        (WORD) resource->getBlockAlign(),
-        (WORD) resource->getBitsPerSample(),
-        0
-    };
+void SoundPlayer::mixVoice(Voice& voice, float* buffer, int frames) {
+    const std::uint64_t blockFrame = lastBlockFrame;
+    if (voice.startFrame >= blockFrame + frames) {
+        // Scheduled for a later block.
+        return;
+    }
 
-    IXAudio2SourceVoice* voice = nullptr;
-    HRESULT hr = audio->CreateSourceVoice(&voice, &format, 0, XAUDIO2_DEFAULT_FREQ_RATIO, reusable);
-    if (FAILED(hr)) {
-        delete reusable;
-        return nullptr;
+    std::uint64_t offset = (voice.startFrame > blockFrame) ? voice.startFrame - blockFrame : 0;
+
+    if (!voice.started) {
+        std::uint64_t onset = blockFrame + offset;
+        onsetStatistics.add((double) onset - (double) voice.inputFrame);
+        if (scheduling && onset > voice.startFrame) {
+            onsetStatistics.late++;
+        }
+        voice.started = true;
     }
 
-    reusable->setSourceVoice(voice);
-    voices.push_back(reusable);
+    voice.mix(buffer + offset * format.numberOfChannels, frames - offset);
+}
+
+Voice* SoundPlayer::findIdleVoice() {
+    Voice* idle = nullptr;
+    for (auto& voice : voices) {
+        if (voice.isSilent()) {
+            return &voice;
+        } else if (idle == nullptr && !voice.isActive()) {
+            // Still fading out, which does not prevent a new sound.
+            idle = &voice;
+        }
+    }
+    return idle;
+}
 
-    return reusable;
+// Takes the voice with the least energy left to play, which is missed the least.
+Voice* SoundPlayer::stealVoice() {
+    Voice* quietest = nullptr;
+    float quietestEnergy = 0.0f;
+    for (auto& voice : voices) {
+        float energy = voice.getRemainingEnergy();
+        if (quietest == nullptr || energy < quietestEnergy) {
+            quietest = &voice;
+            quietestEnergy = energy;
+        }
+    }
+    if (quietest != nullptr) {
+        quietest->release();
+        Metrics::increment(metrics.steals);
+        FlightRecorder::get().record(FlightEventType::VOICE_STEAL, 0, getVoiceIndex(*quietest));
+    }
+    return quietest;
 }
 
-void SoundPlayer::destroyAllVoices() {
+std::uint32_t SoundPlayer::getVoiceIndex(const Voice& voice) {
+    return (std::uint32_t) (&voice - voices.data());
+}
 
-    while (!idle.empty()) {
-        idle.pop();
+bool SoundPlayer::isSilent() {
+    for (auto& voice : voices) {
+        if (!voice.isSilent()) {
+            return false;
+        }
     }
+    return true;
+}
 
-    auto it =  voices.begin();
-    while (it != voices.end()) {
-        delete *it++;
+int SoundPlayer::countActiveVoices() {
+    int count = 0;
+    for (auto& voice : voices) {
+        if (voice.isActive()) {
+            count++;
+        }
     }
+    return count;
+}
 
-    voices.clear();
+void SoundPlayer::releaseAllVoices() {
+    for (auto& voice : voices) {
+        // Tails of the expiring sound pack must not outlive it.
+        voice.settleTail(format.numberOfChannels);
+        voice.release();
+    }
 }
 
-ReusableVoice* SoundPlayer::findIdleVoice() {
-    std::lock_guard lock(mutex);
-    if (idle.empty()) {
-        return nullptr;
-    } else {
-        auto first = idle.front();
-        idle.pop();
-        return first;
+void SoundPlayer::releaseVoicesFrom(std::uint64_t startFrame) {
+    for (auto& voice : voices) {
+        if (voice.isActive() && voice.startFrame >= startFrame) {
+            voice.release();
+            Metrics::increment(metrics.collapsed);
+        }
     }
 }
 
-void SoundPlayer::finishVoice(ReusableVoice* voice) {
-    std::lock_guard lock(mutex);
-    idle.push(voice);
+void SoundPlayer::stopAllVoices() {
+    for (auto& voice : voices) {
+        voice.stop();
+    }
 }
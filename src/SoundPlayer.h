@@ -15,50 +15,209 @@
  */
 #pragma once
 
+#include "AudioBackend.h"
+#include "InputThrottle.h"
+#include "Voice.h"
+#include "MasterBus.h"
+#include "Metrics.h"
+
 class SoundPack;
-class SoundClip;
-class ReusableVoice;
+class ConvolutionReverb;
+
+class SoundPlayer: public AudioRenderer {
+public:
+
+    // Latency from key events to the first samples of their sounds, in frames.
+    struct OnsetStatistics {
+        std::uint64_t count;
+        // Sounds started after their scheduled frame.
+        std::uint64_t late;
+        double minimum;
+        double maximum;
+        double sum;
+        double sumOfSquares;
+
+        void add(double latency) {
+            minimum = (count == 0) ? latency : std::min(minimum, latency);
+            maximum = (count == 0) ? latency : std::max(maximum, latency);
+            sum += latency;
+            sumOfSquares += latency * latency;
+            count++;
+        }
+
+        double getMean() const {
+            return (count > 0) ? sum / count : 0.0;
+        }
+
+        // Standard deviation of the latency.
+        double getJitter() const {
+            if (count == 0) {
+                return 0.0;
+            }
+            double mean = getMean();
+            return std::sqrt(std::max(0.0, sumOfSquares / count - mean * mean));
+        }
+    };
+
+    struct Statistics {
+        std::uint64_t plays;
+        // Sounds not played because no voice was available.
+        std::uint64_t drops;
+        // Voices cut off to play a newer sound.
+        std::uint64_t steals;
+        int peakVoices;
+        OnsetStatistics onset;
+    };
 
-class SoundPlayer {
 private:
 
-    static const int MAX_VOICES = 8;
+    static constexpr int MAX_VOICES = 64;
 
-    IXAudio2* audio;
-    IXAudio2MasteringVoice* masterVoice;
+    AudioBackend* backend;
+    AudioFormat format;
 
     SoundPack* soundPack;
-
-    // All created voices.
-    std::vector<ReusableVoice*> voices;
-    // Finished voices.
-    std::queue<ReusableVoice*> idle;
+    // Previous sound pack, kept while its sounds fade out.
+    SoundPack* retiredSoundPack;
+
+    // Allocated up front, never while playing.
+    std::vector<Voice> voices;
+
+    MasterBus masterBus;
+
+    InputThrottle throttle;
+
+    std::atomic<bool> reverbEnabled;
+    // Reverb of the sound pack fed by the last block, which starts afresh when it changes.
+    ConvolutionReverb* activeReverb;
+    // Reverb replaced by another one or turned off, ringing out until it is silent.
+    // Belongs to the current or the retired sound pack.
+    ConvolutionReverb* fadingReverb;
+
+    int voiceCount;
+    bool voiceStealing;
+    // Delays sounds by a block to start them at the exact offset of their key events.
+    bool scheduling;
+    OnsetStatistics onsetStatistics;
+    Metrics metrics;
+    // Time spent rendering, in ticks of the flight recorder.
+    std::atomic<std::uint64_t> renderTicks;
+
+    // Frame of the next block to render.
+    std::uint64_t nextBlockFrame;
+    // Frame, backend time and length of the block rendered last.
+    std::uint64_t lastBlockFrame;
+    std::uint64_t lastBlockTime;
+    int lastBlockFrames;
+
+    // Length of silence after which the backend is suspended, zero never suspends it.
+    std::uint64_t idleMicros;
+    // Length of silence after which the samples are released, zero never releases them.
+    std::uint64_t trimMicros;
+    // Backend time of the last block with something audible.
+    std::uint64_t lastActiveTime;
 
     std::mutex mutex;
+    // Serializes suspending and resuming the backend with key events.
+    std::mutex deviceMutex;
 
 public:
 
-    static SoundPlayer* create();
+    static constexpr int DEFAULT_VOICES = 8;
 
-    ~SoundPlayer();
+    static SoundPlayer* create(AudioBackend* backend);
 
-    void setSoundPack(SoundPack* soundPack);
+    virtual ~SoundPlayer();
+
+    // Takes ownership of the pack. Returns false if the output cannot be
+    // opened for it, deleting the pack and leaving the player silent.
+    bool setSoundPack(SoundPack* soundPack);
 
     void clearSoundPack();
 
     bool playSound(int scanCode);
 
+    // Plays a sound for a key event which occurred at the given backend time.
+    bool playSound(int scanCode, std::uint64_t timestamp);
+
+    // Current backend time in microseconds, to date key events with.
+    std::uint64_t getTime();
+
+    // Number of sounds playing at once, taking effect with the next sound pack.
+    void setVoiceCount(int count);
+
+    void setVoiceStealing(bool enabled);
+
+    void setScheduling(bool enabled);
+
+    // Output volume from 0 to 1, applied smoothly.
+    void setVolume(float volume);
+
+    void setLimiting(bool enabled);
+
+    // Applies the reverb of sound packs which have one.
+    void setReverb(bool enabled);
+
+    // Limits on the sounds started by bursts of key events.
+    void setInputLimits(const InputThrottle::Limits& limits);
+
+    // Time of silence after which the backend is suspended, zero disables it.
+    void setIdleTimeout(int millis);
+
+    // Suspends the backend if nothing has been audible for the idle timeout.
+    // Called periodically, never from the backend thread.
+    bool suspendIfIdle();
+
+    // Time of silence after which the samples of the sound packs are
+    // released, once the backend is suspended. Zero disables it.
+    void setTrimTimeout(int millis);
+
+    // Releases the samples if the backend has been suspended for long enough,
+    // to be restored by the next key. Called periodically like suspendIfIdle().
+    bool trimIfIdle();
+
+    Statistics getStatistics();
+
+    // Safe to call from any thread.
+    Metrics& getMetrics();
+
+    virtual void render(float* buffer, int frames);
+
 private:
 
-    SoundPlayer(IXAudio2* audio, IXAudio2MasteringVoice* masterVoice);
+    SoundPlayer(AudioBackend* backend);
+
+    bool startSound(int scanCode, std::uint64_t timestamp);
+
+    void resume();
+
+    void rematerialize();
+
+    bool isSilent();
+
+    bool admitSound(int scanCode, std::uint64_t startFrame);
+
+    std::uint64_t getInputFrame(std::uint64_t timestamp);
+
+    void mixVoice(Voice& voice, float* buffer, int frames);
+
+    Voice* findIdleVoice();
+
+    Voice* stealVoice();
+
+    std::uint32_t getVoiceIndex(const Voice& voice);
+
+    int countActiveVoices();
+
+    void prepareVoices();
 
-    ReusableVoice* createVoice();
+    void reserveResidues(SoundPack* soundPack);
 
-    ReusableVoice* findIdleVoice();
+    void updatePackMetrics();
 
-    void finishVoice(ReusableVoice* voice);
+    void releaseAllVoices();
 
-    void destroyAllVoices();
+    void releaseVoicesFrom(std::uint64_t startFrame);
 
-    friend class ReusableVoice;
+    void stopAllVoices();
 };
@@ -37,20 +37,29 @@ SoundResource::~SoundResource()
     }
 }
 
-SoundClip* SoundResource::slice(int start, int duration)
+SoundClip SoundResource::slice(int start, int duration)
 {
-    const size_t samplePerSec = getSamplingRate();
-    const size_t bytesPerSample = getBitsPerSample() * getNumberOfChannels() / 8L;
+    SampleRange range = getSliceRange(getSamplingRate(), getBlockAlign(), length, start, duration);
+    if (range.isEmpty()) {
+        return SoundClip{};
+    }
+    return SoundClip{data + range.offset, range.length};
+}
+
+SampleRange SoundResource::getSliceRange(int samplingRate, int blockAlign, std::uint64_t length, int start, int duration)
+{
+    const size_t samplePerSec = samplingRate;
+    const size_t bytesPerSample = blockAlign;
     size_t clipOffset = (samplePerSec * start / 1000) * bytesPerSample;
     size_t clipLength = (samplePerSec * duration / 1000) * bytesPerSample;
 
     if (clipOffset >= length) {
-        return nullptr;
+        return SampleRange{};
     }
 
     if (clipOffset + clipLength > length) {
         clipLength = length - clipOffset;
     }
 
-    return new SoundClip{data + clipOffset, clipLength};
+    return SampleRange{clipOffset, clipLength};
 }
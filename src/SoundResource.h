@@ -17,6 +17,20 @@
 
 #include "SoundClip.h"
 
+// Bytes of a slice within the samples of a resource.
+struct SampleRange {
+    std::uint64_t offset = 0;
+    std::uint64_t length = 0;
+
+    bool isEmpty() const {
+        return length == 0;
+    }
+
+    bool operator==(const SampleRange& other) const {
+        return offset == other.offset && length == other.length;
+    }
+};
+
 class SoundResource {
 private:
 
@@ -65,5 +79,10 @@ public:
         return length;
     }
 
-    SoundClip* slice(int start, int duration);
+    // Returns an empty clip if the range is out of the resource.
+    SoundClip slice(int start, int duration);
+
+    // Range of the samples from start for duration, both in milliseconds,
+    // cut to the length of the samples.
+    static SampleRange getSliceRange(int samplingRate, int blockAlign, std::uint64_t length, int start, int duration);
 };
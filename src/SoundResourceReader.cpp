@@ -14,8 +14,10 @@
  * limitations under the License.
  */
 #include "SoundResourceReader.h"
+#include "FilePrefetcher.h"
 #include "OggSoundResourceReader.h"
 #include "WaveSoundResourceReader.h"
+#include "ZipArchive.h"
 
 SoundResourceReader* SoundResourceReader::fromFile(const wchar_t* path) {
     return fromFile(std::filesystem::path(path));
@@ -25,15 +27,49 @@ SoundResourceReader* SoundResourceReader::fromFile(const std::filesystem::path&
     std::string e = path.extension().string();
     std::transform(e.begin(), e.end(), e.begin(), ::tolower);
 
+    if (e != ".ogg" && e != ".wav") {
+        return nullptr;
+    }
+
     FILE* file = ::fopen(path.string().c_str(), "rb");
-    if (file != nullptr) {
-        if (e == ".ogg") {
-            return new OggSoundResourceReader(file);
-        } else if (e == ".wav") {
-            return new WaveSoundResourceReader(file);
-        }
-        ::fclose(file);
+    if (file == nullptr) {
+        return nullptr;
+    }
+
+    FilePrefetcher* prefetcher = FilePrefetcher::start(file);
+    if (prefetcher == nullptr) {
+        return nullptr;
+    }
+    if (e == ".ogg") {
+        return new OggSoundResourceReader(prefetcher);
+    }
+    return new WaveSoundResourceReader(prefetcher);
+}
+
+SoundResourceReader* SoundResourceReader::fromMemory(const std::uint8_t* data, std::size_t size, const std::filesystem::path& name) {
+    std::string e = name.extension().string();
+    std::transform(e.begin(), e.end(), e.begin(), ::tolower);
+
+    if (e == ".ogg") {
+        return new OggSoundResourceReader(data, size);
+    } else if (e == ".wav") {
+        return new WaveSoundResourceReader(data, size);
     }
 
     return nullptr;
 }
+
+SoundResourceReader::~SoundResourceReader() {
+    if (archive != nullptr) {
+        delete archive;
+    }
+}
+
+void SoundResourceReader::keepSource(ZipArchive* archive, std::vector<std::uint8_t>&& buffer) {
+    if (this->archive != nullptr) {
+        delete this->archive;
+    }
+    this->archive = archive;
+    // Moving keeps the samples where the reader points.
+    this->buffer = std::move(buffer);
+}
@@ -16,13 +16,53 @@
 #pragma once
 
 class SoundResource;
+class ZipArchive;
 
 class SoundResourceReader {
+private:
+
+    // What the memory of the reader lies in, when owned by the reader.
+    ZipArchive* archive = nullptr;
+    std::vector<std::uint8_t> buffer;
+
 public:
 
+    struct Format {
+        int numberOfChannels;
+        int samplingRate;
+        int bitsPerSample;
+        // Bytes of samples in the whole resource.
+        std::uint64_t length;
+    };
+
+    // Files are read ahead on a thread of their own while they are decoded.
     static SoundResourceReader* fromFile(const wchar_t* path);
     static SoundResourceReader* fromFile(const std::filesystem::path& path);
 
-    virtual ~SoundResourceReader() {};
+    // Reads a file held in memory, such as an entry of an archive, named by its extension.
+    static SoundResourceReader* fromMemory(const std::uint8_t* data, std::size_t size, const std::filesystem::path& name);
+
+    virtual ~SoundResourceReader();
     virtual SoundResource* read() = 0;
+
+    // Takes ownership of the archive or of the buffer holding the memory the
+    // reader was created with, which ranges are decoded from long after loading.
+    void keepSource(ZipArchive* archive, std::vector<std::uint8_t>&& buffer);
+
+    // Prepares for decoding ranges of the samples on demand, which readers
+    // of formats cheap enough to read whole do not support. The memory the
+    // reader was created with is decoded in place, so it must outlive the reader.
+    virtual bool open(Format& /*format*/) {
+        return false;
+    }
+
+    // Decodes a range of the samples in whole frames, one call at a time.
+    virtual bool readRange(std::uint64_t /*offset*/, std::uint64_t /*length*/, std::uint8_t* /*output*/) {
+        return false;
+    }
+
+    // Time decoding so far was held up waiting for the file to be read.
+    virtual std::uint64_t getWaitMicros() {
+        return 0;
+    }
 };
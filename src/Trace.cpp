@@ -0,0 +1,77 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "Trace.h"
+
+#ifdef ROAR_TRACE
+
+Tracer& Tracer::get()
+{
+    static Tracer tracer;
+    return tracer;
+}
+
+Tracer::Tracer()
+:   origin(Clock::now())
+{
+}
+
+std::uint64_t Tracer::now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - origin).count();
+}
+
+void Tracer::add(const char* name, std::uint64_t start, std::uint64_t end)
+{
+    int thread = getThreadId();
+    std::lock_guard lock(mutex);
+    events.push_back(Event{name, start, end - start, thread});
+}
+
+void Tracer::setPath(const std::filesystem::path& path)
+{
+    std::lock_guard lock(mutex);
+    this->path = path;
+}
+
+void Tracer::flush()
+{
+    std::lock_guard lock(mutex);
+    if (path.empty()) {
+        return;
+    }
+
+    std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+    stream << "{\"traceEvents\":[";
+    for (size_t i = 0; i < events.size(); i++) {
+        const Event& event = events[i];
+        stream << (i > 0 ? ",\n" : "\n")
+            << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1"
+            << ",\"tid\":" << event.thread
+            << ",\"ts\":" << event.start
+            << ",\"dur\":" << event.duration << "}";
+    }
+    stream << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+// Small sequential numbers read better in the viewer than native ids.
+int Tracer::getThreadId()
+{
+    static std::atomic<int> next(1);
+    thread_local int id = next++;
+    return id;
+}
+
+#endif
@@ -0,0 +1,93 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+/*
+ * Scoped zones recorded as Chrome trace events, viewable in
+ * chrome://tracing or Perfetto. Zones compile to nothing unless
+ * ROAR_TRACE is defined.
+ */
+
+#ifdef ROAR_TRACE
+
+class Tracer {
+private:
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Event {
+        const char* name;
+        std::uint64_t start;
+        std::uint64_t duration;
+        int thread;
+    };
+
+    std::mutex mutex;
+    std::vector<Event> events;
+    std::filesystem::path path;
+    Clock::time_point origin;
+
+public:
+
+    static Tracer& get();
+
+    std::uint64_t now();
+
+    void add(const char* name, std::uint64_t start, std::uint64_t end);
+
+    void setPath(const std::filesystem::path& path);
+
+    // Writes the events recorded so far as trace JSON.
+    void flush();
+
+private:
+
+    Tracer();
+
+    static int getThreadId();
+};
+
+class TraceZone {
+private:
+
+    const char* name;
+    std::uint64_t start;
+
+public:
+
+    TraceZone(const char* name)
+    :   name(name),
+        start(Tracer::get().now()) {
+    }
+
+    ~TraceZone() {
+        Tracer::get().add(name, start, Tracer::get().now());
+    }
+};
+
+#define ROAR_TRACE_CONCAT_(a, b) a##b
+#define ROAR_TRACE_CONCAT(a, b) ROAR_TRACE_CONCAT_(a, b)
+#define TRACE_ZONE(name) TraceZone ROAR_TRACE_CONCAT(traceZone, __LINE__)(name)
+#define TRACE_OUTPUT(path) Tracer::get().setPath(path)
+#define TRACE_FLUSH() Tracer::get().flush()
+
+#else
+
+#define TRACE_ZONE(name)
+#define TRACE_OUTPUT(path)
+#define TRACE_FLUSH()
+
+#endif
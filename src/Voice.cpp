@@ -0,0 +1,277 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "Voice.h"
+#include "Envelope.h"
+#include "ClipLoudness.h"
+
+static const float SCALE = 1.0f / 32768.0f;
+
+static void mixPlain(float* output, const std::int16_t* source, std::uint64_t samples, float gain)
+{
+    const float g = gain * SCALE;
+    for (std::uint64_t i = 0; i < samples; i++) {
+        output[i] += source[i] * g;
+    }
+}
+
+static void mixFaded(
+    float* output,
+    const std::int16_t* source,
+    std::uint64_t frames,
+    int channels,
+    const float* gains,
+    float gain)
+{
+    for (std::uint64_t i = 0; i < frames; i++) {
+        const float g = gains[i] * gain * SCALE;
+        for (int c = 0; c < channels; c++) {
+            output[c] += source[c] * g;
+        }
+        output += channels;
+        source += channels;
+    }
+}
+
+static void mixPlainUpmixed(float* output, const std::int16_t* source, std::uint64_t frames, int channels, float gain)
+{
+    const float g = gain * SCALE;
+    for (std::uint64_t i = 0; i < frames; i++) {
+        const float sample = source[i] * g;
+        for (int c = 0; c < channels; c++) {
+            output[c] += sample;
+        }
+        output += channels;
+    }
+}
+
+static void mixFadedUpmixed(
+    float* output,
+    const std::int16_t* source,
+    std::uint64_t frames,
+    int channels,
+    const float* gains,
+    float gain)
+{
+    for (std::uint64_t i = 0; i < frames; i++) {
+        const float sample = source[i] * gains[i] * gain * SCALE;
+        for (int c = 0; c < channels; c++) {
+            output[c] += sample;
+        }
+        output += channels;
+    }
+}
+
+// Mixes frames of a clip with the given number of channels, either matching the output or mono.
+static void mixEnveloped(
+    float* output,
+    const std::int16_t* source,
+    std::uint64_t frames,
+    int sourceChannels,
+    int channels,
+    const float* gains,
+    float gain)
+{
+    if (sourceChannels == channels) {
+        mixFaded(output, source, frames, channels, gains, gain);
+    } else {
+        mixFadedUpmixed(output, source, frames, channels, gains, gain);
+    }
+}
+
+void Voice::Tail::mix(float* output, std::uint64_t frames, int channels)
+{
+    std::uint64_t n = std::min({
+        frames,
+        (length - position) / sourceChannels,
+        releaseFrames - releasePosition
+    });
+
+    mixEnveloped(output, samples + position, n, sourceChannels, channels, release + releasePosition, gain);
+
+    position += n * sourceChannels;
+    releasePosition += n;
+    if (position >= length || releasePosition >= releaseFrames) {
+        stop();
+    }
+}
+
+void Voice::start(
+    const SoundClip& clip,
+    int sourceChannels,
+    int channels,
+    const Envelope* envelope,
+    std::uint64_t inputFrame,
+    std::uint64_t startFrame)
+{
+    samples = reinterpret_cast<const std::int16_t*>(clip.data);
+    length = clip.length / sizeof(std::int16_t);
+    position = 0;
+    this->sourceChannels = sourceChannels;
+    this->channels = channels;
+    this->envelope = envelope;
+    this->loudness = clip.loudness;
+    this->gain = (clip.loudness != nullptr) ? clip.loudness->gain : 1.0f;
+    this->inputFrame = inputFrame;
+    this->startFrame = startFrame;
+    started = false;
+}
+
+void Voice::release()
+{
+    if (!isActive()) {
+        return;
+    }
+
+    // A sound not started yet has nothing to fade.
+    if (started && envelope->getReleaseFrames() > 0) {
+        settleTail(channels);
+        tail.samples = samples;
+        tail.length = length;
+        tail.position = position;
+        tail.release = envelope->getRelease();
+        tail.releaseFrames = envelope->getReleaseFrames();
+        tail.releasePosition = 0;
+        tail.sourceChannels = sourceChannels;
+        tail.gain = getGain(position / sourceChannels) * gain;
+    }
+
+    samples = nullptr;
+    started = false;
+}
+
+void Voice::stop()
+{
+    samples = nullptr;
+    started = false;
+    tail.stop();
+    residueFrames = 0;
+    residuePosition = 0;
+}
+
+void Voice::reserveResidue(std::uint64_t releaseFrames, int channels)
+{
+    if (residue.size() < releaseFrames * channels) {
+        residue.resize(releaseFrames * channels, 0.0f);
+    }
+}
+
+/*
+ * Tails last no longer than their release, so the residue left and the
+ * rest of the tail fit the room made for the longest release.
+ */
+void Voice::settleTail(int channels)
+{
+    if (!tail.isActive()) {
+        return;
+    }
+
+    const std::uint64_t capacity = residue.size() / channels;
+    const std::uint64_t left = residueFrames - residuePosition;
+    std::memmove(residue.data(), residue.data() + residuePosition * channels, left * channels * sizeof(float));
+    std::fill(residue.begin() + left * channels, residue.end(), 0.0f);
+
+    const std::uint64_t tailFrames = std::min({
+        (tail.length - tail.position) / tail.sourceChannels,
+        tail.releaseFrames - tail.releasePosition,
+        capacity
+    });
+    tail.mix(residue.data(), tailFrames, channels);
+    tail.stop();
+
+    residueFrames = std::max(left, tailFrames);
+    residuePosition = 0;
+}
+
+void Voice::mixTails(float* output, std::uint64_t frames, int channels)
+{
+    if (residuePosition < residueFrames) {
+        std::uint64_t n = std::min(frames, residueFrames - residuePosition);
+        const float* source = residue.data() + residuePosition * channels;
+        for (std::uint64_t i = 0; i < n * channels; i++) {
+            output[i] += source[i];
+        }
+        residuePosition += n;
+    }
+    if (tail.isActive()) {
+        tail.mix(output, frames, channels);
+    }
+}
+
+void Voice::mix(float* output, std::uint64_t frames)
+{
+    const std::uint64_t totalFrames = length / sourceChannels;
+    const std::uint64_t attackFrames = envelope->getAttackFrames();
+    const std::uint64_t releaseFrames = envelope->getReleaseFrames();
+    // The release ends exactly at the last frame of the clip.
+    const std::uint64_t releaseStart = std::max(attackFrames, totalFrames - std::min(totalFrames, releaseFrames));
+
+    std::uint64_t frame = position / sourceChannels;
+    const std::uint64_t end = std::min(totalFrames, frame + frames);
+
+    while (frame < end) {
+        std::uint64_t n = 0;
+        const std::int16_t* source = samples + frame * sourceChannels;
+        if (frame < attackFrames) {
+            n = std::min(end, attackFrames) - frame;
+            mixEnveloped(output, source, n, sourceChannels, channels, envelope->getAttack() + frame, gain);
+        } else if (frame < releaseStart) {
+            n = std::min(end, releaseStart) - frame;
+            if (sourceChannels == channels) {
+                mixPlain(output, source, n * channels, gain);
+            } else {
+                mixPlainUpmixed(output, source, n, channels, gain);
+            }
+        } else {
+            n = end - frame;
+            mixEnveloped(output, source, n, sourceChannels, channels, envelope->getRelease() + (frame + releaseFrames - totalFrames), gain);
+        }
+        output += n * channels;
+        frame += n;
+    }
+
+    position = frame * sourceChannels;
+    if (frame >= totalFrames) {
+        samples = nullptr;
+        started = false;
+    }
+}
+
+float Voice::getRemainingEnergy() const
+{
+    if (!isActive()) {
+        return 0.0f;
+    }
+    if (loudness == nullptr) {
+        // Without analysis, the longer a clip has played the less is left.
+        return (float) (length - position);
+    }
+    return loudness->getRemainingEnergy(position, length);
+}
+
+float Voice::getGain(std::uint64_t frame) const
+{
+    const std::uint64_t totalFrames = length / sourceChannels;
+    const std::uint64_t releaseFrames = envelope->getReleaseFrames();
+
+    float gain = 1.0f;
+    if (frame < envelope->getAttackFrames()) {
+        gain *= envelope->getAttack()[frame];
+    }
+    if (frame < totalFrames && frame + releaseFrames >= totalFrames) {
+        gain *= envelope->getRelease()[frame + releaseFrames - totalFrames];
+    }
+    return gain;
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "SoundClip.h"
+
+class Envelope;
+struct ClipLoudness;
+
+/*
+ * A clip being mixed into the output.
+ */
+struct Voice {
+
+    /*
+     * A sound cut off before its end, fading out over the release of its envelope.
+     */
+    struct Tail {
+        const std::int16_t* samples = nullptr;
+        std::uint64_t length = 0;
+        std::uint64_t position = 0;
+        const float* release = nullptr;
+        std::uint64_t releaseFrames = 0;
+        std::uint64_t releasePosition = 0;
+        int sourceChannels = 1;
+        // Gain of the sound when it was cut off.
+        float gain = 1.0f;
+
+        bool isActive() const {
+            return samples != nullptr;
+        }
+
+        void stop() {
+            samples = nullptr;
+        }
+
+        void mix(float* output, std::uint64_t frames, int channels);
+    };
+
+    const std::int16_t* samples = nullptr;
+    // Length and position in samples, not frames.
+    std::uint64_t length = 0;
+    std::uint64_t position = 0;
+    // Channels of the clip and of the output, a mono clip being upmixed.
+    int sourceChannels = 1;
+    int channels = 0;
+    const Envelope* envelope = nullptr;
+    const ClipLoudness* loudness = nullptr;
+    // Normalization gain of the clip.
+    float gain = 1.0f;
+
+    // Output frame of the key event, and the frame the clip should start at.
+    std::uint64_t inputFrame = 0;
+    std::uint64_t startFrame = 0;
+    bool started = false;
+
+    Tail tail;
+
+    // Output of tails released before the current one, still to be mixed,
+    // so that no fade out is cut short.
+    std::vector<float> residue;
+    std::uint64_t residueFrames = 0;
+    std::uint64_t residuePosition = 0;
+
+    bool isActive() const {
+        return samples != nullptr;
+    }
+
+    bool isFading() const {
+        return tail.isActive() || residuePosition < residueFrames;
+    }
+
+    // Neither playing nor fading out.
+    bool isSilent() const {
+        return !isActive() && !isFading();
+    }
+
+    void start(
+        const SoundClip& clip,
+        int sourceChannels,
+        int channels,
+        const Envelope* envelope,
+        std::uint64_t inputFrame,
+        std::uint64_t startFrame);
+
+    // Fades out the playing sound instead of cutting it off.
+    void release();
+
+    // Makes room for the output of a tail, before the voice plays.
+    void reserveResidue(std::uint64_t releaseFrames, int channels);
+
+    // Renders the rest of the tail into the residue, so that it no longer
+    // needs its clip and a new tail may take its place.
+    void settleTail(int channels);
+
+    // Adds up to the given number of frames of fading sounds to output.
+    void mixTails(float* output, std::uint64_t frames, int channels);
+
+    void stop();
+
+    // Energy of the part of the clip still to be played, zero once silent.
+    float getRemainingEnergy() const;
+
+    // Adds up to the given number of frames to output.
+    void mix(float* output, std::uint64_t frames);
+
+private:
+
+    float getGain(std::uint64_t frame) const;
+};
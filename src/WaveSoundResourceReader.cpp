@@ -14,41 +14,132 @@
  * limitations under the License.
  */
 #include "WaveSoundResourceReader.h"
+#include "FilePrefetcher.h"
+#include "SampleConverter.h"
 #include "SoundResource.h"
+#include "Trace.h"
 
-static bool fourcc(const BYTE* t, char c1, char c2, char c3, char c4) {
+static bool fourcc(const std::uint8_t* t, char c1, char c2, char c3, char c4) {
     return t[0] == c1 && t[1] == c2 && t[2] == c3 && t[3] == c4;
 }
 
 struct Chunk {
-    BYTE chunkType[4];
-    DWORD chunkSize;
+    std::uint8_t chunkType[4];
+    std::uint32_t chunkSize;
 
-    boolean hasType(char c1, char c2, char c3, char c4) {
+    bool hasType(char c1, char c2, char c3, char c4) {
         return fourcc(chunkType, c1, c2, c3, c4);
     }
 };
 
 struct RiffChunk : Chunk {
-    BYTE fileType[4];
+    std::uint8_t fileType[4];
 };
 
-WaveSoundResourceReader::WaveSoundResourceReader(FILE* file)
-:   file(file)
+static const std::uint16_t FORMAT_PCM = 0x0001;
+static const std::uint16_t FORMAT_IEEE_FLOAT = 0x0003;
+static const std::uint16_t FORMAT_EXTENSIBLE = 0xFFFE;
+
+// WAVEFORMATEXTENSIBLE, of which plain format chunks fill only the first 16 bytes.
+struct WaveFormat {
+    std::uint16_t formatTag;
+    std::uint16_t numberOfChannels;
+    std::uint32_t samplingRate;
+    std::uint32_t bytesPerSec;
+    std::uint16_t blockAlign;
+    std::uint16_t bitsPerSample;
+    std::uint16_t extensionSize;
+    std::uint16_t validBitsPerSample;
+    std::uint32_t channelMask;
+    std::uint8_t subFormat[16];
+};
+
+static const std::uint32_t MIN_FORMAT_SIZE = 16;
+
+static bool getSampleFormat(const WaveFormat& format, SampleFormat* sampleFormat)
+{
+    std::uint16_t formatTag = format.formatTag;
+    if (formatTag == FORMAT_EXTENSIBLE) {
+        // The sub-format GUID starts with the plain format tag.
+        formatTag = format.subFormat[0] | (format.subFormat[1] << 8);
+    }
+
+    if (formatTag == FORMAT_PCM) {
+        switch (format.bitsPerSample) {
+            case 8: *sampleFormat = SampleFormat::UNSIGNED_8; return true;
+            case 16: *sampleFormat = SampleFormat::SIGNED_16; return true;
+            case 24: *sampleFormat = SampleFormat::SIGNED_24; return true;
+            case 32: *sampleFormat = SampleFormat::SIGNED_32; return true;
+        }
+    } else if (formatTag == FORMAT_IEEE_FLOAT && format.bitsPerSample == 32) {
+        *sampleFormat = SampleFormat::FLOAT_32;
+        return true;
+    }
+
+    return false;
+}
+
+static SoundResource* createResource(const WaveFormat& format, std::uint8_t* data, std::uint32_t dataSize)
+{
+    SampleFormat sampleFormat;
+    if (!getSampleFormat(format, &sampleFormat) || format.numberOfChannels == 0) {
+        std::cerr << "Unsupported wave format " << format.formatTag
+                  << " with " << format.bitsPerSample << " bits per sample" << std::endl;
+        delete [] data;
+        return nullptr;
+    }
+
+    if (sampleFormat == SampleFormat::SIGNED_16) {
+        return new SoundResource(format.numberOfChannels, format.samplingRate, 16, data, dataSize);
+    }
+
+    TRACE_ZONE("WaveSoundResourceReader::convert");
+
+    // Drops any trailing partial frame.
+    std::size_t frameSize = (std::size_t) SampleConverter::getBytesPerSample(sampleFormat) * format.numberOfChannels;
+    std::size_t count = (dataSize / frameSize) * format.numberOfChannels;
+
+    std::uint32_t convertedSize = (std::uint32_t) (count * sizeof(std::int16_t));
+    std::uint8_t* converted = new std::uint8_t[convertedSize];
+    SampleConverter::toSigned16(sampleFormat, data, count, reinterpret_cast<std::int16_t*>(converted));
+    delete [] data;
+
+    return new SoundResource(format.numberOfChannels, format.samplingRate, 16, converted, convertedSize);
+}
+
+WaveSoundResourceReader::WaveSoundResourceReader(FilePrefetcher* prefetcher)
+:   prefetcher(prefetcher),
+    memory(prefetcher->getData()),
+    memorySize(prefetcher->getSize()),
+    position(0),
+    waitMicros(0)
+{
+}
+
+WaveSoundResourceReader::WaveSoundResourceReader(const std::uint8_t* memory, std::size_t memorySize)
+:   prefetcher(nullptr),
+    memory(memory),
+    memorySize(memorySize),
+    position(0),
+    waitMicros(0)
 {
 }
 
 WaveSoundResourceReader::~WaveSoundResourceReader()
 {
-    ::fclose(file);
+    if (prefetcher != nullptr) {
+        delete prefetcher;
+    }
 }
 
 SoundResource* WaveSoundResourceReader::read()
 {
+    TRACE_ZONE("WaveSoundResourceReader::read");
+
     RiffChunk chunk{};
 
     if (!readRiffHeader(&chunk)) {
-        return false;
+        return nullptr;
     }
 
     return readRiffBody(chunk.chunkSize - 4);
@@ -56,7 +147,7 @@ SoundResource* WaveSoundResourceReader::read()
 
 bool WaveSoundResourceReader::readRiffHeader(RiffChunk* chunk)
 {
-    if (::fread(chunk, sizeof(RiffChunk), 1, file) != 1) {
+    if (!readBytes(chunk, sizeof(RiffChunk))) {
         return false;
     }
 
@@ -69,7 +160,7 @@ bool WaveSoundResourceReader::readRiffHeader(RiffChunk* chunk)
 
 SoundResource* WaveSoundResourceReader::readRiffBody(long bodySize)
 {
-    WAVEFORMATEXTENSIBLE format{};
+    WaveFormat format{};
     std::uint8_t* data = nullptr;
     std::uint32_t dataSize = 0;
 
@@ -81,27 +172,41 @@ SoundResource* WaveSoundResourceReader::readRiffBody(long bodySize)
 
     while (offset < bodySize) {
 
-        if (::fread(&chunk, sizeof(chunk), 1, file) != 1) {
-            return false;
+        if (!readBytes(&chunk, sizeof(chunk))) {
+            break;
         }
 
         offset += sizeof(chunk);
         long paddedSize = ((chunk.chunkSize + 1) / 2) * 2;
 
         if (chunk.hasType('f', 'm', 't', ' ')) {
-            if (::fread(&format, chunk.chunkSize, 1, file) != 1) {
+            if (chunk.chunkSize < MIN_FORMAT_SIZE) {
+                break;
+            }
+            long formatSize = std::min<long>(chunk.chunkSize, sizeof(format));
+            if (!readBytes(&format, formatSize)) {
+                break;
+            }
+            if (!skipBytes(paddedSize - formatSize)) {
                 break;
             }
             chunksProcessed++;
         } else if (chunk.hasType('d', 'a', 't', 'a')) {
+            // Sizes are not trusted before anything is allocated for them.
+            if (data != nullptr || chunk.chunkSize > memorySize - position) {
+                break;
+            }
             data = new std::uint8_t[chunk.chunkSize];
             dataSize = chunk.chunkSize;
-            if (::fread(data, dataSize, 1, file) != 1) {
+            if (!readBytes(data, dataSize)) {
+                break;
+            }
+            if (!skipBytes(paddedSize - dataSize)) {
                 break;
             }
             chunksProcessed++;
         } else {
-            if (::fseek(file, paddedSize, SEEK_CUR) != 0) {
+            if (!skipBytes(paddedSize)) {
                 break;
             }
         }
@@ -109,12 +214,7 @@ SoundResource* WaveSoundResourceReader::readRiffBody(long bodySize)
         offset += paddedSize;
 
         if (chunksProcessed >= 2) {
-            return new SoundResource(
-                format.Format.nChannels,
-                format.Format.nSamplesPerSec,
-                format.Format.wBitsPerSample,
-                data,
-                dataSize);
+            return createResource(format, data, dataSize);
         }
     }
 
@@ -125,3 +225,23 @@ SoundResource* WaveSoundResourceReader::readRiffBody(long bodySize)
     return nullptr;
 }
 
+
+bool WaveSoundResourceReader::readBytes(void* buffer, std::size_t count)
+{
+    if (count > memorySize - position) {
+        return false;
+    }
+    if (prefetcher != nullptr && !prefetcher->waitFor(position, count, waitMicros)) {
+        return false;
+    }
+    std::memcpy(buffer, memory + position, count);
+    position += count;
+    return true;
+}
+
+// Skipping past the end is left to the next read to detect.
+bool WaveSoundResourceReader::skipBytes(long count)
+{
+    position = std::min(memorySize, position + count);
+    return true;
+}
@@ -18,22 +18,41 @@
 #include "SoundResourceReader.h"
 
 class RiffChunk;
+class FilePrefetcher;
 
 class WaveSoundResourceReader: public SoundResourceReader {
 private:
 
-    FILE* file;
+    // Reads the file ahead of the chunks, if there is one.
+    FilePrefetcher* prefetcher;
+
+    const std::uint8_t* memory;
+    std::size_t memorySize;
+    std::size_t position;
+
+    std::uint64_t waitMicros;
 
 public:
 
-    WaveSoundResourceReader(FILE* file);
+    WaveSoundResourceReader(FilePrefetcher* prefetcher);
+
+    // The memory must outlive the reader.
+    WaveSoundResourceReader(const std::uint8_t* memory, std::size_t memorySize);
 
     virtual ~WaveSoundResourceReader();
 
     virtual SoundResource* read();
 
+    virtual std::uint64_t getWaitMicros() {
+        return waitMicros;
+    }
+
 private:
 
     bool readRiffHeader(RiffChunk* chunk);
     SoundResource* readRiffBody(long bodySize);
+
+    bool readBytes(void* buffer, std::size_t count);
+
+    bool skipBytes(long count);
 };
@@ -16,12 +16,24 @@
 #include "Window.h"
 #include "resource.h"
 #include "SoundPlayer.h"
+#include "KeyTrace.h"
+#include "KeyUsage.h"
+#include "FlightRecorder.h"
+#include "Trace.h"
 
 static const wchar_t CLASS_NAME[] = L"RoarWindow";
 static const GUID NOTIFICATION_GUID = {0xdcae2d01, 0x416c, 0x4743, { 0xb6, 0x1c, 0x6c, 0xbc, 0xd1, 0x84, 0x67, 0x20}};
 
 static const UINT WM_NOTIFICATION_CALLBACK = WM_APP + 1;
 
+// Checks whether the audio output has been idle long enough to suspend it.
+static const UINT_PTR IDLE_TIMER_ID = 1;
+static const UINT IDLE_TIMER_MILLIS = 1000;
+
+// Saves the key usage now and then, so that little is lost if roar does not exit cleanly.
+static const UINT_PTR USAGE_TIMER_ID = 2;
+static const UINT USAGE_TIMER_MILLIS = 5 * 60 * 1000;
+
 void Window::registerClass(HINSTANCE module) {
     WNDCLASSEXW wc{};
     wc.cbSize = sizeof(wc);
@@ -35,6 +47,7 @@ void Window::registerClass(HINSTANCE module) {
 }
 
 Window* Window::create(const wchar_t* title, SoundPlayer* soundPlayer, HINSTANCE module) {
+    TRACE_ZONE("Window::create");
 
     Window* window = new Window(module, soundPlayer);
     window->createWindow(title);
@@ -46,11 +59,14 @@ Window::Window(HINSTANCE module, SoundPlayer* soundPlayer)
 :   module(module),
     handle(nullptr),
     notificationIcon(nullptr),
-    soundPlayer(soundPlayer) {
+    soundPlayer(soundPlayer),
+    traceWriter(nullptr),
+    keyUsage(nullptr) {
 }
 
 Window::~Window() {
-    keyState.clear();
+    keyState.reset();
+    setTraceWriter(nullptr);
 }
 
 bool Window::createWindow(const wchar_t* title) {
@@ -69,6 +85,7 @@ bool Window::createWindow(const wchar_t* title) {
         this
     );
 
+    TRACE_ZONE("RegisterRawInputDevices");
     RAWINPUTDEVICE device = {
         0x01,  // generic
         0x06,  // keyboard
@@ -90,12 +107,30 @@ void Window::show(int state) {
     ::ShowWindow(this->handle, state);
 }
 
+void Window::setTraceWriter(KeyTraceWriter* traceWriter) {
+    if (this->traceWriter != nullptr) {
+        delete this->traceWriter;
+    }
+    this->traceWriter = traceWriter;
+}
+
+void Window::setKeyUsage(KeyUsage* keyUsage) {
+    this->keyUsage = keyUsage;
+}
+
 LRESULT Window::handleMessage(UINT msg, WPARAM wParam, LPARAM lParam) {
     switch (msg) {
         case WM_CREATE:
             addNotificationIcon();
+            ::SetTimer(this->handle, IDLE_TIMER_ID, IDLE_TIMER_MILLIS, nullptr);
+            ::SetTimer(this->handle, USAGE_TIMER_ID, USAGE_TIMER_MILLIS, nullptr);
             break;
         case WM_DESTROY:
+            ::KillTimer(this->handle, IDLE_TIMER_ID);
+            ::KillTimer(this->handle, USAGE_TIMER_ID);
+            if (keyUsage != nullptr) {
+                keyUsage->save();
+            }
             deleteNotificationIcon();
             ::PostQuitMessage(0);
             break;
@@ -105,8 +140,11 @@ LRESULT Window::handleMessage(UINT msg, WPARAM wParam, LPARAM lParam) {
             }
             break;
         case WM_INPUT:
-            handleRawInput((HRAWINPUT) lParam);
+            handleRawInput((HRAWINPUT) lParam, ::GetMessageTime());
             break;
+        case WM_TIMER:
+            handleTimer(wParam);
+            return 0;
         case WM_NOTIFICATION_CALLBACK:
             return handleNotificationMessage(msg, wParam, lParam);
     }
@@ -128,6 +166,9 @@ LRESULT Window::handleNotificationMessage(UINT msg, WPARAM wParam, LPARAM lParam
 
 bool Window::handleCommand(WPARAM wParam, LPARAM lParam) {
     switch (LOWORD(wParam)) {
+        case IDM_SAVE_FLIGHT_RECORDING:
+            FlightRecorder::get().dump();
+            return true;
         case IDM_EXIT:
             destroy();
             return true;
@@ -135,18 +176,23 @@ bool Window::handleCommand(WPARAM wParam, LPARAM lParam) {
     return false;
 }
 
-void Window::handleRawInput(HRAWINPUT rawInputHandle) {
+void Window::handleRawInput(HRAWINPUT rawInputHandle, LONG messageTime) {
     RAWINPUT rawInput;
     UINT bufferSize = sizeof(rawInput);
 
     if (::GetRawInputData(rawInputHandle, RID_INPUT, &rawInput, &bufferSize, sizeof(RAWINPUTHEADER))) {
         if (rawInput.header.dwType == RIM_TYPEKEYBOARD) {
-            handleKeyboardEvent(rawInput.data.keyboard);
+            // The message time is in the tick count clock, so the key event is dated
+            // by how long the message has been waiting in the queue.
+            const DWORD age = ::GetTickCount() - static_cast<DWORD>(messageTime);
+            const std::uint64_t now = soundPlayer->getTime();
+            const std::uint64_t delay = static_cast<std::uint64_t>(age) * 1000;
+            handleKeyboardEvent(rawInput.data.keyboard, delay < now ? now - delay : 0);
         }
      }
 }
 
-void Window::handleKeyboardEvent(const RAWKEYBOARD& keyboard) {
+void Window::handleKeyboardEvent(const RAWKEYBOARD& keyboard, std::uint64_t timestamp) {
     std::uint16_t scanCode = keyboard.MakeCode & 0x00ff;
     if (keyboard.Flags & RI_KEY_E0) {
         scanCode |= 0xe000;
@@ -154,11 +200,22 @@ void Window::handleKeyboardEvent(const RAWKEYBOARD& keyboard) {
         scanCode |= 0xe100;
     }
 
-    if ((keyboard.Flags & RI_KEY_BREAK) == 0) {
+    const bool down = (keyboard.Flags & RI_KEY_BREAK) == 0;
+
+    if (traceWriter != nullptr) {
+        traceWriter->record(scanCode, down);
+    }
+
+    FlightRecorder::get().record(down ? FlightEventType::KEY_DOWN : FlightEventType::KEY_UP, scanCode);
+
+    if (down) {
         // key down
         if (!keyState[scanCode]) {
             keyState[scanCode] = true;
-            soundPlayer->playSound(scanCode);
+            soundPlayer->playSound(scanCode, timestamp);
+            if (keyUsage != nullptr) {
+                keyUsage->count(scanCode);
+            }
         }
     } else {
         // key up
@@ -166,6 +223,15 @@ void Window::handleKeyboardEvent(const RAWKEYBOARD& keyboard) {
     }
 }
 
+void Window::handleTimer(WPARAM id) {
+    if (id == IDLE_TIMER_ID) {
+        soundPlayer->suspendIfIdle();
+        soundPlayer->trimIfIdle();
+    } else if (id == USAGE_TIMER_ID && keyUsage != nullptr) {
+        keyUsage->save();
+    }
+}
+
 LRESULT Window::callDefaultHandler(UINT msg, WPARAM wParam, LPARAM lParam) {
     return ::DefWindowProcW(this->handle, msg, wParam, lParam);
 }
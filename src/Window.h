@@ -16,6 +16,8 @@
 #pragma once
 
 class SoundPlayer;
+class KeyTraceWriter;
+class KeyUsage;
 
 class Window {
 private:
@@ -27,7 +29,14 @@ private:
 
     SoundPlayer* soundPlayer;
 
-    std::unordered_map<int, bool> keyState;
+    // Records keyboard events if enabled.
+    KeyTraceWriter* traceWriter;
+
+    // Counts key presses if enabled, not owned.
+    KeyUsage* keyUsage;
+
+    // Indexed by scan code, preallocated to keep key events free of allocations.
+    std::bitset<0x10000> keyState;
 
 public:
 
@@ -44,6 +53,10 @@ public:
 
     void show(int state);
 
+    void setTraceWriter(KeyTraceWriter* traceWriter);
+
+    void setKeyUsage(KeyUsage* keyUsage);
+
 private:
 
     Window(HINSTANCE module, SoundPlayer* soundPlayer);
@@ -56,9 +69,11 @@ private:
 
     bool handleCommand(WPARAM wParam, LPARAM lParam);
 
-    void handleRawInput(HRAWINPUT rawInput);
+    void handleRawInput(HRAWINPUT rawInput, LONG messageTime);
+
+    void handleKeyboardEvent(const RAWKEYBOARD& keyboard, std::uint64_t timestamp);
 
-    void handleKeyboardEvent(const RAWKEYBOARD& keyboard);
+    void handleTimer(WPARAM id);
 
     LRESULT callDefaultHandler(UINT msg, WPARAM wParam, LPARAM lParam);
 
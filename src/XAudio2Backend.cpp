@@ -0,0 +1,221 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "XAudio2Backend.h"
+#include "Trace.h"
+#include "FlightRecorder.h"
+
+XAudio2Backend* XAudio2Backend::create(int blockFrames, int bufferCount) {
+    TRACE_ZONE("XAudio2Backend::create");
+
+    IXAudio2* audio = nullptr;
+    HRESULT hr = XAudio2Create(&audio, 0, XAUDIO2_DEFAULT_PROCESSOR);
+    if (FAILED(hr)) {
+        return nullptr;
+    }
+
+    IXAudio2MasteringVoice* masterVoice = nullptr;
+    hr = audio->CreateMasteringVoice(&masterVoice);
+    if (FAILED(hr)) {
+        audio->Release();
+        return nullptr;
+    }
+
+    if (blockFrames != 0) {
+        blockFrames = std::max(MIN_BLOCK_FRAMES, std::min(blockFrames, MAX_BLOCK_FRAMES));
+    }
+    bufferCount = std::max(2, std::min(bufferCount, MAX_BUFFER_COUNT));
+    return new XAudio2Backend(audio, masterVoice, blockFrames, bufferCount);
+}
+
+XAudio2Backend::XAudio2Backend(IXAudio2* audio, IXAudio2MasteringVoice* masterVoice, int blockFrames, int bufferCount)
+:   audio(audio),
+    masterVoice(masterVoice),
+    source(nullptr),
+    renderer(nullptr),
+    format{0, 0},
+    requestedBlockFrames(blockFrames),
+    bufferCount(bufferCount),
+    blockFrames(0),
+    nextBuffer(0),
+    running(false),
+    suspended(false),
+    framePosition(0),
+    underruns(0),
+    sourceStartFrame(0),
+    outputDelay(0) {
+}
+
+XAudio2Backend::~XAudio2Backend() {
+
+    close();
+
+    if (masterVoice != nullptr) {
+        masterVoice->DestroyVoice();
+        masterVoice = nullptr;
+    }
+
+    if (audio != nullptr) {
+        audio->Release();
+        audio = nullptr;
+    }
+}
+
+bool XAudio2Backend::open(const AudioFormat& format, AudioRenderer* renderer) {
+    TRACE_ZONE("XAudio2Backend::open");
+
+    close();
+
+    this->format = format;
+    this->renderer = renderer;
+    blockFrames = (requestedBlockFrames > 0) ? requestedBlockFrames : format.samplingRate * DEFAULT_BLOCK_MILLIS / 1000;
+    buffers.assign((size_t) bufferCount * blockFrames * format.numberOfChannels, 0.0f);
+    framePosition = 0;
+
+    if (!startSource()) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void XAudio2Backend::close() {
+    stopSource();
+
+    if (suspended) {
+        audio->StartEngine();
+        suspended = false;
+    }
+
+    renderer = nullptr;
+}
+
+/*
+ * Destroys the source voice and stops the engine thread,
+ * so that nothing wakes up while no sound is playing.
+ */
+void XAudio2Backend::suspend() {
+    if (source == nullptr || suspended) {
+        return;
+    }
+
+    stopSource();
+    audio->StopEngine();
+    suspended = true;
+}
+
+bool XAudio2Backend::resume() {
+    if (!suspended) {
+        return source != nullptr;
+    }
+
+    // Stays suspended on failure, so that the next key tries again.
+    HRESULT hr = audio->StartEngine();
+    if (FAILED(hr)) {
+        return false;
+    }
+
+    // The frame position carries on from where the output stopped.
+    if (!startSource()) {
+        audio->StopEngine();
+        return false;
+    }
+
+    suspended = false;
+    return true;
+}
+
+bool XAudio2Backend::startSource() {
+    WAVEFORMATEX waveFormat{
+        WAVE_FORMAT_IEEE_FLOAT,
+        (WORD) format.numberOfChannels,
+        (DWORD) format.samplingRate,
+        (DWORD) (format.samplingRate * format.numberOfChannels * sizeof(float)),
+        (WORD) (format.numberOfChannels * sizeof(float)),
+        32,
+        0
+    };
+
+    HRESULT hr = audio->CreateSourceVoice(&source, &waveFormat, 0, XAUDIO2_DEFAULT_FREQ_RATIO, this);
+    if (FAILED(hr)) {
+        source = nullptr;
+        return false;
+    }
+
+    nextBuffer = 0;
+    running = true;
+    // The voice counts the samples it played from zero.
+    sourceStartFrame = framePosition;
+    outputDelay = 0;
+
+    for (int i = 0; i < bufferCount; i++) {
+        submitBlock();
+    }
+
+    hr = source->Start(0);
+    if (FAILED(hr)) {
+        stopSource();
+        return false;
+    }
+
+    return true;
+}
+
+void XAudio2Backend::stopSource() {
+    running = false;
+
+    if (source != nullptr) {
+        source->Stop(0);
+        // Blocks until the voice stops calling back.
+        source->DestroyVoice();
+        source = nullptr;
+    }
+}
+
+std::uint64_t XAudio2Backend::getTime() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+}
+
+void XAudio2Backend::OnBufferEnd(void * pBufferContext) {
+    if (running) {
+        XAUDIO2_VOICE_STATE state{};
+        source->GetState(&state, 0);
+        if (state.BuffersQueued == 0) {
+            underruns++;
+            FlightRecorder::get().record(FlightEventType::UNDERRUN, 0, (std::uint32_t) framePosition);
+        }
+        std::uint64_t played = sourceStartFrame + state.SamplesPlayed;
+        outputDelay = (framePosition > played) ? framePosition - played : 0;
+        submitBlock();
+    }
+}
+
+bool XAudio2Backend::submitBlock() {
+    const int samplesPerBlock = blockFrames * format.numberOfChannels;
+    float* block = buffers.data() + (size_t) nextBuffer * samplesPerBlock;
+    nextBuffer = (nextBuffer + 1) % bufferCount;
+
+    renderer->render(block, blockFrames);
+    framePosition += blockFrames;
+
+    XAUDIO2_BUFFER buffer{};
+    buffer.AudioBytes = samplesPerBlock * sizeof(float);
+    buffer.pAudioData = reinterpret_cast<const BYTE*>(block);
+
+    FlightRecorder::get().record(FlightEventType::BUFFER_SUBMIT, (std::uint16_t) blockFrames, (std::uint32_t) framePosition);
+    return SUCCEEDED(source->SubmitSourceBuffer(&buffer));
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "AudioBackend.h"
+
+/*
+ * Streams the rendered blocks through a single XAudio2 source voice.
+ */
+class XAudio2Backend: public AudioBackend, public IXAudio2VoiceCallback {
+private:
+
+    static constexpr int MAX_BUFFER_COUNT = 16;
+    static constexpr int DEFAULT_BLOCK_MILLIS = 10;
+    static constexpr int MIN_BLOCK_FRAMES = 16;
+    static constexpr int MAX_BLOCK_FRAMES = 8192;
+
+    IXAudio2* audio;
+    IXAudio2MasteringVoice* masterVoice;
+    IXAudio2SourceVoice* source;
+
+    AudioRenderer* renderer;
+    AudioFormat format;
+
+    // Frames per block, zero for the default length, and blocks in flight.
+    const int requestedBlockFrames;
+    const int bufferCount;
+
+    int blockFrames;
+    std::vector<float> buffers;
+    int nextBuffer;
+
+    std::atomic<bool> running;
+    // The engine is stopped and the source voice destroyed.
+    bool suspended;
+    std::atomic<std::uint64_t> framePosition;
+    std::atomic<std::uint64_t> underruns;
+    // Frame position when the source voice started counting played samples.
+    std::uint64_t sourceStartFrame;
+    std::atomic<std::uint64_t> outputDelay;
+
+public:
+
+    static constexpr int DEFAULT_BUFFER_COUNT = 3;
+
+    // Blocks of the given number of frames, 10 ms by default, with the given number queued.
+    static XAudio2Backend* create(int blockFrames = 0, int bufferCount = DEFAULT_BUFFER_COUNT);
+
+    virtual ~XAudio2Backend();
+
+    virtual bool open(const AudioFormat& format, AudioRenderer* renderer);
+
+    virtual void close();
+
+    virtual std::uint64_t getFramePosition() {
+        return framePosition;
+    }
+
+    virtual std::uint64_t getTime();
+
+    virtual std::uint64_t getUnderruns() {
+        return underruns;
+    }
+
+    virtual std::uint64_t getOutputDelay() {
+        return outputDelay;
+    }
+
+    virtual void suspend();
+
+    virtual bool resume();
+
+    virtual bool isSuspended() {
+        return suspended;
+    }
+
+    virtual void OnBufferEnd(void * pBufferContext);
+
+    // Callbacks to ignore.
+    virtual void OnStreamEnd() {}
+    virtual void OnVoiceProcessingPassEnd() {}
+    virtual void OnVoiceProcessingPassStart(UINT32 SamplesRequired) {}
+    virtual void OnBufferStart(void * pBufferContext) {}
+    virtual void OnLoopEnd(void * pBufferContext) {}
+    virtual void OnVoiceError(void * pBufferContext, HRESULT Error) {}
+
+private:
+
+    XAudio2Backend(IXAudio2* audio, IXAudio2MasteringVoice* masterVoice, int blockFrames, int bufferCount);
+
+    bool startSource();
+
+    void stopSource();
+
+    bool submitBlock();
+};
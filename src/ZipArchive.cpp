@@ -0,0 +1,233 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "ZipArchive.h"
+#include "MappedFile.h"
+#include "Trace.h"
+#include <zlib.h>
+
+static const std::uint32_t END_OF_CENTRAL_DIRECTORY = 0x06054b50;
+static const std::uint32_t CENTRAL_FILE_HEADER = 0x02014b50;
+static const std::uint32_t LOCAL_FILE_HEADER = 0x04034b50;
+
+static const std::size_t END_OF_CENTRAL_DIRECTORY_SIZE = 22;
+static const std::size_t CENTRAL_FILE_HEADER_SIZE = 46;
+static const std::size_t LOCAL_FILE_HEADER_SIZE = 30;
+static const std::size_t MAX_COMMENT_SIZE = 0xffff;
+
+static const std::uint16_t FLAG_ENCRYPTED = 0x0001;
+
+// Deflate expands no byte into more than 258 bytes of output, by about 1032:1 at best.
+static const std::uint64_t MAX_DEFLATE_RATIO = 1032;
+
+// Far larger than any sound file of a pack.
+static const std::uint64_t MAX_ENTRY_SIZE = 512 * 1024 * 1024;
+
+// Fields of zip archives are little endian and unaligned.
+static std::uint16_t read16(const std::uint8_t* p)
+{
+    return (std::uint16_t) (p[0] | (p[1] << 8));
+}
+
+static std::uint32_t read32(const std::uint8_t* p)
+{
+    return (std::uint32_t) read16(p) | ((std::uint32_t) read16(p + 2) << 16);
+}
+
+ZipArchive* ZipArchive::open(const std::filesystem::path& path)
+{
+    TRACE_ZONE("ZipArchive::open");
+
+    MappedFile* file = MappedFile::open(path);
+    if (file == nullptr) {
+        return nullptr;
+    }
+
+    auto archive = new ZipArchive(file);
+    if (!archive->readCentralDirectory()) {
+        delete archive;
+        return nullptr;
+    }
+    return archive;
+}
+
+ZipArchive::ZipArchive(MappedFile* file)
+:   file(file)
+{
+}
+
+ZipArchive::~ZipArchive()
+{
+    if (file != nullptr) {
+        delete file;
+        file = nullptr;
+    }
+}
+
+const ZipArchive::Entry* ZipArchive::find(const std::string& name)
+{
+    for (const auto& entry : entries) {
+        if (entry.name == name) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+const std::uint8_t* ZipArchive::read(const Entry& entry, std::vector<std::uint8_t>& buffer)
+{
+    const std::uint8_t* data = getCompressedData(entry);
+    if (data == nullptr) {
+        return nullptr;
+    }
+
+    if (entry.method == METHOD_STORED) {
+        if (entry.compressedSize != entry.size || ::crc32(0L, data, entry.size) != entry.crc) {
+            return nullptr;
+        }
+        return data;
+    }
+
+    if (entry.method == METHOD_DEFLATED) {
+        // The sizes are not trusted with an allocation before they are checked.
+        if (entry.size > MAX_ENTRY_SIZE || entry.size > entry.compressedSize * MAX_DEFLATE_RATIO) {
+            return nullptr;
+        }
+        TRACE_ZONE("ZipArchive::inflate");
+        buffer.resize(entry.size);
+        if (inflate(data, entry, buffer.data())) {
+            return buffer.data();
+        }
+    }
+
+    return nullptr;
+}
+
+/*
+ * Finds the end of central directory record, which is followed only by
+ * the comment of the archive, and lists the entries it points to.
+ * Neither multiple disks nor ZIP64 are supported.
+ */
+bool ZipArchive::readCentralDirectory()
+{
+    const std::uint8_t* data = file->getData();
+    const std::size_t size = file->getSize();
+    if (size < END_OF_CENTRAL_DIRECTORY_SIZE) {
+        return false;
+    }
+
+    const std::uint8_t* end = nullptr;
+    std::size_t lowest = (size > END_OF_CENTRAL_DIRECTORY_SIZE + MAX_COMMENT_SIZE)
+        ? size - END_OF_CENTRAL_DIRECTORY_SIZE - MAX_COMMENT_SIZE
+        : 0;
+    for (std::size_t offset = size - END_OF_CENTRAL_DIRECTORY_SIZE + 1; offset-- > lowest; ) {
+        if (read32(data + offset) == END_OF_CENTRAL_DIRECTORY) {
+            end = data + offset;
+            break;
+        }
+    }
+    if (end == nullptr) {
+        return false;
+    }
+
+    const std::uint16_t count = read16(end + 10);
+    const std::uint32_t directorySize = read32(end + 12);
+    const std::uint32_t directoryOffset = read32(end + 16);
+    if ((std::size_t) directoryOffset + directorySize > size) {
+        return false;
+    }
+
+    const std::uint8_t* p = data + directoryOffset;
+    const std::uint8_t* directoryEnd = p + directorySize;
+    entries.reserve(count);
+
+    for (int i = 0; i < count; i++) {
+        if (p + CENTRAL_FILE_HEADER_SIZE > directoryEnd || read32(p) != CENTRAL_FILE_HEADER) {
+            return false;
+        }
+
+        const std::uint16_t flags = read16(p + 8);
+        const std::uint16_t nameLength = read16(p + 28);
+        const std::uint16_t extraLength = read16(p + 30);
+        const std::uint16_t commentLength = read16(p + 32);
+        const std::uint8_t* next = p + CENTRAL_FILE_HEADER_SIZE + nameLength + extraLength + commentLength;
+        if (next > directoryEnd) {
+            return false;
+        }
+
+        Entry entry{
+            std::string(reinterpret_cast<const char*>(p + CENTRAL_FILE_HEADER_SIZE), nameLength),
+            read16(p + 10),
+            read32(p + 16),
+            read32(p + 20),
+            read32(p + 24),
+            read32(p + 42)
+        };
+
+        // Directories and encrypted files have no content to offer.
+        bool isDirectory = !entry.name.empty() && entry.name.back() == '/';
+        if (!isDirectory && (flags & FLAG_ENCRYPTED) == 0) {
+            entries.push_back(std::move(entry));
+        }
+
+        p = next;
+    }
+
+    return true;
+}
+
+// Skips the local header, whose extra field may differ from the central one.
+const std::uint8_t* ZipArchive::getCompressedData(const Entry& entry)
+{
+    const std::uint8_t* data = file->getData();
+    const std::size_t size = file->getSize();
+
+    std::size_t offset = entry.localHeaderOffset;
+    if (offset + LOCAL_FILE_HEADER_SIZE > size || read32(data + offset) != LOCAL_FILE_HEADER) {
+        return nullptr;
+    }
+
+    offset += LOCAL_FILE_HEADER_SIZE + read16(data + offset + 26) + read16(data + offset + 28);
+    if (offset + entry.compressedSize > size) {
+        return nullptr;
+    }
+    return data + offset;
+}
+
+/*
+ * Inflates the raw deflate stream of the entry straight into the output,
+ * which holds exactly the uncompressed size, and checks its CRC.
+ */
+bool ZipArchive::inflate(const std::uint8_t* input, const Entry& entry, std::uint8_t* output)
+{
+    z_stream stream{};
+    if (::inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+        return false;
+    }
+
+    stream.next_in = const_cast<Bytef*>(input);
+    stream.avail_in = entry.compressedSize;
+    stream.next_out = output;
+    stream.avail_out = entry.size;
+
+    int result = ::inflate(&stream, Z_FINISH);
+    const bool complete = result == Z_STREAM_END && stream.total_out == entry.size;
+    ::inflateEnd(&stream);
+
+    if (!complete) {
+        return false;
+    }
+    return ::crc32(0L, output, entry.size) == entry.crc;
+}
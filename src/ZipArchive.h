@@ -0,0 +1,71 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+class MappedFile;
+
+/*
+ * Zip archive mapped into memory. Stored entries are read in place,
+ * deflated ones are inflated into a buffer of the caller.
+ */
+class ZipArchive {
+public:
+
+    struct Entry {
+        std::string name;
+        std::uint16_t method;
+        std::uint32_t crc;
+        std::uint32_t compressedSize;
+        std::uint32_t size;
+        std::uint32_t localHeaderOffset;
+    };
+
+private:
+
+    static const std::uint16_t METHOD_STORED = 0;
+    static const std::uint16_t METHOD_DEFLATED = 8;
+
+    MappedFile* file;
+    std::vector<Entry> entries;
+
+public:
+
+    // Returns nullptr if the file is not a zip archive.
+    static ZipArchive* open(const std::filesystem::path& path);
+
+    ~ZipArchive();
+
+    const std::vector<Entry>& getEntries() {
+        return entries;
+    }
+
+    // Entry of the given path within the archive, or nullptr.
+    const Entry* find(const std::string& name);
+
+    // Contents of the entry, pointing either into the archive or into the buffer.
+    // Returns nullptr if the entry is damaged or compressed in an unsupported way.
+    const std::uint8_t* read(const Entry& entry, std::vector<std::uint8_t>& buffer);
+
+private:
+
+    ZipArchive(MappedFile* file);
+
+    bool readCentralDirectory();
+
+    const std::uint8_t* getCompressedData(const Entry& entry);
+
+    static bool inflate(const std::uint8_t* input, const Entry& entry, std::uint8_t* output);
+};
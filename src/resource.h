@@ -20,3 +20,4 @@
 #define IDI_NOTIFICATION_ICON 201
 #define IDC_CONTEXT_MENU 202
 #define IDM_EXIT 203
+#define IDM_SAVE_FLIGHT_RECORDING 204
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+/*
+ * Checks of the test executables, which report every failed check
+ * and exit with a non-zero status if any failed.
+ */
+namespace expect {
+
+inline int& failures() {
+    static int count = 0;
+    return count;
+}
+
+template<typename Actual, typename Expected>
+void equal(const Actual& actual, const Expected& expected, const char* expression, const char* file, int line) {
+    if (!(actual == expected)) {
+        std::cerr << file << ":" << line << ": " << expression
+            << " is " << actual << ", expected " << expected << std::endl;
+        failures()++;
+    }
+}
+
+inline void isTrue(bool condition, const char* expression, const char* file, int line) {
+    if (!condition) {
+        std::cerr << file << ":" << line << ": " << expression << " is false" << std::endl;
+        failures()++;
+    }
+}
+
+// Status to return from main.
+inline int status() {
+    if (failures() > 0) {
+        std::cerr << failures() << " check(s) failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+}
+
+#define EXPECT_EQ(actual, expected) expect::equal((actual), (expected), #actual, __FILE__, __LINE__)
+#define EXPECT_TRUE(condition) expect::isTrue((condition), #condition, __FILE__, __LINE__)
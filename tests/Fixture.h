@@ -0,0 +1,88 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "NullAudioBackend.h"
+#include "SoundPack.h"
+#include "SoundPlayer.h"
+
+/*
+ * Synthetic sound packs and players on the simulated clock, shared by
+ * the tests which play keys.
+ */
+
+static const int SAMPLING_RATE = 48000;
+static const int BLOCK_FRAMES = 480;
+
+/*
+ * A stereo pack with a constant clip of the given length for each key in
+ * turn. The channels differ, so that the pack is not folded to mono.
+ */
+inline SoundPack* createSoundPack(
+    const std::vector<int>& scanCodes,
+    int clipMillis,
+    int releaseMillis = Envelope::DEFAULT_RELEASE_MILLIS)
+{
+    const std::uint64_t frames = (std::uint64_t) SAMPLING_RATE * clipMillis / 1000 * scanCodes.size();
+    const std::uint64_t length = frames * 2 * sizeof(std::int16_t);
+    auto data = new std::uint8_t[length];
+    auto samples = reinterpret_cast<std::int16_t*>(data);
+    for (std::uint64_t i = 0; i < frames; i++) {
+        samples[i * 2] = 8192;
+        samples[i * 2 + 1] = 4096;
+    }
+
+    SoundResource resource(2, SAMPLING_RATE, 16, data, length);
+    SoundPack::SoundClipMap map;
+    int start = 0;
+    for (int scanCode : scanCodes) {
+        map[scanCode] = resource.slice(start, clipMillis);
+        start += clipMillis;
+    }
+    return new SoundPack(&resource, map, Envelope(SAMPLING_RATE, Envelope::DEFAULT_ATTACK_MILLIS, releaseMillis));
+}
+
+/*
+ * A player owning a backend which renders blocks on request.
+ */
+template<typename Backend = NullAudioBackend>
+struct Fixture {
+    Backend* backend;
+    SoundPlayer* player;
+
+    Fixture() {
+        backend = new Backend(BLOCK_FRAMES);
+        // Owns the backend.
+        player = SoundPlayer::create(backend);
+    }
+
+    ~Fixture() {
+        delete player;
+    }
+
+    // Renders for the given time, checking for idle output after each block.
+    void run(int millis) {
+        std::uint64_t end = backend->getFramePosition() + (std::uint64_t) SAMPLING_RATE * millis / 1000;
+        while (backend->getFramePosition() < end) {
+            backend->renderBlock();
+            player->suspendIfIdle();
+        }
+    }
+
+    std::uint64_t getMetric(std::atomic<std::uint64_t> Metrics::* metric) {
+        return (player->getMetrics().*metric).load();
+    }
+};
@@ -0,0 +1,148 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "Expect.h"
+#include "Fixture.h"
+#include "AllocationGuard.h"
+#include "KeyTrace.h"
+
+/*
+ * Replays a burst of typing, a mash of keys, an auto repeated key and a
+ * flood, checking that nothing allocates from the heap between the key
+ * events and the output.
+ */
+
+static const int CLIP_MILLIS = 150;
+
+// A clip of its own for every key of the trace.
+static SoundPack* createSoundPack(const std::vector<KeyEvent>& events)
+{
+    std::set<int> scanCodes;
+    for (const auto& event : events) {
+        scanCodes.insert(event.scanCode);
+    }
+    return createSoundPack(std::vector<int>(scanCodes.begin(), scanCodes.end()), CLIP_MILLIS);
+}
+
+/*
+ * Replays the trace as roar-replay does, with the rendering and the key
+ * events inside guards, and returns the allocations they made.
+ */
+static std::uint64_t replay(const std::vector<KeyEvent>& events, SoundPlayer* player, NullAudioBackend* backend)
+{
+    const std::uint64_t before = AllocationGuard::getCount();
+    bool keyState[0x10000]{};
+
+    for (const auto& event : events) {
+        {
+            AllocationGuard guard;
+            std::uint64_t frame = event.timestamp * SAMPLING_RATE / 1000000;
+            while (backend->getFramePosition() < frame && backend->renderBlock()) {
+                player->suspendIfIdle();
+            }
+        }
+
+        if (!event.down) {
+            keyState[event.scanCode] = false;
+            continue;
+        }
+        if (keyState[event.scanCode]) {
+            continue;
+        }
+        keyState[event.scanCode] = true;
+
+        AllocationGuard guard;
+        player->playSound(event.scanCode, event.timestamp);
+    }
+
+    {
+        AllocationGuard guard;
+        backend->advanceTo(backend->getFramePosition() + SAMPLING_RATE);
+    }
+    return AllocationGuard::getCount() - before;
+}
+
+struct Configuration {
+    const char* name;
+    int voices;
+    bool stealing;
+    bool collapseFloods;
+};
+
+static void testReplay(const std::vector<KeyEvent>& events, const Configuration& configuration)
+{
+    auto backend = new NullAudioBackend();
+    // Owns the backend.
+    std::unique_ptr<SoundPlayer> player(SoundPlayer::create(backend));
+    player->setVoiceCount(configuration.voices);
+    player->setVoiceStealing(configuration.stealing);
+    InputThrottle::Limits limits;
+    limits.collapseFloods = configuration.collapseFloods;
+    player->setInputLimits(limits);
+    player->setIdleTimeout(500);
+    player->setSoundPack(createSoundPack(events));
+
+    std::uint64_t allocations = replay(events, player.get(), backend);
+    if (allocations > 0) {
+        std::cerr << configuration.name << ": " << allocations << " allocation(s)" << std::endl;
+    }
+    EXPECT_EQ(allocations, 0u);
+
+    SoundPlayer::Statistics statistics = player->getStatistics();
+    EXPECT_TRUE(statistics.plays > 0);
+    EXPECT_TRUE(player->getMetrics().resumes > 0);
+}
+
+/*
+ * Allocations in guards are counted, including aligned ones. The pointers
+ * are volatile, as the compiler may otherwise drop unused allocations.
+ */
+static void testGuardCounts()
+{
+    const std::uint64_t before = AllocationGuard::getCount();
+    {
+        AllocationGuard guard;
+        int* volatile value = new int(1);
+        delete value;
+        char* volatile array = new char[16];
+        delete [] array;
+        void* volatile aligned = ::operator new(64, std::align_val_t(64));
+        ::operator delete(aligned, std::align_val_t(64));
+    }
+    int* volatile unguarded = new int(2);
+    delete unguarded;
+    EXPECT_EQ(AllocationGuard::getCount() - before, 3u);
+}
+
+int main()
+{
+    std::vector<KeyEvent> events;
+    if (!KeyTraceReader::read("burst.trace", events)) {
+        std::cerr << "Cannot read burst.trace" << std::endl;
+        return 1;
+    }
+
+    testGuardCounts();
+
+    const Configuration configurations[] = {
+        {"default", 8, false, false},
+        {"stealing", 4, true, false},
+        {"collapsing", 8, true, true},
+    };
+    for (const auto& configuration : configurations) {
+        testReplay(events, configuration);
+    }
+    return expect::status();
+}
@@ -0,0 +1,246 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "Expect.h"
+#include "ConvolutionReverb.h"
+#include "Equalizer.h"
+#include "Fft.h"
+#include "SoundResource.h"
+
+/*
+ * Checks the transform, the reverb and the equalizer against results
+ * known in closed form.
+ */
+
+static const int SAMPLING_RATE = 48000;
+// As in ConvolutionReverb.
+static const int PARTITION_FRAMES = 256;
+
+static const double PI = 3.14159265358979323846;
+
+// Deterministic samples in [-1, 1).
+static std::vector<float> createNoise(std::size_t count, std::uint32_t seed)
+{
+    std::vector<float> samples(count);
+    for (auto& sample : samples) {
+        seed = seed * 1664525u + 1013904223u;
+        sample = (float) (seed >> 8) / (1 << 23) - 1.0f;
+    }
+    return samples;
+}
+
+static float findLargestError(const float* actual, const float* expected, std::size_t count)
+{
+    float largest = 0.0f;
+    for (std::size_t i = 0; i < count; i++) {
+        largest = std::max(largest, std::fabs(actual[i] - expected[i]));
+    }
+    return largest;
+}
+
+/*
+ * The forward transform matches the definition of the DFT, and the
+ * inverse brings back the input scaled by the size.
+ */
+static void testFftRoundTrip()
+{
+    for (int size = 2; size <= 1024; size *= 2) {
+        Fft fft(size);
+        const std::vector<float> inputRe = createNoise(size, size);
+        const std::vector<float> inputIm = createNoise(size, size + 1);
+        std::vector<float> re = inputRe;
+        std::vector<float> im = inputIm;
+
+        fft.forward(re.data(), im.data());
+        float largest = 0.0f;
+        for (int k = 0; k < size; k++) {
+            double sumRe = 0.0;
+            double sumIm = 0.0;
+            for (int n = 0; n < size; n++) {
+                double angle = -2.0 * PI * k * n / size;
+                sumRe += inputRe[n] * std::cos(angle) - inputIm[n] * std::sin(angle);
+                sumIm += inputRe[n] * std::sin(angle) + inputIm[n] * std::cos(angle);
+            }
+            largest = std::max(largest, (float) std::fabs(re[k] - sumRe));
+            largest = std::max(largest, (float) std::fabs(im[k] - sumIm));
+        }
+        EXPECT_TRUE(largest < 1e-4f * size);
+
+        fft.inverse(re.data(), im.data());
+        for (int i = 0; i < size; i++) {
+            re[i] /= size;
+            im[i] /= size;
+        }
+        EXPECT_TRUE(findLargestError(re.data(), inputRe.data(), size) < 1e-5f);
+        EXPECT_TRUE(findLargestError(im.data(), inputIm.data(), size) < 1e-5f);
+    }
+}
+
+/*
+ * An impulse response of a single full scale sample in each channel,
+ * at the given frames, which normalizes to unit energy.
+ */
+static ConvolutionReverb* createReverb(int channels, int frames, int leftFrame, int rightFrame, float wet)
+{
+    const std::uint64_t length = (std::uint64_t) frames * channels * sizeof(std::int16_t);
+    auto data = new std::uint8_t[length]();
+    auto samples = reinterpret_cast<std::int16_t*>(data);
+    samples[leftFrame * channels] = INT16_MAX;
+    samples[rightFrame * channels + channels - 1] = INT16_MAX;
+    SoundResource impulse(channels, SAMPLING_RATE, 16, data, length);
+    return ConvolutionReverb::create(&impulse, 2, SAMPLING_RATE, wet);
+}
+
+/*
+ * Reverberates stereo noise in blocks not aligned to the partitions, and
+ * checks that each channel is its input plus the input delayed by the
+ * reverb's partition and the frame of its impulse.
+ */
+static void checkDelays(ConvolutionReverb* reverb, float wet, int leftDelay, int rightDelay)
+{
+    const int frames = 8 * PARTITION_FRAMES;
+    const std::vector<float> input = createNoise((std::size_t) frames * 2, 7);
+    std::vector<float> output = input;
+    for (int offset = 0; offset < frames; offset += 100) {
+        reverb->process(output.data() + (std::size_t) offset * 2, std::min(100, frames - offset));
+    }
+
+    const int delays[] = {PARTITION_FRAMES + leftDelay, PARTITION_FRAMES + rightDelay};
+    float largest = 0.0f;
+    for (int i = 0; i < frames; i++) {
+        for (int channel = 0; channel < 2; channel++) {
+            const int from = i - delays[channel];
+            float expected = input[(std::size_t) i * 2 + channel];
+            if (from >= 0) {
+                expected += wet * input[(std::size_t) from * 2 + channel];
+            }
+            largest = std::max(largest, std::fabs(output[(std::size_t) i * 2 + channel] - expected));
+        }
+    }
+    EXPECT_TRUE(largest < 1e-4f);
+}
+
+/*
+ * A one partition reverb of a unit impulse returns its input, one
+ * partition late, in both channels of the shared transform.
+ */
+static void testUnitImpulse()
+{
+    std::unique_ptr<ConvolutionReverb> reverb(createReverb(1, 100, 0, 0, 1.0f));
+    EXPECT_TRUE(reverb != nullptr);
+    if (reverb != nullptr) {
+        checkDelays(reverb.get(), 1.0f, 0, 0);
+    }
+}
+
+/*
+ * Channels with impulses of their own stay apart, which depends on the
+ * split of the transform shared by both.
+ */
+static void testStereoImpulse()
+{
+    std::unique_ptr<ConvolutionReverb> reverb(createReverb(2, 100, 0, 37, 0.5f));
+    EXPECT_TRUE(reverb != nullptr);
+    if (reverb != nullptr) {
+        checkDelays(reverb.get(), 0.5f, 0, 37);
+    }
+}
+
+/*
+ * Impulses beyond the first partition are found in the older blocks
+ * of the history.
+ */
+static void testLaterPartitions()
+{
+    std::unique_ptr<ConvolutionReverb> reverb(createReverb(2, 3 * PARTITION_FRAMES, 300, 2 * PARTITION_FRAMES + 5, 0.5f));
+    EXPECT_TRUE(reverb != nullptr);
+    if (reverb != nullptr) {
+        checkDelays(reverb.get(), 0.5f, 300, 2 * PARTITION_FRAMES + 5);
+
+        // Once the input falls silent, the tail dies away completely.
+        std::vector<float> silence((std::size_t) 8 * PARTITION_FRAMES * 2);
+        reverb->ringOut(silence.data(), 8 * PARTITION_FRAMES);
+        EXPECT_TRUE(reverb->isSilent());
+        EXPECT_TRUE(std::all_of(silence.end() - PARTITION_FRAMES * 2, silence.end(), [](float s) { return s == 0.0f; }));
+    }
+}
+
+// Sine of the given frequency, in both channels.
+static std::vector<float> createSine(double frequency, int frames)
+{
+    std::vector<float> samples((std::size_t) frames * 2);
+    for (int i = 0; i < frames; i++) {
+        float sample = (float) (0.25 * std::sin(2.0 * PI * frequency * i / SAMPLING_RATE));
+        samples[(std::size_t) i * 2] = sample;
+        samples[(std::size_t) i * 2 + 1] = sample;
+    }
+    return samples;
+}
+
+static float findPeak(const float* samples, std::size_t count)
+{
+    float peak = 0.0f;
+    for (std::size_t i = 0; i < count; i++) {
+        peak = std::max(peak, std::fabs(samples[i]));
+    }
+    return peak;
+}
+
+/*
+ * Bands without gain pass the signal unchanged, while a boost is heard.
+ */
+static void testFlatBands()
+{
+    const int frames = SAMPLING_RATE / 10;
+    const std::vector<float> input = createNoise((std::size_t) frames * 2, 11);
+
+    EqualizerBand peak;
+    EqualizerBand lowShelf;
+    lowShelf.type = FilterType::LOW_SHELF;
+    lowShelf.frequency = 200.0f;
+    EqualizerBand highShelf;
+    highShelf.type = FilterType::HIGH_SHELF;
+    highShelf.frequency = 5000.0f;
+
+    Equalizer flat;
+    flat.setBands({peak, lowShelf, highShelf});
+    flat.configure(2, SAMPLING_RATE);
+    EXPECT_TRUE(!flat.isBypassed());
+    std::vector<float> output = input;
+    flat.process(output.data(), frames);
+    EXPECT_TRUE(findLargestError(output.data(), input.data(), output.size()) < 1e-5f);
+
+    // Twelve decibels at the center of a peak are four times the amplitude.
+    EqualizerBand boost;
+    boost.gain = 12.0f;
+    Equalizer boosted;
+    boosted.setBands({boost});
+    boosted.configure(2, SAMPLING_RATE);
+    std::vector<float> sine = createSine(boost.frequency, frames);
+    boosted.process(sine.data(), frames);
+    const std::size_t settled = sine.size() / 2;
+    const float gain = findPeak(sine.data() + settled, sine.size() - settled) / 0.25f;
+    EXPECT_TRUE(std::fabs(gain - 3.98f) < 0.05f);
+}
+
+int main()
+{
+    testFftRoundTrip();
+    testUnitImpulse();
+    testStereoImpulse();
+    testLaterPartitions();
+    testFlatBands();
+    return expect::status();
+}
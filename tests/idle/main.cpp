@@ -0,0 +1,154 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "Expect.h"
+#include "Fixture.h"
+
+/*
+ * Suspends the simulated output after the idle timeout and resumes it
+ * with the next key, as the window timer and key events do.
+ */
+
+static const int CLIP_MILLIS = 100;
+static const int IDLE_MILLIS = 200;
+
+static const int KEY_A = 0x1e;
+
+/*
+ * Fails to resume a given number of times, as a device may.
+ */
+class FlakyBackend: public NullAudioBackend {
+public:
+
+    int failures = 0;
+
+    FlakyBackend(int blockFrames)
+    :   NullAudioBackend(blockFrames) {
+    }
+
+    virtual bool resume() {
+        if (failures > 0) {
+            failures--;
+            return false;
+        }
+        return NullAudioBackend::resume();
+    }
+};
+
+struct IdleFixture: Fixture<FlakyBackend> {
+    IdleFixture(int idleMillis) {
+        player->setIdleTimeout(idleMillis);
+        player->setSoundPack(createSoundPack({KEY_A}, CLIP_MILLIS));
+    }
+};
+
+/*
+ * Silence suspends the output once the timeout has passed, not before.
+ */
+static void testSuspendAfterTimeout()
+{
+    IdleFixture fixture(IDLE_MILLIS);
+    fixture.run(IDLE_MILLIS - 20);
+    EXPECT_TRUE(!fixture.backend->isSuspended());
+
+    fixture.run(40);
+    EXPECT_TRUE(fixture.backend->isSuspended());
+    EXPECT_EQ(fixture.getMetric(&Metrics::suspends), 1u);
+
+    // Nothing more to suspend.
+    EXPECT_TRUE(!fixture.player->suspendIfIdle());
+    EXPECT_EQ(fixture.getMetric(&Metrics::suspends), 1u);
+}
+
+/*
+ * The timeout counts from the end of the last sound, fade out included.
+ */
+static void testNoSuspendWhilePlaying()
+{
+    IdleFixture fixture(IDLE_MILLIS);
+    fixture.run(IDLE_MILLIS - 50);
+    fixture.player->playSound(KEY_A, fixture.backend->getTime());
+
+    fixture.run(IDLE_MILLIS);
+    EXPECT_TRUE(!fixture.backend->isSuspended());
+
+    fixture.run(CLIP_MILLIS + 50);
+    EXPECT_TRUE(fixture.backend->isSuspended());
+}
+
+/*
+ * A key resumes the output, whose clock has kept running.
+ */
+static void testResumeOnKey()
+{
+    IdleFixture fixture(IDLE_MILLIS);
+    fixture.run(IDLE_MILLIS + 20);
+    EXPECT_TRUE(fixture.backend->isSuspended());
+
+    fixture.run(1000);
+    std::uint64_t frame = fixture.backend->getFramePosition();
+    EXPECT_TRUE(fixture.player->playSound(KEY_A, fixture.backend->getTime()));
+    EXPECT_TRUE(!fixture.backend->isSuspended());
+    EXPECT_EQ(fixture.getMetric(&Metrics::resumes), 1u);
+
+    fixture.backend->renderBlock();
+    EXPECT_EQ(fixture.backend->getFramePosition(), frame + BLOCK_FRAMES);
+    EXPECT_TRUE(fixture.backend->getBlock()[0] != 0.0f);
+
+    // Idles out again once the sound is over.
+    fixture.run(CLIP_MILLIS + IDLE_MILLIS + 50);
+    EXPECT_TRUE(fixture.backend->isSuspended());
+    EXPECT_EQ(fixture.getMetric(&Metrics::suspends), 2u);
+}
+
+/*
+ * A failed resume leaves the output suspended, and the next key tries again.
+ */
+static void testRetryFailedResume()
+{
+    IdleFixture fixture(IDLE_MILLIS);
+    fixture.run(IDLE_MILLIS + 20);
+    EXPECT_TRUE(fixture.backend->isSuspended());
+
+    fixture.backend->failures = 1;
+    fixture.player->playSound(KEY_A, fixture.backend->getTime());
+    EXPECT_TRUE(fixture.backend->isSuspended());
+    EXPECT_EQ(fixture.getMetric(&Metrics::resumes), 0u);
+
+    fixture.player->playSound(KEY_A, fixture.backend->getTime());
+    EXPECT_TRUE(!fixture.backend->isSuspended());
+    EXPECT_EQ(fixture.getMetric(&Metrics::resumes), 1u);
+}
+
+/*
+ * A timeout of zero keeps the output running.
+ */
+static void testNoTimeout()
+{
+    IdleFixture fixture(0);
+    fixture.run(5000);
+    EXPECT_TRUE(!fixture.backend->isSuspended());
+    EXPECT_EQ(fixture.getMetric(&Metrics::suspends), 0u);
+}
+
+int main()
+{
+    testSuspendAfterTimeout();
+    testNoSuspendWhilePlaying();
+    testResumeOnKey();
+    testRetryFailedResume();
+    testNoTimeout();
+    return expect::status();
+}
@@ -0,0 +1,321 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "Expect.h"
+#include "Fixture.h"
+#include "ConvolutionReverb.h"
+
+/*
+ * Plays keys on the simulated clock and checks the exact frames
+ * their sounds start at in the output.
+ */
+
+static const int CLIP_MILLIS = 100;
+
+static const int KEY_A = 0x1e;
+static const int KEY_S = 0x1f;
+
+// The keys of the tests, with clips of their own.
+static SoundPack* createSoundPack(int releaseMillis = Envelope::DEFAULT_RELEASE_MILLIS)
+{
+    return createSoundPack({KEY_A, KEY_S}, CLIP_MILLIS, releaseMillis);
+}
+
+// Backend time at which the given frame is played.
+static std::uint64_t getTimeOf(std::uint64_t frame)
+{
+    return frame * 1000000 / SAMPLING_RATE;
+}
+
+/*
+ * Renders whole blocks up to the given frame, keeping the left channel.
+ */
+static void renderTo(NullAudioBackend* backend, std::uint64_t frame, std::vector<float>& output)
+{
+    while (backend->getFramePosition() < frame) {
+        backend->advanceTo(backend->getFramePosition() + backend->getBlockFrames());
+        const float* block = backend->getBlock();
+        for (int i = 0; i < backend->getBlockFrames(); i++) {
+            output.push_back(block[i * 2]);
+        }
+    }
+}
+
+// First frame from the given one with a sample, -1 if all are silent.
+static std::int64_t findOnset(const std::vector<float>& output, std::uint64_t from = 0)
+{
+    for (std::uint64_t i = from; i < output.size(); i++) {
+        if (output[i] != 0.0f) {
+            return (std::int64_t) i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Sounds are delayed by a block, so that they start exactly one block
+ * after their key events.
+ */
+static void testScheduledStart()
+{
+    Fixture<> fixture;
+    fixture.player->setSoundPack(createSoundPack());
+
+    std::vector<float> output;
+    renderTo(fixture.backend, 10 * BLOCK_FRAMES, output);
+    EXPECT_EQ(findOnset(output), -1);
+
+    EXPECT_TRUE(fixture.player->playSound(KEY_A, getTimeOf(9 * BLOCK_FRAMES + 240)));
+    renderTo(fixture.backend, 14 * BLOCK_FRAMES, output);
+    EXPECT_EQ(findOnset(output), 10 * BLOCK_FRAMES + 240);
+
+    SoundPlayer::Statistics statistics = fixture.player->getStatistics();
+    EXPECT_EQ(statistics.onset.count, 1u);
+    EXPECT_EQ(statistics.onset.late, 0u);
+    EXPECT_EQ(statistics.onset.getMean(), (double) BLOCK_FRAMES);
+}
+
+/*
+ * Two keys in the same block keep the distance between them.
+ */
+static void testStartsWithinBlock()
+{
+    std::vector<float> single;
+    {
+        Fixture<> fixture;
+        fixture.player->setSoundPack(createSoundPack());
+        renderTo(fixture.backend, 10 * BLOCK_FRAMES, single);
+        fixture.player->playSound(KEY_A, getTimeOf(9 * BLOCK_FRAMES + 80));
+        renderTo(fixture.backend, 14 * BLOCK_FRAMES, single);
+    }
+
+    std::vector<float> both;
+    {
+        Fixture<> fixture;
+        fixture.player->setSoundPack(createSoundPack());
+        renderTo(fixture.backend, 10 * BLOCK_FRAMES, both);
+        fixture.player->playSound(KEY_A, getTimeOf(9 * BLOCK_FRAMES + 80));
+        fixture.player->playSound(KEY_S, getTimeOf(9 * BLOCK_FRAMES + 380));
+        renderTo(fixture.backend, 14 * BLOCK_FRAMES, both);
+    }
+
+    EXPECT_EQ(findOnset(single), 10 * BLOCK_FRAMES + 80);
+    EXPECT_EQ(findOnset(both), 10 * BLOCK_FRAMES + 80);
+
+    // Mixing is linear, so the second sound is what the first alone lacks.
+    std::vector<float> second(both.size());
+    for (std::size_t i = 0; i < both.size(); i++) {
+        second[i] = both[i] - single[i];
+    }
+    EXPECT_EQ(findOnset(second), 10 * BLOCK_FRAMES + 380);
+}
+
+/*
+ * Without scheduling, sounds start with the next block, at the cost of jitter.
+ */
+static void testUnscheduledStart()
+{
+    Fixture<> fixture;
+    fixture.player->setScheduling(false);
+    fixture.player->setSoundPack(createSoundPack());
+
+    std::vector<float> output;
+    renderTo(fixture.backend, 10 * BLOCK_FRAMES, output);
+    fixture.player->playSound(KEY_A, getTimeOf(9 * BLOCK_FRAMES + 240));
+    renderTo(fixture.backend, 14 * BLOCK_FRAMES, output);
+    EXPECT_EQ(findOnset(output), 10 * BLOCK_FRAMES);
+
+    SoundPlayer::Statistics statistics = fixture.player->getStatistics();
+    EXPECT_EQ(statistics.onset.getMean(), 240.0);
+}
+
+/*
+ * A key before the first block starts its sound at the first frame.
+ */
+static void testStartBeforeFirstBlock()
+{
+    Fixture<> fixture;
+    fixture.player->setSoundPack(createSoundPack());
+
+    fixture.player->playSound(KEY_A, 0);
+    std::vector<float> output;
+    renderTo(fixture.backend, 4 * BLOCK_FRAMES, output);
+    EXPECT_EQ(findOnset(output), 0);
+}
+
+/*
+ * After the output was suspended, the sound is in the first block rendered.
+ */
+static void testStartAfterSuspend()
+{
+    Fixture<> fixture;
+    fixture.player->setIdleTimeout(50);
+    fixture.player->setSoundPack(createSoundPack());
+
+    std::vector<float> output;
+    while (fixture.backend->getFramePosition() < 20 * BLOCK_FRAMES) {
+        renderTo(fixture.backend, fixture.backend->getFramePosition() + BLOCK_FRAMES, output);
+        fixture.player->suspendIfIdle();
+    }
+    EXPECT_TRUE(fixture.backend->isSuspended());
+
+    fixture.player->playSound(KEY_A, fixture.backend->getTime());
+    EXPECT_TRUE(!fixture.backend->isSuspended());
+    renderTo(fixture.backend, 24 * BLOCK_FRAMES, output);
+    EXPECT_EQ(findOnset(output), 20 * BLOCK_FRAMES);
+}
+
+/*
+ * Keys with no clip play nothing.
+ */
+static void testUnknownKey()
+{
+    Fixture<> fixture;
+    fixture.player->setSoundPack(createSoundPack());
+
+    std::vector<float> output;
+    renderTo(fixture.backend, 2 * BLOCK_FRAMES, output);
+    EXPECT_TRUE(!fixture.player->playSound(0x39, getTimeOf(BLOCK_FRAMES)));
+    renderTo(fixture.backend, 6 * BLOCK_FRAMES, output);
+    EXPECT_EQ(findOnset(output), -1);
+}
+
+/*
+ * A pack whose output cannot be opened is dropped, so that keys are
+ * ignored instead of being played into nothing.
+ */
+static void testOutputNotOpened()
+{
+    auto backend = NullAudioBackend::create("missing-directory/output.wav", BLOCK_FRAMES);
+    // Owns the backend.
+    std::unique_ptr<SoundPlayer> player(SoundPlayer::create(backend));
+
+    EXPECT_TRUE(!player->setSoundPack(createSoundPack()));
+    EXPECT_TRUE(!player->playSound(KEY_A, 0));
+    EXPECT_TRUE(!backend->renderBlock());
+    EXPECT_EQ(player->getStatistics().plays, 0u);
+}
+
+// Largest difference between two frames in a row.
+static float findLargestStep(const std::vector<float>& output)
+{
+    float largest = 0.0f;
+    for (std::size_t i = 1; i < output.size(); i++) {
+        largest = std::max(largest, std::fabs(output[i] - output[i - 1]));
+    }
+    return largest;
+}
+
+/*
+ * Stealing a voice whose previous sound is still fading out lets both fade,
+ * so that the output moves in steps no larger than a single sound makes.
+ */
+static void testReleaseWhileFading()
+{
+    std::vector<float> single;
+    {
+        Fixture<> fixture;
+        // Fades out over four blocks.
+        fixture.player->setSoundPack(createSoundPack(40));
+        renderTo(fixture.backend, 4 * BLOCK_FRAMES, single);
+        fixture.player->playSound(KEY_A, getTimeOf(3 * BLOCK_FRAMES));
+        renderTo(fixture.backend, 20 * BLOCK_FRAMES, single);
+    }
+
+    std::vector<float> stolen;
+    {
+        Fixture<> fixture;
+        fixture.player->setVoiceCount(1);
+        fixture.player->setVoiceStealing(true);
+        fixture.player->setSoundPack(createSoundPack(40));
+        renderTo(fixture.backend, 4 * BLOCK_FRAMES, stolen);
+        fixture.player->playSound(KEY_A, getTimeOf(3 * BLOCK_FRAMES));
+        renderTo(fixture.backend, 8 * BLOCK_FRAMES, stolen);
+        // Cuts off the first sound.
+        fixture.player->playSound(KEY_S, getTimeOf(7 * BLOCK_FRAMES));
+        renderTo(fixture.backend, 9 * BLOCK_FRAMES, stolen);
+        // Cuts off the second sound while the first is still fading.
+        fixture.player->playSound(KEY_A, getTimeOf(8 * BLOCK_FRAMES));
+        renderTo(fixture.backend, 20 * BLOCK_FRAMES, stolen);
+        EXPECT_EQ(fixture.player->getStatistics().steals, 2u);
+    }
+
+    EXPECT_TRUE(findLargestStep(stolen) <= findLargestStep(single));
+}
+
+// A smooth room, decaying over a quarter of a second.
+static ConvolutionReverb* createReverb()
+{
+    const std::uint64_t frames = SAMPLING_RATE / 4;
+    auto data = new std::uint8_t[frames * sizeof(std::int16_t)];
+    auto samples = reinterpret_cast<std::int16_t*>(data);
+    for (std::uint64_t i = 0; i < frames; i++) {
+        samples[i] = (std::int16_t) (20000 * std::exp(-(double) i / 2400));
+    }
+    SoundResource impulse(1, SAMPLING_RATE, 16, data, frames * sizeof(std::int16_t));
+    return ConvolutionReverb::create(&impulse, 2, SAMPLING_RATE, 0.5f);
+}
+
+/*
+ * Switching to a pack without reverb lets the reverb of the previous
+ * pack ring out, just as if the pack had stayed.
+ */
+static void testReverbRingsOut()
+{
+    const int switchBlock = 16;
+    const int endBlock = 40;
+
+    std::vector<float> stayed;
+    {
+        Fixture<> fixture;
+        SoundPack* soundPack = createSoundPack(40);
+        soundPack->setReverb(createReverb());
+        fixture.player->setSoundPack(soundPack);
+        fixture.player->playSound(KEY_A, getTimeOf(3 * BLOCK_FRAMES));
+        renderTo(fixture.backend, endBlock * BLOCK_FRAMES, stayed);
+    }
+
+    std::vector<float> switched;
+    {
+        Fixture<> fixture;
+        SoundPack* soundPack = createSoundPack(40);
+        soundPack->setReverb(createReverb());
+        fixture.player->setSoundPack(soundPack);
+        fixture.player->playSound(KEY_A, getTimeOf(3 * BLOCK_FRAMES));
+        renderTo(fixture.backend, switchBlock * BLOCK_FRAMES, switched);
+        // The sound has ended, only its reverberation is left.
+        fixture.player->setSoundPack(createSoundPack(40));
+        renderTo(fixture.backend, endBlock * BLOCK_FRAMES, switched);
+    }
+
+    const std::size_t from = (std::size_t) switchBlock * BLOCK_FRAMES;
+    EXPECT_TRUE(stayed[from] != 0.0f);
+    EXPECT_TRUE(std::equal(stayed.begin() + from, stayed.end(), switched.begin() + from));
+    EXPECT_EQ(switched.back(), 0.0f);
+}
+
+int main()
+{
+    testScheduledStart();
+    testStartsWithinBlock();
+    testUnscheduledStart();
+    testStartBeforeFirstBlock();
+    testStartAfterSuspend();
+    testUnknownKey();
+    testOutputNotOpened();
+    testReleaseWhileFading();
+    testReverbRingsOut();
+    return expect::status();
+}
@@ -0,0 +1,190 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "Expect.h"
+#include "InputThrottle.h"
+
+/*
+ * Feeds key events to the throttle and checks each of its decisions.
+ */
+
+using Decision = InputThrottle::Decision;
+
+static const int SAMPLING_RATE = 48000;
+static const int BLOCK_FRAMES = 480;
+
+// As in InputThrottle.
+static const int FLOOD_EVENTS = 6;
+static const int FLOOD_QUIET_MILLIS = 100;
+
+static const int KEY_A = 0x1e;
+
+static std::ostream& operator<<(std::ostream& out, Decision decision)
+{
+    static const char* const names[] = {"PLAY", "COALESCE", "LIMIT", "COLLAPSE", "SUPPRESS"};
+    return out << names[(int) decision];
+}
+
+static std::uint64_t toFrames(int millis)
+{
+    return (std::uint64_t) millis * SAMPLING_RATE / 1000;
+}
+
+// Only the limits given are applied.
+static InputThrottle::Limits noLimits()
+{
+    InputThrottle::Limits limits;
+    limits.startsPerBlock = 0;
+    limits.keyIntervalMillis = 0;
+    limits.startsPerSecond = 0;
+    return limits;
+}
+
+static void createThrottle(InputThrottle& throttle, const InputThrottle::Limits& limits)
+{
+    throttle.setLimits(limits);
+    throttle.configure(SAMPLING_RATE);
+}
+
+/*
+ * A key starts one sound per block, and a block starts no more than
+ * the sounds allowed.
+ */
+static void testCoalesce()
+{
+    InputThrottle::Limits limits = noLimits();
+    limits.startsPerBlock = 3;
+    InputThrottle throttle;
+    createThrottle(throttle, limits);
+
+    EXPECT_EQ(throttle.admit(KEY_A, 0, BLOCK_FRAMES), Decision::PLAY);
+    EXPECT_EQ(throttle.admit(KEY_A, 100, BLOCK_FRAMES), Decision::COALESCE);
+    EXPECT_EQ(throttle.admit(KEY_A + 1, 200, BLOCK_FRAMES), Decision::PLAY);
+    EXPECT_EQ(throttle.admit(KEY_A + 2, 300, BLOCK_FRAMES), Decision::PLAY);
+    EXPECT_EQ(throttle.admit(KEY_A + 3, 400, BLOCK_FRAMES), Decision::COALESCE);
+
+    // The next block starts afresh.
+    EXPECT_EQ(throttle.admit(KEY_A, BLOCK_FRAMES, BLOCK_FRAMES), Decision::PLAY);
+    EXPECT_EQ(throttle.admit(KEY_A + 3, BLOCK_FRAMES + 100, BLOCK_FRAMES), Decision::PLAY);
+}
+
+/*
+ * A key starts another sound only once its interval has passed.
+ */
+static void testKeyInterval()
+{
+    InputThrottle::Limits limits = noLimits();
+    limits.keyIntervalMillis = 25;
+    InputThrottle throttle;
+    createThrottle(throttle, limits);
+
+    EXPECT_EQ(throttle.admit(KEY_A, 0, BLOCK_FRAMES), Decision::PLAY);
+    EXPECT_EQ(throttle.admit(KEY_A, toFrames(20), BLOCK_FRAMES), Decision::LIMIT);
+    // Other keys are not held back.
+    EXPECT_EQ(throttle.admit(KEY_A + 1, toFrames(20), BLOCK_FRAMES), Decision::PLAY);
+    EXPECT_EQ(throttle.admit(KEY_A, toFrames(30), BLOCK_FRAMES), Decision::PLAY);
+}
+
+/*
+ * All keys share a bucket of starts, which holds the burst and refills
+ * at the rate allowed.
+ */
+static void testTokenBucket()
+{
+    InputThrottle::Limits limits = noLimits();
+    limits.startsPerSecond = 10;
+    limits.burst = 3;
+    InputThrottle throttle;
+    createThrottle(throttle, limits);
+
+    // Refills a fifth of a start between events.
+    EXPECT_EQ(throttle.admit(KEY_A, 0, BLOCK_FRAMES), Decision::PLAY);
+    EXPECT_EQ(throttle.admit(KEY_A + 1, toFrames(20), BLOCK_FRAMES), Decision::PLAY);
+    EXPECT_EQ(throttle.admit(KEY_A + 2, toFrames(40), BLOCK_FRAMES), Decision::PLAY);
+    EXPECT_EQ(throttle.admit(KEY_A + 3, toFrames(60), BLOCK_FRAMES), Decision::LIMIT);
+
+    // A tenth of a second refills one start.
+    EXPECT_EQ(throttle.admit(KEY_A + 3, toFrames(160), BLOCK_FRAMES), Decision::PLAY);
+    EXPECT_EQ(throttle.admit(KEY_A + 4, toFrames(180), BLOCK_FRAMES), Decision::LIMIT);
+
+    // Never more than the burst, however long the pause.
+    const std::uint64_t later = toFrames(60000);
+    for (int i = 0; i < limits.burst; i++) {
+        EXPECT_EQ(throttle.admit(KEY_A + i, later + i * BLOCK_FRAMES, BLOCK_FRAMES), Decision::PLAY);
+    }
+    EXPECT_EQ(throttle.admit(KEY_A + 5, later + 5 * BLOCK_FRAMES, BLOCK_FRAMES), Decision::LIMIT);
+}
+
+/*
+ * Events closely spaced, as injected ones are, are collapsed into a
+ * single sound once they are many enough, until the input pauses.
+ */
+static void testFlood()
+{
+    InputThrottle::Limits limits = noLimits();
+    limits.collapseFloods = true;
+    InputThrottle throttle;
+    createThrottle(throttle, limits);
+
+    const std::uint64_t start = toFrames(1000);
+    const std::uint64_t gap = toFrames(5);
+    std::uint64_t frame = start;
+    for (int i = 1; i < FLOOD_EVENTS; i++) {
+        EXPECT_EQ(throttle.admit(KEY_A + i, frame, BLOCK_FRAMES), Decision::PLAY);
+        frame += gap;
+    }
+    EXPECT_EQ(throttle.admit(KEY_A, frame, BLOCK_FRAMES), Decision::COLLAPSE);
+    EXPECT_EQ(throttle.getFloodFrame(), start);
+
+    for (int i = 0; i < 10; i++) {
+        frame += gap;
+        EXPECT_EQ(throttle.admit(KEY_A + i, frame, BLOCK_FRAMES), Decision::SUPPRESS);
+    }
+
+    // Shorter pauses than the quiet time keep the flood going.
+    frame += toFrames(FLOOD_QUIET_MILLIS / 2);
+    EXPECT_EQ(throttle.admit(KEY_A, frame, BLOCK_FRAMES), Decision::SUPPRESS);
+
+    // A longer one ends it.
+    frame += toFrames(FLOOD_QUIET_MILLIS) + 1;
+    EXPECT_EQ(throttle.admit(KEY_A, frame, BLOCK_FRAMES), Decision::PLAY);
+    frame += toFrames(200);
+    EXPECT_EQ(throttle.admit(KEY_A + 1, frame, BLOCK_FRAMES), Decision::PLAY);
+}
+
+/*
+ * Without collapsing, the events of a flood are only held to the other limits.
+ */
+static void testFloodNotCollapsed()
+{
+    InputThrottle throttle;
+    createThrottle(throttle, noLimits());
+
+    std::uint64_t frame = 0;
+    for (int i = 0; i < 2 * FLOOD_EVENTS; i++) {
+        EXPECT_EQ(throttle.admit(KEY_A + i, frame, BLOCK_FRAMES), Decision::PLAY);
+        frame += toFrames(5);
+    }
+}
+
+int main()
+{
+    testCoalesce();
+    testKeyInterval();
+    testTokenBucket();
+    testFlood();
+    testFloodNotCollapsed();
+    return expect::status();
+}
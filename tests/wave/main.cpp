@@ -0,0 +1,270 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "Expect.h"
+#include "SampleConverter.h"
+#include "SoundResource.h"
+#include "WaveSoundResourceReader.h"
+
+/*
+ * Converts samples of every format to 16 bits, on the vector path and
+ * the scalar one, and reads them back from wave files.
+ */
+
+static const std::uint16_t FORMAT_PCM = 0x0001;
+static const std::uint16_t FORMAT_IEEE_FLOAT = 0x0003;
+static const std::uint16_t FORMAT_EXTENSIBLE = 0xFFFE;
+
+// Long enough for whole vectors and a scalar tail.
+static const std::size_t COUNT = 16 * 8 + 5;
+
+// Samples covering the full range, with both extremes.
+static std::vector<std::int16_t> createSamples()
+{
+    std::vector<std::int16_t> samples(COUNT);
+    for (std::size_t i = 0; i < COUNT; i++) {
+        samples[i] = (std::int16_t) ((i * 7919) % 65536 - 32768);
+    }
+    samples[0] = INT16_MIN;
+    samples[1] = INT16_MAX;
+    samples[2] = 0;
+    return samples;
+}
+
+static void put(std::vector<std::uint8_t>& bytes, std::uint64_t value, int size)
+{
+    for (int i = 0; i < size; i++) {
+        bytes.push_back((std::uint8_t) (value >> (i * 8)));
+    }
+}
+
+// Encodes the samples in the given format, as in the data chunk of a wave file.
+static std::vector<std::uint8_t> encode(SampleFormat format, const std::vector<std::int16_t>& samples)
+{
+    std::vector<std::uint8_t> bytes;
+    for (std::int16_t sample : samples) {
+        switch (format) {
+            case SampleFormat::UNSIGNED_8:
+                put(bytes, (std::uint8_t) ((sample >> 8) + 128), 1);
+                break;
+            case SampleFormat::SIGNED_16:
+                put(bytes, (std::uint16_t) sample, 2);
+                break;
+            case SampleFormat::SIGNED_24:
+                // Low byte that truncating to 16 bits drops.
+                put(bytes, (std::uint32_t) ((sample * 256) | 0x7f), 3);
+                break;
+            case SampleFormat::SIGNED_32:
+                put(bytes, (std::uint32_t) ((sample * 65536) | 0x7fff), 4);
+                break;
+            case SampleFormat::FLOAT_32: {
+                float value = sample / 32767.0f;
+                std::uint32_t bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                put(bytes, bits, 4);
+                break;
+            }
+        }
+    }
+    return bytes;
+}
+
+// What the samples are expected to come back as.
+static std::int16_t roundTrip(SampleFormat format, std::int16_t sample)
+{
+    switch (format) {
+        case SampleFormat::UNSIGNED_8:
+            return (std::int16_t) (sample & ~0xff);
+        case SampleFormat::FLOAT_32:
+            // Full scale is symmetric.
+            return std::max<std::int16_t>(sample, -32767);
+        default:
+            return sample;
+    }
+}
+
+static std::vector<std::uint8_t> createWave(SampleFormat format, int channels, bool extensible, const std::vector<std::int16_t>& samples)
+{
+    const int bytesPerSample = SampleConverter::getBytesPerSample(format);
+    const std::uint16_t formatTag = (format == SampleFormat::FLOAT_32) ? FORMAT_IEEE_FLOAT : FORMAT_PCM;
+    std::vector<std::uint8_t> data = encode(format, samples);
+
+    std::vector<std::uint8_t> fmt;
+    put(fmt, extensible ? FORMAT_EXTENSIBLE : formatTag, 2);
+    put(fmt, channels, 2);
+    put(fmt, 48000, 4);
+    put(fmt, 48000 * channels * bytesPerSample, 4);
+    put(fmt, channels * bytesPerSample, 2);
+    put(fmt, bytesPerSample * 8, 2);
+    if (extensible) {
+        put(fmt, 22, 2);
+        put(fmt, bytesPerSample * 8, 2);
+        put(fmt, 0, 4);
+        // The GUID of the sub-format starts with the plain format tag.
+        put(fmt, formatTag, 2);
+        for (int i = 2; i < 16; i++) {
+            fmt.push_back(0);
+        }
+    }
+
+    std::vector<std::uint8_t> wave;
+    wave.insert(wave.end(), {'R', 'I', 'F', 'F'});
+    put(wave, 4 + 8 + fmt.size() + 8 + data.size() + (data.size() & 1), 4);
+    wave.insert(wave.end(), {'W', 'A', 'V', 'E', 'f', 'm', 't', ' '});
+    put(wave, fmt.size(), 4);
+    wave.insert(wave.end(), fmt.begin(), fmt.end());
+    wave.insert(wave.end(), {'d', 'a', 't', 'a'});
+    put(wave, data.size(), 4);
+    wave.insert(wave.end(), data.begin(), data.end());
+    if (data.size() & 1) {
+        wave.push_back(0);
+    }
+    return wave;
+}
+
+static const SampleFormat FORMATS[] = {
+    SampleFormat::UNSIGNED_8,
+    SampleFormat::SIGNED_16,
+    SampleFormat::SIGNED_24,
+    SampleFormat::SIGNED_32,
+    SampleFormat::FLOAT_32,
+};
+
+/*
+ * Samples converted one at a time take the scalar path,
+ * and must match those converted in vectors.
+ */
+static void testVectorMatchesScalar()
+{
+    std::vector<std::int16_t> samples = createSamples();
+    for (SampleFormat format : FORMATS) {
+        std::vector<std::uint8_t> input = encode(format, samples);
+        const int bytesPerSample = SampleConverter::getBytesPerSample(format);
+
+        std::vector<std::int16_t> vector(COUNT);
+        SampleConverter::toSigned16(format, input.data(), COUNT, vector.data());
+
+        for (std::size_t i = 0; i < COUNT; i++) {
+            std::int16_t scalar = 0;
+            SampleConverter::toSigned16(format, input.data() + i * bytesPerSample, 1, &scalar);
+            EXPECT_EQ(vector[i], scalar);
+            EXPECT_EQ(vector[i], roundTrip(format, samples[i]));
+        }
+    }
+}
+
+/*
+ * Floats beyond full scale are clipped.
+ */
+static void testFloatClipping()
+{
+    const float values[] = {2.0f, -2.0f, 1.0f, -1.0f, 0.5f, 0.0f, 1e9f, -1e9f};
+    std::vector<float> input;
+    for (int i = 0; i < 4; i++) {
+        input.insert(input.end(), std::begin(values), std::end(values));
+    }
+    std::vector<std::int16_t> output(input.size());
+    SampleConverter::toSigned16(SampleFormat::FLOAT_32, reinterpret_cast<const std::uint8_t*>(input.data()), input.size(), output.data());
+
+    for (std::size_t i = 0; i < input.size(); i++) {
+        float clipped = std::max(-1.0f, std::min(1.0f, input[i]));
+        EXPECT_EQ(output[i], (std::int16_t) std::lrint(clipped * 32767.0f));
+    }
+}
+
+/*
+ * Wave files of every format read back as the 16-bit samples they were made from.
+ */
+static void testWaveRoundTrip()
+{
+    std::vector<std::int16_t> samples = createSamples();
+    // Whole stereo frames.
+    samples.pop_back();
+
+    for (SampleFormat format : FORMATS) {
+        for (bool extensible : {false, true}) {
+            std::vector<std::uint8_t> wave = createWave(format, 2, extensible, samples);
+            WaveSoundResourceReader reader(wave.data(), wave.size());
+            std::unique_ptr<SoundResource> resource(reader.read());
+            EXPECT_TRUE(resource != nullptr);
+            if (!resource) {
+                continue;
+            }
+
+            EXPECT_EQ(resource->getNumberOfChannels(), 2);
+            EXPECT_EQ(resource->getSamplingRate(), 48000);
+            EXPECT_EQ(resource->getBitsPerSample(), 16);
+            EXPECT_EQ(resource->getLength(), samples.size() * sizeof(std::int16_t));
+
+            auto decoded = reinterpret_cast<const std::int16_t*>(resource->getData());
+            for (std::size_t i = 0; i < samples.size() && i * 2 < resource->getLength(); i++) {
+                EXPECT_EQ(decoded[i], roundTrip(format, samples[i]));
+            }
+        }
+    }
+}
+
+/*
+ * A trailing partial frame is dropped.
+ */
+static void testPartialFrame()
+{
+    std::vector<std::int16_t> samples = createSamples();
+    std::vector<std::uint8_t> wave = createWave(SampleFormat::SIGNED_24, 2, false, samples);
+    WaveSoundResourceReader reader(wave.data(), wave.size());
+    std::unique_ptr<SoundResource> resource(reader.read());
+    EXPECT_TRUE(resource != nullptr);
+    if (resource) {
+        EXPECT_EQ(resource->getLength(), (samples.size() - 1) * sizeof(std::int16_t));
+    }
+}
+
+/*
+ * Data chunks larger than the file, or more than one of them, are rejected.
+ */
+static void testCorruptDataChunk()
+{
+    std::vector<std::int16_t> samples = createSamples();
+    samples.pop_back();
+    std::vector<std::uint8_t> wave = createWave(SampleFormat::SIGNED_16, 2, false, samples);
+
+    // Size of the data chunk, after the 12 bytes of the RIFF header and the 8 + 16 of the format chunk.
+    const std::size_t dataSizeOffset = 12 + 8 + 16 + 4;
+    std::vector<std::uint8_t> oversized = wave;
+    for (std::size_t i = 0; i < 4; i++) {
+        oversized[dataSizeOffset + i] = 0xff;
+    }
+    WaveSoundResourceReader oversizedReader(oversized.data(), oversized.size());
+    EXPECT_TRUE(std::unique_ptr<SoundResource>(oversizedReader.read()) == nullptr);
+
+    // Two data chunks before the format chunk.
+    std::vector<std::uint8_t> data(wave.begin() + dataSizeOffset - 4, wave.end());
+    std::vector<std::uint8_t> duplicated(wave.begin(), wave.begin() + 12);
+    duplicated.insert(duplicated.end(), data.begin(), data.end());
+    duplicated.insert(duplicated.end(), data.begin(), data.end());
+    duplicated.insert(duplicated.end(), wave.begin() + 12, wave.begin() + dataSizeOffset - 4);
+    WaveSoundResourceReader duplicatedReader(duplicated.data(), duplicated.size());
+    EXPECT_TRUE(std::unique_ptr<SoundResource>(duplicatedReader.read()) == nullptr);
+}
+
+int main()
+{
+    testVectorMatchesScalar();
+    testFloatClipping();
+    testWaveRoundTrip();
+    testPartialFrame();
+    testCorruptDataChunk();
+    return expect::status();
+}
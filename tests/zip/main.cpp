@@ -0,0 +1,187 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "Expect.h"
+#include "ZipArchive.h"
+#include <zlib.h>
+
+/*
+ * Reads entries of small archives written here, and checks that damaged
+ * sizes and checksums are refused before anything is allocated for them.
+ */
+
+static const std::uint16_t METHOD_STORED = 0;
+static const std::uint16_t METHOD_DEFLATED = 8;
+
+struct TestEntry {
+    std::string name;
+    std::uint16_t method;
+    std::vector<std::uint8_t> data;
+    std::uint32_t crc;
+    std::uint32_t size;
+};
+
+static void put(std::vector<std::uint8_t>& bytes, std::uint64_t value, int size)
+{
+    for (int i = 0; i < size; i++) {
+        bytes.push_back((std::uint8_t) (value >> (i * 8)));
+    }
+}
+
+static std::vector<std::uint8_t> createContent(std::size_t size)
+{
+    std::vector<std::uint8_t> content(size);
+    for (std::size_t i = 0; i < size; i++) {
+        content[i] = (std::uint8_t) (i * 31 % 251);
+    }
+    return content;
+}
+
+static std::uint32_t getCrc(const std::vector<std::uint8_t>& content)
+{
+    return (std::uint32_t) ::crc32(0L, content.data(), (uInt) content.size());
+}
+
+static TestEntry createStored(const std::string& name, const std::vector<std::uint8_t>& content)
+{
+    return TestEntry{name, METHOD_STORED, content, getCrc(content), (std::uint32_t) content.size()};
+}
+
+// Raw deflate stream, as zip archives hold it.
+static TestEntry createDeflated(const std::string& name, const std::vector<std::uint8_t>& content)
+{
+    z_stream stream{};
+    ::deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    std::vector<std::uint8_t> data(::deflateBound(&stream, (uLong) content.size()));
+    stream.next_in = const_cast<Bytef*>(content.data());
+    stream.avail_in = (uInt) content.size();
+    stream.next_out = data.data();
+    stream.avail_out = (uInt) data.size();
+    ::deflate(&stream, Z_FINISH);
+    data.resize(stream.total_out);
+    ::deflateEnd(&stream);
+    return TestEntry{name, METHOD_DEFLATED, data, getCrc(content), (std::uint32_t) content.size()};
+}
+
+static std::filesystem::path writeArchive(const std::vector<TestEntry>& entries)
+{
+    std::vector<std::uint8_t> bytes;
+    std::vector<std::uint32_t> offsets;
+    for (const auto& entry : entries) {
+        offsets.push_back((std::uint32_t) bytes.size());
+        put(bytes, 0x04034b50, 4);
+        put(bytes, 20, 2);
+        put(bytes, 0, 2);
+        put(bytes, entry.method, 2);
+        put(bytes, 0, 4);
+        put(bytes, entry.crc, 4);
+        put(bytes, entry.data.size(), 4);
+        put(bytes, entry.size, 4);
+        put(bytes, entry.name.size(), 2);
+        put(bytes, 0, 2);
+        bytes.insert(bytes.end(), entry.name.begin(), entry.name.end());
+        bytes.insert(bytes.end(), entry.data.begin(), entry.data.end());
+    }
+
+    const std::size_t directoryOffset = bytes.size();
+    for (std::size_t i = 0; i < entries.size(); i++) {
+        const auto& entry = entries[i];
+        put(bytes, 0x02014b50, 4);
+        put(bytes, 20, 2);
+        put(bytes, 20, 2);
+        put(bytes, 0, 2);
+        put(bytes, entry.method, 2);
+        put(bytes, 0, 4);
+        put(bytes, entry.crc, 4);
+        put(bytes, entry.data.size(), 4);
+        put(bytes, entry.size, 4);
+        put(bytes, entry.name.size(), 2);
+        put(bytes, 0, 2);
+        put(bytes, 0, 2);
+        put(bytes, 0, 2);
+        put(bytes, 0, 2);
+        put(bytes, 0, 4);
+        put(bytes, offsets[i], 4);
+        bytes.insert(bytes.end(), entry.name.begin(), entry.name.end());
+    }
+    const std::size_t directorySize = bytes.size() - directoryOffset;
+
+    put(bytes, 0x06054b50, 4);
+    put(bytes, 0, 2);
+    put(bytes, 0, 2);
+    put(bytes, entries.size(), 2);
+    put(bytes, entries.size(), 2);
+    put(bytes, directorySize, 4);
+    put(bytes, directoryOffset, 4);
+    put(bytes, 0, 2);
+
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "roar-test-zip.zip";
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(bytes.data()), (std::streamsize) bytes.size());
+    return path;
+}
+
+static bool readsAs(ZipArchive* archive, const std::string& name, const std::vector<std::uint8_t>& content)
+{
+    const ZipArchive::Entry* entry = archive->find(name);
+    if (entry == nullptr) {
+        return false;
+    }
+    std::vector<std::uint8_t> buffer;
+    const std::uint8_t* data = archive->read(*entry, buffer);
+    return data != nullptr && std::equal(content.begin(), content.end(), data);
+}
+
+static bool isRefused(ZipArchive* archive, const std::string& name)
+{
+    const ZipArchive::Entry* entry = archive->find(name);
+    std::vector<std::uint8_t> buffer;
+    return entry != nullptr && archive->read(*entry, buffer) == nullptr && buffer.capacity() == 0;
+}
+
+static void testEntries()
+{
+    const std::vector<std::uint8_t> content = createContent(10000);
+
+    TestEntry badStored = createStored("bad-crc.wav", content);
+    badStored.crc ^= 1;
+
+    // A kilobyte claiming to inflate to 4 GiB.
+    TestEntry bomb = createDeflated("bomb.wav", createContent(1000));
+    bomb.size = UINT32_MAX;
+
+    auto path = writeArchive({
+        createStored("stored.wav", content),
+        createDeflated("deflated.wav", content),
+        badStored,
+        bomb,
+    });
+    std::unique_ptr<ZipArchive> archive(ZipArchive::open(path));
+    EXPECT_TRUE(archive != nullptr);
+    if (archive != nullptr) {
+        EXPECT_TRUE(readsAs(archive.get(), "stored.wav", content));
+        EXPECT_TRUE(readsAs(archive.get(), "deflated.wav", content));
+        EXPECT_TRUE(isRefused(archive.get(), "bad-crc.wav"));
+        EXPECT_TRUE(isRefused(archive.get(), "bomb.wav"));
+    }
+    archive.reset();
+    std::filesystem::remove(path);
+}
+
+int main()
+{
+    testEntries();
+    return expect::status();
+}
@@ -0,0 +1,197 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "FlightRecorder.h"
+
+/*
+ * Decodes a flight recording saved from the tray menu, after a crash
+ * or by roar-replay, printing one event per line.
+ */
+
+namespace fs = std::filesystem;
+
+struct Options {
+    fs::path recording;
+    bool summary = false;
+};
+
+static const char* const THROTTLE_NAMES[] = {
+    "play",
+    "coalesce",
+    "limit",
+    "collapse",
+    "suppress"
+};
+
+static void usage()
+{
+    std::cerr << "usage: roar-flight <recording> [--summary]" << std::endl;
+}
+
+static bool parseOptions(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--summary") {
+            options.summary = true;
+        } else if (options.recording.empty() && arg[0] != '-') {
+            options.recording = arg;
+        } else {
+            return false;
+        }
+    }
+    return !options.recording.empty();
+}
+
+static bool readRecording(const fs::path& path, FlightDumpHeader& header, std::vector<FlightEvent>& events)
+{
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        return false;
+    }
+    if (std::memcmp(header.magic, FlightRecorder::MAGIC, sizeof(header.magic)) != 0) {
+        return false;
+    }
+
+    events.resize(header.count);
+    if (header.count > 0 && !stream.read(reinterpret_cast<char*>(events.data()), sizeof(FlightEvent) * header.count)) {
+        return false;
+    }
+
+    // Events are stored in the order their slots were claimed.
+    std::stable_sort(events.begin(), events.end(), [](const FlightEvent& a, const FlightEvent& b) {
+        return a.timestamp < b.timestamp;
+    });
+    return true;
+}
+
+static std::string formatScanCode(std::uint16_t scanCode)
+{
+    std::ostringstream stream;
+    stream << "0x" << std::hex << std::setw(4) << std::setfill('0') << scanCode;
+    return stream.str();
+}
+
+static void printDetails(const FlightEvent& event, double microsPerTick)
+{
+    switch ((FlightEventType) event.type) {
+        case FlightEventType::KEY_DOWN:
+        case FlightEventType::KEY_UP:
+        case FlightEventType::VOICE_DROP:
+            std::cout << " key " << formatScanCode(event.code);
+            break;
+        case FlightEventType::VOICE_START:
+            std::cout << " key " << formatScanCode(event.code) << " voice " << event.value;
+            break;
+        case FlightEventType::VOICE_STOP:
+        case FlightEventType::VOICE_STEAL:
+            std::cout << " voice " << event.value;
+            break;
+        case FlightEventType::THROTTLE:
+            std::cout << " key " << formatScanCode(event.code) << " "
+                << (event.value < 5 ? THROTTLE_NAMES[event.value] : "unknown");
+            break;
+        case FlightEventType::RENDER:
+            std::cout << " voices " << event.code << " took " << event.value * microsPerTick << " us";
+            break;
+        case FlightEventType::BUFFER_SUBMIT:
+            std::cout << " frames " << event.code << " position " << event.value;
+            break;
+        case FlightEventType::UNDERRUN:
+            std::cout << " position " << event.value;
+            break;
+        case FlightEventType::PACK_SWITCH:
+            std::cout << " clips " << event.value << (event.code != 0 ? " reopened" : " crossfaded");
+            break;
+        case FlightEventType::RESUME:
+        case FlightEventType::REMATERIALIZE:
+            std::cout << " took " << event.value << " us";
+            break;
+        case FlightEventType::TRIM:
+            std::cout << " resident " << event.value << " bytes";
+            break;
+        default:
+            break;
+    }
+}
+
+static void printSummary(const std::vector<FlightEvent>& events, double microsPerTick)
+{
+    std::uint64_t counts[(size_t) FlightEventType::COUNT]{};
+    double renderMicros = 0.0;
+    double maxRenderMicros = 0.0;
+
+    for (const auto& event : events) {
+        if (event.type < (std::uint16_t) FlightEventType::COUNT) {
+            counts[event.type]++;
+        }
+        if (event.type == (std::uint16_t) FlightEventType::RENDER) {
+            double micros = event.value * microsPerTick;
+            renderMicros += micros;
+            maxRenderMicros = std::max(maxRenderMicros, micros);
+        }
+    }
+
+    for (size_t type = 0; type < (size_t) FlightEventType::COUNT; type++) {
+        std::cout << std::left << std::setw(15) << FlightRecorder::getTypeName((std::uint16_t) type)
+            << counts[type] << std::endl;
+    }
+
+    std::uint64_t renders = counts[(size_t) FlightEventType::RENDER];
+    std::cout << "render time:   mean " << (renders > 0 ? renderMicros / renders : 0.0)
+        << " us, max " << maxRenderMicros << " us" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage();
+        return 2;
+    }
+
+    FlightDumpHeader header{};
+    std::vector<FlightEvent> events;
+    if (!readRecording(options.recording, header, events)) {
+        std::cerr << "Cannot read flight recording: " << options.recording << std::endl;
+        return 1;
+    }
+
+    if (events.empty()) {
+        std::cout << "No events recorded" << std::endl;
+        return 0;
+    }
+
+    const double microsPerTick = (header.ticksPerSecond > 0.0) ? 1e6 / header.ticksPerSecond : 0.0;
+
+    if (options.summary) {
+        std::cout << "events:        " << events.size() << ", over "
+            << (events.back().timestamp - events.front().timestamp) * microsPerTick / 1000.0 << " ms" << std::endl;
+        printSummary(events, microsPerTick);
+        return 0;
+    }
+
+    // Times are relative to the oldest event still in the ring.
+    const std::uint64_t origin = events.front().timestamp;
+    std::cout << std::fixed << std::setprecision(3);
+    for (const auto& event : events) {
+        std::cout << std::right << std::setw(12) << (event.timestamp - origin) * microsPerTick / 1000.0 << " ms  "
+            << std::left << std::setw(14) << FlightRecorder::getTypeName(event.type);
+        printDetails(event, microsPerTick);
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,436 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "KeyUsage.h"
+#include "SoundPack.h"
+#include "SoundPackRepository.h"
+#include "SoundResource.h"
+#include "SoundResourceReader.h"
+#include <vorbis/vorbisenc.h>
+
+/*
+ * Rewrites an unpacked sound pack so that its sound file holds only the
+ * slices its keys play, each once, the slices of the keys typed most first,
+ * and reports how much faster the pack loads afterwards.
+ */
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+static const char CONFIG_NAME[] = "config.json";
+
+// Silence between slices, so that the encoder does not smear one into the next.
+static const int GAP_MILLIS = 20;
+
+static const std::uint16_t WAVE_FORMAT_PCM_TAG = 1;
+
+// Canonical 44-byte header of a WAV file.
+struct WaveFileHeader {
+    char riff[4];
+    std::uint32_t riffSize;
+    char wave[4];
+    char fmt[4];
+    std::uint32_t fmtSize;
+    std::uint16_t formatTag;
+    std::uint16_t numberOfChannels;
+    std::uint32_t samplingRate;
+    std::uint32_t bytesPerSec;
+    std::uint16_t blockAlign;
+    std::uint16_t bitsPerSample;
+    char data[4];
+    std::uint32_t dataSize;
+};
+
+struct Options {
+    fs::path root = fs::current_path();
+    fs::path output;
+    fs::path keyUsage;
+    std::wstring pack = L"cherrymx-black-abs";
+    // Vorbis quality from -0.1 to 1.0.
+    float quality = 0.8f;
+};
+
+// Start and duration of a slice in milliseconds, as in config.json.
+using Slice = std::pair<int, int>;
+
+struct PackedSlice {
+    Slice source;
+    Slice target;
+    std::uint64_t presses = 0;
+    int rank = KeyUsage::COMMON_KEY_COUNT;
+};
+
+struct LoadTimes {
+    std::uint64_t loadMicros;
+    std::uint64_t decodeMicros;
+    std::uint64_t ioWaitMicros;
+};
+
+static void usage()
+{
+    std::cerr << "usage: roar-packopt --output <dir> [--root <dir>] [--pack <name>]"
+        " [--key-usage <file>] [--quality <-0.1..1.0>]" << std::endl;
+}
+
+static bool parseArguments(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--root" && hasValue) {
+            options.root = argv[++i];
+        } else if (arg == "--output" && hasValue) {
+            options.output = argv[++i];
+        } else if (arg == "--pack" && hasValue) {
+            options.pack = fs::path(argv[++i]).wstring();
+        } else if (arg == "--key-usage" && hasValue) {
+            options.keyUsage = argv[++i];
+        } else if (arg == "--quality" && hasValue) {
+            options.quality = std::stof(argv[++i]);
+        } else {
+            return false;
+        }
+    }
+    return !options.output.empty() && options.quality >= -0.1f && options.quality <= 1.0f;
+}
+
+static bool parseOptions(int argc, char* argv[], Options& options)
+{
+    try {
+        return parseArguments(argc, argv, options);
+    } catch (const std::logic_error&) {
+        // A quality which cannot be parsed or is out of range.
+        return false;
+    }
+}
+
+/*
+ * Loads the pack as roar does without key usage, decoding the whole sound file.
+ */
+static bool measureLoad(const fs::path& root, const std::wstring& pack, LoadTimes& times)
+{
+    SoundPackRepository repository({root});
+    std::unique_ptr<SoundPack> soundPack(repository.load(pack.c_str()));
+    if (!soundPack) {
+        return false;
+    }
+    soundPack->waitForClips();
+    times = LoadTimes{soundPack->getLoadMicros(), soundPack->getDecodeMicros(), soundPack->getIoWaitMicros()};
+    return true;
+}
+
+/*
+ * Reads the slice of each key, keeping the keys as they are written.
+ */
+static std::map<std::string, Slice> readKeys(const json& config)
+{
+    std::map<std::string, Slice> keys;
+    if (!config.contains("keys") || !config.at("keys").is_object()) {
+        return keys;
+    }
+    for (auto& [key, value] : config.at("keys").items()) {
+        if (value.is_array() && value.size() == 2 && value.at(0).is_number() && value.at(1).is_number()) {
+            keys[key] = Slice(value.at(0).get<int>(), value.at(1).get<int>());
+        }
+    }
+    return keys;
+}
+
+/*
+ * Identical slices are kept once. They are ordered by the number of presses
+ * of their keys, then by how common their keys are in text, so that the
+ * clips loaded first are at the start of the file.
+ */
+static std::vector<PackedSlice> orderSlices(const std::map<std::string, Slice>& keys, const KeyUsage* keyUsage)
+{
+    std::map<Slice, PackedSlice> unique;
+    for (const auto& [key, slice] : keys) {
+        PackedSlice& packed = unique[slice];
+        packed.source = slice;
+        int scanCode = 0;
+        try {
+            scanCode = std::stoi(key);
+        } catch (const std::exception& e) {
+            continue;
+        }
+        if (keyUsage != nullptr) {
+            packed.presses += keyUsage->getCount(scanCode);
+        }
+        auto common = std::find(std::begin(KeyUsage::COMMON_KEYS), std::end(KeyUsage::COMMON_KEYS), scanCode);
+        packed.rank = std::min(packed.rank, (int) (common - std::begin(KeyUsage::COMMON_KEYS)));
+    }
+
+    std::vector<PackedSlice> slices;
+    for (const auto& [slice, packed] : unique) {
+        slices.push_back(packed);
+    }
+    std::stable_sort(slices.begin(), slices.end(), [](const PackedSlice& a, const PackedSlice& b) {
+        if (a.presses != b.presses) {
+            return a.presses > b.presses;
+        }
+        return a.rank < b.rank;
+    });
+    return slices;
+}
+
+/*
+ * Copies the samples of each slice after the previous one, returning the
+ * packed samples. A slice starts on a whole millisecond so that it covers
+ * exactly the samples it did before.
+ */
+static std::vector<std::uint8_t> packSamples(SoundResource& resource, std::vector<PackedSlice>& slices)
+{
+    const int samplingRate = resource.getSamplingRate();
+    const int blockAlign = resource.getBlockAlign();
+
+    std::vector<std::uint8_t> samples;
+    int position = 0;
+    for (auto& slice : slices) {
+        SampleRange source = SoundResource::getSliceRange(
+            samplingRate, blockAlign, resource.getLength(), slice.source.first, slice.source.second);
+        slice.target = Slice(position, slice.source.second);
+
+        // Sized as if the slice ran on, so that it is never cut short.
+        SampleRange target = SoundResource::getSliceRange(
+            samplingRate, blockAlign, UINT64_MAX, position, slice.source.second + GAP_MILLIS);
+        samples.resize(target.offset + target.length, 0);
+        std::memcpy(samples.data() + target.offset, resource.getData() + source.offset, source.length);
+
+        position += slice.source.second + GAP_MILLIS;
+    }
+    return samples;
+}
+
+static bool writeWave(const fs::path& path, SoundResource& resource, const std::vector<std::uint8_t>& samples)
+{
+    WaveFileHeader header{
+        {'R', 'I', 'F', 'F'},
+        (std::uint32_t) (sizeof(WaveFileHeader) - 8 + samples.size()),
+        {'W', 'A', 'V', 'E'},
+        {'f', 'm', 't', ' '},
+        16,
+        WAVE_FORMAT_PCM_TAG,
+        (std::uint16_t) resource.getNumberOfChannels(),
+        (std::uint32_t) resource.getSamplingRate(),
+        (std::uint32_t) resource.getBytesPerSec(),
+        (std::uint16_t) resource.getBlockAlign(),
+        (std::uint16_t) resource.getBitsPerSample(),
+        {'d', 'a', 't', 'a'},
+        (std::uint32_t) samples.size()
+    };
+
+    std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    stream.write(reinterpret_cast<const char*>(samples.data()), samples.size());
+    return stream.good();
+}
+
+static void writePages(ogg_stream_state& stream, std::ofstream& out, bool flush)
+{
+    ogg_page page;
+    while (flush ? ogg_stream_flush(&stream, &page) : ogg_stream_pageout(&stream, &page)) {
+        out.write(reinterpret_cast<const char*>(page.header), page.header_len);
+        out.write(reinterpret_cast<const char*>(page.body), page.body_len);
+    }
+}
+
+/*
+ * Encodes the 16-bit samples with Vorbis at the given quality.
+ */
+static bool writeOgg(const fs::path& path, SoundResource& resource, const std::vector<std::uint8_t>& samples, float quality)
+{
+    static const int FRAMES_PER_WRITE = 4096;
+
+    const int channels = resource.getNumberOfChannels();
+
+    vorbis_info info;
+    vorbis_info_init(&info);
+    if (vorbis_encode_init_vbr(&info, channels, resource.getSamplingRate(), quality) != 0) {
+        vorbis_info_clear(&info);
+        return false;
+    }
+
+    vorbis_comment comment;
+    vorbis_comment_init(&comment);
+    vorbis_comment_add_tag(&comment, "ENCODER", "roar-packopt");
+
+    vorbis_dsp_state dsp;
+    vorbis_block block;
+    vorbis_analysis_init(&dsp, &info);
+    vorbis_block_init(&dsp, &block);
+
+    ogg_stream_state stream;
+    ogg_stream_init(&stream, 1);
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+
+    ogg_packet header, commentHeader, codeHeader;
+    vorbis_analysis_headerout(&dsp, &comment, &header, &commentHeader, &codeHeader);
+    ogg_stream_packetin(&stream, &header);
+    ogg_stream_packetin(&stream, &commentHeader);
+    ogg_stream_packetin(&stream, &codeHeader);
+    // Audio starts on a page of its own.
+    writePages(stream, out, true);
+
+    const std::int16_t* input = reinterpret_cast<const std::int16_t*>(samples.data());
+    const std::size_t totalFrames = samples.size() / resource.getBlockAlign();
+    std::size_t frame = 0;
+    bool done = false;
+    while (!done) {
+        const int frames = (int) std::min<std::size_t>(FRAMES_PER_WRITE, totalFrames - frame);
+        if (frames > 0) {
+            float** buffer = vorbis_analysis_buffer(&dsp, frames);
+            for (int i = 0; i < frames; i++) {
+                for (int channel = 0; channel < channels; channel++) {
+                    buffer[channel][i] = input[(frame + i) * channels + channel] / 32768.0f;
+                }
+            }
+            frame += frames;
+        }
+        // Writing no frames marks the end of the stream.
+        vorbis_analysis_wrote(&dsp, frames);
+
+        while (vorbis_analysis_blockout(&dsp, &block) == 1) {
+            vorbis_analysis(&block, nullptr);
+            vorbis_bitrate_addblock(&block);
+            ogg_packet packet;
+            while (vorbis_bitrate_flushpacket(&dsp, &packet)) {
+                ogg_stream_packetin(&stream, &packet);
+                writePages(stream, out, false);
+            }
+        }
+        done = frames == 0;
+    }
+    writePages(stream, out, true);
+
+    ogg_stream_clear(&stream);
+    vorbis_block_clear(&block);
+    vorbis_dsp_clear(&dsp);
+    vorbis_comment_clear(&comment);
+    vorbis_info_clear(&info);
+    return out.good();
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage();
+        return 2;
+    }
+
+    const fs::path source = options.root / "sound" / options.pack;
+    const fs::path target = options.output / "sound" / options.pack;
+    if (!fs::exists(source / CONFIG_NAME)) {
+        std::cerr << "Cannot find an unpacked sound pack: " << source << std::endl;
+        return 1;
+    }
+    std::error_code error;
+    if (fs::equivalent(source, target, error)) {
+        std::cerr << "The output must not be the pack itself" << std::endl;
+        return 2;
+    }
+
+    KeyUsage keyUsage(options.keyUsage);
+    if (!options.keyUsage.empty() && !keyUsage.load()) {
+        std::cerr << "Cannot read key usage: " << options.keyUsage << std::endl;
+        return 1;
+    }
+
+    LoadTimes before{};
+    if (!measureLoad(options.root, options.pack, before)) {
+        std::cerr << "Cannot load sound pack: " << source << std::endl;
+        return 1;
+    }
+
+    json config;
+    {
+        std::ifstream stream(source / CONFIG_NAME);
+        config = json::parse(stream, nullptr, false);
+    }
+    if (!config.is_object()) {
+        std::cerr << "Cannot parse " << (source / CONFIG_NAME) << std::endl;
+        return 1;
+    }
+
+    const std::string sound = config.value("sound", std::string("sound.wav"));
+    std::unique_ptr<SoundResourceReader> reader(SoundResourceReader::fromFile(source / sound));
+    std::unique_ptr<SoundResource> resource(reader ? reader->read() : nullptr);
+    if (!resource) {
+        std::cerr << "Cannot read " << (source / sound) << std::endl;
+        return 1;
+    }
+
+    auto keys = readKeys(config);
+    auto slices = orderSlices(keys, options.keyUsage.empty() ? nullptr : &keyUsage);
+    auto samples = packSamples(*resource, slices);
+
+    std::map<Slice, Slice> moved;
+    for (const auto& slice : slices) {
+        moved[slice.source] = slice.target;
+    }
+    json packedKeys = json::object();
+    for (const auto& [key, slice] : keys) {
+        const Slice& target = moved[slice];
+        packedKeys[key] = json::array({target.first, target.second});
+    }
+    config["keys"] = packedKeys;
+
+    fs::create_directories(target, error);
+    if (error) {
+        std::cerr << "Cannot create " << target << std::endl;
+        return 1;
+    }
+
+    // Notices, impulse responses and anything else of the pack go along unchanged.
+    for (const auto& item : fs::directory_iterator(source)) {
+        const fs::path name = item.path().filename();
+        if (item.is_regular_file() && name != CONFIG_NAME && name != fs::path(sound)) {
+            fs::copy_file(item.path(), target / name, fs::copy_options::overwrite_existing, error);
+        }
+    }
+
+    bool written = (fs::path(sound).extension() == ".ogg")
+        ? writeOgg(target / sound, *resource, samples, options.quality)
+        : writeWave(target / sound, *resource, samples);
+    std::ofstream configStream(target / CONFIG_NAME, std::ios::trunc);
+    configStream << config.dump(2) << std::endl;
+    if (!written || !configStream.good()) {
+        std::cerr << "Cannot write the sound pack to " << target << std::endl;
+        return 1;
+    }
+    configStream.close();
+
+    LoadTimes after{};
+    if (!measureLoad(options.output, options.pack, after)) {
+        std::cerr << "Cannot load the rewritten sound pack: " << target << std::endl;
+        return 1;
+    }
+
+    const double sourceSeconds = (double) resource->getLength() / resource->getBytesPerSec();
+    const double targetSeconds = (double) samples.size() / resource->getBytesPerSec();
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "keys:        " << keys.size() << ", slices " << slices.size() << std::endl;
+    std::cout << "duration:    " << sourceSeconds << " s -> " << targetSeconds << " s" << std::endl;
+    std::cout << "file size:   " << fs::file_size(source / sound) / 1024.0 << " KiB -> "
+        << fs::file_size(target / sound) / 1024.0 << " KiB" << std::endl;
+    std::cout << "pack load:   " << before.loadMicros / 1000.0 << " ms -> "
+        << after.loadMicros / 1000.0 << " ms" << std::endl;
+    std::cout << "decode:      " << before.decodeMicros / 1000.0 << " ms -> "
+        << after.decodeMicros / 1000.0 << " ms" << std::endl;
+    std::cout << "I/O wait:    " << before.ioWaitMicros / 1000.0 << " ms -> "
+        << after.ioWaitMicros / 1000.0 << " ms" << std::endl;
+    return 0;
+}
@@ -0,0 +1,314 @@
+/*
+ * Copyright 2024 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "AllocationGuard.h"
+#include "FlightRecorder.h"
+#include "KeyTrace.h"
+#include "KeyUsage.h"
+#include "NullAudioBackend.h"
+#include "SoundPack.h"
+#include "SoundPackRepository.h"
+#include "SoundPlayer.h"
+
+/*
+ * Replays a key trace recorded with --record-trace against a sound pack
+ * on a simulated clock, and reports how the voices coped with it.
+ */
+
+namespace fs = std::filesystem;
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    fs::path trace;
+    fs::path root = fs::current_path();
+    fs::path wav;
+    fs::path flight;
+    fs::path keyUsage;
+    std::wstring pack = L"cherrymx-black-abs";
+    // Divides the recorded times. The simulated clock never waits for real
+    // time, so the replay runs as fast as it renders whatever the speed.
+    double speed = 1.0;
+    bool steal = false;
+    bool schedule = true;
+    bool checkAllocations = false;
+    bool reverb = true;
+    int voices = 0;
+    int idleMillis = 0;
+    int trimMillis = 0;
+    InputThrottle::Limits limits;
+};
+
+static void usage()
+{
+    std::cerr << "usage: roar-replay <trace> [--root <dir>] [--pack <name>]"
+        " [--speed <factor>] [--steal] [--no-schedule] [--wav <file>]"
+        " [--check-allocations] [--voices <count>] [--idle-timeout <ms>] [--trim-timeout <ms>]"
+        " [--max-rate <starts per second>] [--collapse-floods]"
+        " [--flight-file <file>] [--key-usage <file>] [--no-reverb]" << std::endl;
+}
+
+static bool parseArguments(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--root" && hasValue) {
+            options.root = argv[++i];
+        } else if (arg == "--pack" && hasValue) {
+            options.pack = fs::path(argv[++i]).wstring();
+        } else if (arg == "--speed" && hasValue) {
+            options.speed = std::stod(argv[++i]);
+        } else if (arg == "--voices" && hasValue) {
+            options.voices = std::stoi(argv[++i]);
+        } else if (arg == "--idle-timeout" && hasValue) {
+            options.idleMillis = std::stoi(argv[++i]);
+        } else if (arg == "--trim-timeout" && hasValue) {
+            options.trimMillis = std::stoi(argv[++i]);
+        } else if (arg == "--max-rate" && hasValue) {
+            options.limits.startsPerSecond = std::stoi(argv[++i]);
+        } else if (arg == "--collapse-floods") {
+            options.limits.collapseFloods = true;
+        } else if (arg == "--key-usage" && hasValue) {
+            options.keyUsage = argv[++i];
+        } else if (arg == "--flight-file" && hasValue) {
+            options.flight = argv[++i];
+        } else if (arg == "--wav" && hasValue) {
+            options.wav = argv[++i];
+        } else if (arg == "--steal") {
+            options.steal = true;
+        } else if (arg == "--no-schedule") {
+            options.schedule = false;
+        } else if (arg == "--check-allocations") {
+            options.checkAllocations = true;
+        } else if (arg == "--no-reverb") {
+            options.reverb = false;
+        } else if (options.trace.empty() && arg[0] != '-') {
+            options.trace = arg;
+        } else {
+            return false;
+        }
+    }
+    return !options.trace.empty() && options.speed > 0.0;
+}
+
+static bool parseOptions(int argc, char* argv[], Options& options)
+{
+    try {
+        return parseArguments(argc, argv, options);
+    } catch (const std::logic_error&) {
+        // Numbers which cannot be parsed or are out of range.
+        return false;
+    }
+}
+
+// Fewest and most bytes held by the sound packs while replaying.
+struct ResidentRange {
+    std::uint64_t minimum = UINT64_MAX;
+    std::uint64_t maximum = 0;
+
+    void add(std::uint64_t bytes) {
+        minimum = std::min(minimum, bytes);
+        maximum = std::max(maximum, bytes);
+    }
+};
+
+/*
+ * Renders blocks up to the given frame, checking for idle output
+ * after each of them as the window timer does.
+ */
+static void advance(NullAudioBackend* backend, SoundPlayer* player, std::uint64_t frame, ResidentRange& resident)
+{
+    while (backend->getFramePosition() < frame && backend->renderBlock()) {
+        player->suspendIfIdle();
+        player->trimIfIdle();
+        resident.add(player->getMetrics().residentBytes);
+    }
+}
+
+static double percentile(std::vector<double>& sorted, double p)
+{
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t index = (size_t) (p * (sorted.size() - 1));
+    return sorted[index];
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage();
+        return 2;
+    }
+
+    if (options.checkAllocations && !AllocationGuard::isEnabled()) {
+        std::cerr << "Build with ROAR_ALLOCATION_GUARD to check allocations" << std::endl;
+        return 2;
+    }
+
+    if (options.checkAllocations && options.trimMillis > 0) {
+        std::cerr << "Restoring released samples allocates, so --trim-timeout cannot be checked" << std::endl;
+        return 2;
+    }
+
+    std::vector<KeyEvent> events;
+    if (!KeyTraceReader::read(options.trace, events)) {
+        std::cerr << "Cannot read trace: " << options.trace << std::endl;
+        return 1;
+    }
+
+    // Loads the pack progressively as roar does.
+    KeyUsage keyUsage(options.keyUsage);
+    SoundPackRepository repository({options.root});
+    if (!options.keyUsage.empty()) {
+        keyUsage.load();
+        repository.setKeyUsage(&keyUsage);
+    }
+
+    SoundPack* soundPack = repository.load(options.pack.c_str());
+    if (soundPack == nullptr) {
+        std::cerr << "Cannot load sound pack, available packs:" << std::endl;
+        for (const auto& name : repository.list()) {
+            std::cerr << "  " << fs::path(name).string() << std::endl;
+        }
+        return 1;
+    }
+
+    const int samplingRate = soundPack->getSamplingRate();
+
+    // Replays do not depend on how fast the clips stream in.
+    const std::uint64_t loadMicros = soundPack->getLoadMicros();
+    const std::uint64_t decodeMicros = soundPack->getDecodeMicros();
+    const std::uint64_t ioWaitMicros = soundPack->getIoWaitMicros();
+    soundPack->waitForClips();
+    const std::uint64_t streamMicros = soundPack->getStreamMicros();
+
+    NullAudioBackend* backend = options.wav.empty()
+        ? new NullAudioBackend()
+        : NullAudioBackend::create(options.wav);
+
+    SoundPlayer* player = SoundPlayer::create(backend);
+    player->setVoiceStealing(options.steal);
+    player->setScheduling(options.schedule);
+    if (options.voices > 0) {
+        player->setVoiceCount(options.voices);
+    }
+    player->setIdleTimeout(options.idleMillis);
+    player->setTrimTimeout(options.trimMillis);
+    player->setInputLimits(options.limits);
+    player->setReverb(options.reverb);
+    if (!player->setSoundPack(soundPack)) {
+        std::cerr << "Cannot write output: " << options.wav << std::endl;
+        delete player;
+        return 1;
+    }
+
+    ResidentRange resident;
+    std::unordered_map<int, bool> keyState;
+    std::vector<double> micros;
+    micros.reserve(events.size());
+
+    for (const auto& event : events) {
+        // Time of the event on the simulated clock, which is rendered up to it.
+        const double seconds = event.timestamp / 1e6 / options.speed;
+        const std::uint64_t timestamp = (std::uint64_t) (seconds * 1e6);
+        // Writing the WAV file allocates stdio buffers on its own.
+        if (options.wav.empty()) {
+            AllocationGuard guard;
+            advance(backend, player, (std::uint64_t) (seconds * samplingRate), resident);
+        } else {
+            advance(backend, player, (std::uint64_t) (seconds * samplingRate), resident);
+        }
+
+        FlightRecorder::get().record(event.down ? FlightEventType::KEY_DOWN : FlightEventType::KEY_UP, event.scanCode);
+
+        if (!event.down) {
+            keyState[event.scanCode] = false;
+            continue;
+        }
+
+        // Auto repeats are ignored just as the window does.
+        if (keyState[event.scanCode]) {
+            continue;
+        }
+        keyState[event.scanCode] = true;
+
+        auto start = Clock::now();
+        {
+            AllocationGuard guard;
+            player->playSound(event.scanCode, timestamp);
+        }
+        auto elapsed = Clock::now() - start;
+        micros.push_back(std::chrono::duration<double, std::micro>(elapsed).count());
+    }
+
+    // Lets the last sounds ring out.
+    advance(backend, player, backend->getFramePosition() + samplingRate, resident);
+
+    SoundPlayer::Statistics statistics = player->getStatistics();
+    Metrics& metrics = player->getMetrics();
+
+    std::sort(micros.begin(), micros.end());
+    double total = 0.0;
+    for (double value : micros) {
+        total += value;
+    }
+
+    std::cout << "pack load:   " << loadMicros / 1000.0 << " ms, decode "
+        << decodeMicros / 1000.0 << " ms, I/O wait " << ioWaitMicros / 1000.0
+        << " ms, streamed " << streamMicros / 1000.0 << " ms" << std::endl;
+    std::cout << "events:      " << events.size() << std::endl;
+    std::cout << "key downs:   " << micros.size() << std::endl;
+    std::cout << "plays:       " << statistics.plays << std::endl;
+    std::cout << "drops:       " << statistics.drops << std::endl;
+    std::cout << "steals:      " << statistics.steals << std::endl;
+    std::cout << "peak voices: " << statistics.peakVoices << std::endl;
+    const double millisPerFrame = 1000.0 / samplingRate;
+    std::cout << "onset:       mean " << statistics.onset.getMean() * millisPerFrame
+        << " ms, jitter " << statistics.onset.getJitter() * millisPerFrame
+        << " ms, late " << statistics.onset.late << std::endl;
+    std::cout << "cpu/event:   mean " << (micros.empty() ? 0.0 : total / micros.size())
+        << " us, p99 " << percentile(micros, 0.99)
+        << " us, max " << percentile(micros, 1.0) << " us" << std::endl;
+    std::cout << "throttled:   coalesced " << metrics.coalesced
+        << ", limited " << metrics.limited
+        << ", collapsed " << metrics.collapsed << std::endl;
+    std::cout << "idle:        suspends " << metrics.suspends
+        << ", resumes " << metrics.resumes
+        << ", resume max " << metrics.maxResumeMicros << " us" << std::endl;
+    std::cout << "trim:        trims " << metrics.trims
+        << ", rematerialize max " << metrics.maxRematerializeMicros << " us"
+        << ", resident " << std::min(resident.minimum, resident.maximum)
+        << " to " << resident.maximum << " bytes" << std::endl;
+
+    if (AllocationGuard::isEnabled()) {
+        std::cout << "allocations: " << AllocationGuard::getCount() << std::endl;
+    }
+
+    delete player;
+
+    if (!options.flight.empty() && !FlightRecorder::get().dump(options.flight)) {
+        std::cerr << "Cannot write flight recording: " << options.flight << std::endl;
+    }
+
+    if (options.checkAllocations && AllocationGuard::getCount() > 0) {
+        std::cerr << "Heap allocated between key events and output" << std::endl;
+        return 3;
+    }
+
+    return 0;
+}